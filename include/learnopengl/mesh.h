@@ -8,6 +8,7 @@
 
 #include <learnopengl/shader.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,10 +28,37 @@ struct Vertex {
 
 
 
+// kind of a material texture, doubles as the fixed sampler unit it is bound to
+enum class TextureKind : uint8_t {
+    Diffuse = 0,
+    Specular = 1,
+    Normal = 2,
+    Height = 3,
+    Count
+};
+
 struct Texture {
     unsigned int id;
-    string type;
+    TextureKind kind;
     string path;
+    bool cutOut = false; // has texels with alpha below one half
+};
+
+// Points the material samplers of a program at their fixed units, once after the program is built.
+// The samplers are named prefix + "diffuse", "specular", "normal" and "height"; missing ones are ignored.
+inline void SetMaterialSamplers(Shader &shader, const string &prefix)
+{
+    static const char* names[] = {"diffuse", "specular", "normal", "height"};
+    shader.use();
+    for (int kind = 0; kind < (int)TextureKind::Count; kind++)
+        shader.setInt(prefix + names[kind], kind);
+}
+
+// Textures of a mesh resolved to their sampler units at load time
+struct MaterialBindings {
+    unsigned int units[(int)TextureKind::Count];
+    unsigned int textures[(int)TextureKind::Count];
+    unsigned int count = 0;
 };
 
 class Mesh {
@@ -39,9 +67,15 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    MaterialBindings     bindings;
 
     unsigned int VAO;
-    std::string glslIdentifierPrefix;
+    // attribute location of the lightmap UVs, see SetLightmapUVs
+    static const unsigned int LightmapUVLocation = 6;
+    // position-only stream for depth-only passes, shares the index buffer with VAO
+    unsigned int depthVAO;
+    // copy of the mesh with lightmap UVs, 0 without them; see SetLightmapUVs
+    unsigned int lightmapVAO = 0;
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -51,51 +85,148 @@ public:
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        setupBindings();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    bool HasTexture(TextureKind kind) const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        for (const Texture &texture : textures) {
+            if (texture.kind == kind)
+                return true;
         }
+        return false;
+    }
 
-
+    // render the mesh, the shader's material samplers were set up with SetMaterialSamplers. lightmapped
+    // picks the copy with lightmap UVs if there is one, for shaders that read them.
+    void Draw(Shader &, bool lightmapped = false)
+    {
+        // bind the textures to their fixed units
+        for(unsigned int i = 0; i < bindings.count; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + bindings.units[i]);
+            glBindTexture(GL_TEXTURE_2D, bindings.textures[i]);
+        }
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        if (lightmapped && lightmapVAO) {
+            glBindVertexArray(lightmapVAO);
+            glDrawElements(GL_TRIANGLES, lightmapIndexCount, GL_UNSIGNED_INT, 0);
+        } else {
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        }
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // Lightmap UVs for the corners of every triangle, three per triangle in index order. A vertex keeps one
+    // UV where all its corners agree on it and is split where they don't, into a copy of the mesh of its
+    // own: only the lightmapped forward pass draws that one, every other pass keeps the indexed mesh and
+    // its post-transform cache hits.
+    void SetLightmapUVs(const vector<glm::vec2> &cornerUVs)
+    {
+        if (cornerUVs.size() != indices.size())
+            return;
+        // the split vertices of every original one, as (uv, index in the copy)
+        vector<vector<pair<glm::vec2, unsigned int>>> splits(vertices.size());
+        vector<Vertex> splitVertices;
+        vector<glm::vec2> splitUVs;
+        vector<unsigned int> splitIndices(indices.size());
+        splitVertices.reserve(vertices.size());
+        splitUVs.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            vector<pair<glm::vec2, unsigned int>> &copies = splits[indices[i]];
+            size_t copy = 0;
+            while (copy < copies.size() && copies[copy].first != cornerUVs[i])
+                copy++;
+            if (copy == copies.size()) {
+                copies.push_back(make_pair(cornerUVs[i], (unsigned int)splitVertices.size()));
+                splitVertices.push_back(vertices[indices[i]]);
+                splitUVs.push_back(cornerUVs[i]);
+            }
+            splitIndices[i] = copies[copy].second;
+        }
+
+        if (lightmapVAO == 0) {
+            glGenVertexArrays(1, &lightmapVAO);
+            glGenBuffers(1, &lightmapVBO);
+            glGenBuffers(1, &lightmapUVBO);
+            glGenBuffers(1, &lightmapEBO);
+        }
+        glBindVertexArray(lightmapVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, lightmapVBO);
+        glBufferData(GL_ARRAY_BUFFER, splitVertices.size() * sizeof(Vertex), &splitVertices[0], GL_STATIC_DRAW);
+        setVertexAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lightmapEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, splitIndices.size() * sizeof(unsigned int), &splitIndices[0],
+                     GL_STATIC_DRAW);
+        // a stream of its own, so the Vertex layout stays the same as the indexed mesh's
+        glBindBuffer(GL_ARRAY_BUFFER, lightmapUVBO);
+        glBufferData(GL_ARRAY_BUFFER, splitUVs.size() * sizeof(glm::vec2), &splitUVs[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(LightmapUVLocation);
+        glVertexAttribPointer(LightmapUVLocation, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        glBindVertexArray(0);
+        lightmapIndexCount = splitIndices.size();
+    }
+
+    // render only the positions, for passes that write depth alone
+    void DrawDepth()
+    {
+        glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
 private:
     // render data
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO;
+    unsigned int lightmapVBO = 0, lightmapUVBO = 0, lightmapEBO = 0;
+    size_t lightmapIndexCount = 0;
+
+    // first texture of every kind goes to that kind's unit. A missing specular map falls back to the
+    // diffuse one, which is what the shaders ended up sampling before materials had fixed slots.
+    void setupBindings()
+    {
+        unsigned int byKind[(int)TextureKind::Count] = {};
+        for (const Texture &texture : textures) {
+            unsigned int &slot = byKind[(int)texture.kind];
+            if (slot == 0)
+                slot = texture.id;
+        }
+        unsigned int &specular = byKind[(int)TextureKind::Specular];
+        if (specular == 0)
+            specular = byKind[(int)TextureKind::Diffuse];
+        for (int kind = 0; kind < (int)TextureKind::Count; kind++) {
+            if (byKind[kind] == 0)
+                continue;
+            bindings.units[bindings.count] = (unsigned int)kind;
+            bindings.textures[bindings.count] = byKind[kind];
+            bindings.count++;
+        }
+    }
+
+    // the Vertex attribute pointers into the bound array buffer, for the bound VAO
+    static void setVertexAttributes()
+    {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -116,22 +247,20 @@ private:
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
-        // set the vertex attribute pointers
-        // vertex Positions
+        setVertexAttributes();
+
+        // tightly packed positions, so depth-only passes don't drag normals and tangents through the cache
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
 
         glBindVertexArray(0);
     }
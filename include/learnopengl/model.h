@@ -18,10 +18,11 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool *cutOut = nullptr);
 
 
 
@@ -33,6 +34,12 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // local space bounding box of all meshes, used for culling
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // material features the renderer picks shader variants by
+    bool normalMapped = false; // every mesh has a normal map
+    bool alphaTested = false;  // some diffuse map has cut-out texels
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -40,19 +47,82 @@ public:
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // draws the model, and thus all its meshes; lightmapped as for Mesh::Draw
+    void Draw(Shader &shader, bool lightmapped = false)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, lightmapped);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+    // draws positions only, the caller has the depth-only shader bound
+    void DrawDepth()
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth();
+    }
+
+    // A coarser copy for distant LODs, by vertex clustering: the bounds are cut into cells^3 cells and
+    // the vertices of a mesh that share a cell become one, at their average position and normal with
+    // the first one's texture coordinates. Triangles that collapse are dropped. Shares the textures and
+    // stays within the bounds, so culling by the source model's bounds still holds.
+    Model Simplified(int cells) const
+    {
+        Model simplified;
+        simplified.textures_loaded = textures_loaded;
+        simplified.directory = directory;
+        simplified.gammaCorrection = gammaCorrection;
+        simplified.boundsMin = boundsMin;
+        simplified.boundsMax = boundsMax;
+        simplified.normalMapped = normalMapped;
+        simplified.alphaTested = alphaTested;
+        glm::vec3 cellScale = glm::vec3((float)cells) / glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+        for (const Mesh &mesh : meshes) {
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            vector<unsigned int> merged(mesh.vertices.size());
+            vector<float> weights;
+            unordered_map<unsigned int, unsigned int> clusters;
+            for (size_t i = 0; i < mesh.vertices.size(); i++) {
+                glm::vec3 cell = (mesh.vertices[i].Position - boundsMin) * cellScale;
+                unsigned int key = 0;
+                for (int a = 2; a >= 0; a--)
+                    key = key * (unsigned int)cells + (unsigned int)std::min(std::max((int)cell[a], 0), cells - 1);
+                auto found = clusters.find(key);
+                if (found == clusters.end()) {
+                    found = clusters.insert(make_pair(key, (unsigned int)vertices.size())).first;
+                    vertices.push_back(mesh.vertices[i]);
+                    weights.push_back(1.0f);
+                } else {
+                    Vertex &vertex = vertices[found->second];
+                    float &weight = weights[found->second];
+                    vertex.Position = (vertex.Position * weight + mesh.vertices[i].Position) / (weight + 1.0f);
+                    vertex.Normal += mesh.vertices[i].Normal;
+                    weight += 1.0f;
+                }
+                merged[i] = found->second;
+            }
+            for (Vertex &vertex : vertices) {
+                if (glm::dot(vertex.Normal, vertex.Normal) > 0.0f)
+                    vertex.Normal = glm::normalize(vertex.Normal);
+            }
+            for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+                unsigned int a = merged[mesh.indices[i]], b = merged[mesh.indices[i + 1]], c = merged[mesh.indices[i + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                indices.push_back(a);
+                indices.push_back(b);
+                indices.push_back(c);
+            }
+            if (!indices.empty())
+                simplified.meshes.push_back(Mesh(vertices, indices, mesh.textures));
         }
+        return simplified;
     }
 private:
+    Model() : gammaCorrection(false)
+    {
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
@@ -70,6 +140,13 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        normalMapped = !meshes.empty();
+        for (const Mesh &mesh : meshes) {
+            normalMapped = normalMapped && mesh.HasTexture(TextureKind::Normal);
+            for (const Texture &texture : mesh.textures)
+                alphaTested = alphaTested || (texture.kind == TextureKind::Diffuse && texture.cutOut);
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -108,6 +185,12 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            if (meshes.empty() && i == 0) {
+                boundsMin = vector;
+                boundsMax = vector;
+            }
+            boundsMin = glm::min(boundsMin, vector);
+            boundsMax = glm::max(boundsMax, vector);
             // normals
             if (mesh->HasNormals())
             {
@@ -153,27 +236,23 @@ private:
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        // textures are tagged with their kind here, the mesh resolves them to fixed sampler units
+        // (see TextureKind and SetMaterialSamplers), so drawing needs no sampler names at all
         aiColor3D color(0.0f, 0.0f, 0.0f);
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TextureKind::Diffuse);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TextureKind::Specular);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TextureKind::Normal);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TextureKind::Height);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 
@@ -184,7 +263,7 @@ private:
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureKind kind)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
@@ -198,6 +277,7 @@ private:
                 if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
                 {
                     textures.push_back(textures_loaded[j]);
+                    textures.back().kind = kind; // the same image may serve as another kind of map
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
                     break;
                 }
@@ -205,8 +285,8 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
+                texture.id = TextureFromFile(str.C_Str(), this->directory, false, &texture.cutOut);
+                texture.kind = kind;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
@@ -217,7 +297,7 @@ private:
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool *cutOut)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
@@ -237,6 +317,12 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
+        if (cutOut) {
+            *cutOut = false;
+            for (int i = 3; nrComponents == 4 && i < width * height * 4 && !*cutOut; i += 4)
+                *cutOut = data[i] < 128;
+        }
+
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
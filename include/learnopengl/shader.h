@@ -103,6 +103,9 @@ public:
             glDeleteShader(geometry);
 
     }
+    // wraps a program that was linked elsewhere, e.g. by rg::ShaderLibrary
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int programId) : ID(programId) {}
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
@@ -0,0 +1,131 @@
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+
+namespace rg {
+
+// Exposure from the scene's average brightness, entirely on the GPU. The luminance pass writes the log
+// of the scene's luminance into a fixed 256x256 target, weighted towards the centre of the screen, and
+// glGenerateMipmap reduces it to its mean in the 1x1 level: the scene's geometric mean luminance. The
+// adapt pass moves a 1x1 adapted luminance towards it, quicker when the scene gets brighter than when
+// it gets darker like the eye does, and the composite reads that texel to expose with. Nothing is ever
+// read back, so the frame never waits on the GPU.
+//
+// The textures are fixed in size and kept across frames, so they are the class's own rather than the
+// render target pool's; the adapted luminance ping-pongs between two of them.
+class AutoExposure {
+public:
+    static const int Size = 256;
+    static const int Levels = 9; // 256 down to 1
+    // the unit the composite reads the adapted luminance from
+    static const GLuint AdaptedUnit = 2;
+
+private:
+    GLuint m_Luminance = 0, m_LuminanceFBO = 0;
+    GLuint m_Adapted[2] = {}, m_AdaptedFBO[2] = {};
+    int m_Current = 0;
+    bool m_Valid = false;
+    GLuint m_VAO = 0;
+
+    static GLuint createTarget(GLenum format, GLenum channels, int size, int levels, GLuint& fbo) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 0, levelSize = size; level < levels; ++level, levelSize = levelSize > 1 ? levelSize / 2 : 1)
+            glTexImage2D(GL_TEXTURE_2D, level, format, levelSize, levelSize, 0, channels, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, levels > 1 ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void draw(GLuint fbo, int size) const {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, size, size);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+public:
+    void Create() {
+        // log luminance times weight, and the weight
+        m_Luminance = createTarget(GL_RG16F, GL_RG, Size, Levels, m_LuminanceFBO);
+        for (int i = 0; i < 2; ++i)
+            m_Adapted[i] = createTarget(GL_R32F, GL_RED, 1, 1, m_AdaptedFBO[i]);
+        glGenVertexArrays(1, &m_VAO);
+        m_Valid = false;
+    }
+
+    void Destroy() {
+        glDeleteFramebuffers(1, &m_LuminanceFBO);
+        glDeleteTextures(1, &m_Luminance);
+        glDeleteFramebuffers(2, m_AdaptedFBO);
+        glDeleteTextures(2, m_Adapted);
+        glDeleteVertexArrays(1, &m_VAO);
+        m_Luminance = m_LuminanceFBO = m_VAO = 0;
+        m_Adapted[0] = m_Adapted[1] = m_AdaptedFBO[0] = m_AdaptedFBO[1] = 0;
+    }
+
+    // the next Update jumps straight to the scene's brightness instead of easing towards it
+    void Reset() {
+        m_Valid = false;
+    }
+
+    // Measures the scene colour texture and adapts towards it over deltaTime seconds; speedUp and
+    // speedDown are the rates, per second, of adapting to a brighter and to a darker scene. The adapted
+    // luminance is clamped to minLuminance..maxLuminance, so the night stays night. Leaves the default
+    // framebuffer bound and the viewport at the measuring size, callers set their own.
+    void Update(Shader& luminance, Shader& adapt, GLuint scene, float deltaTime, float speedUp, float speedDown,
+                float minLuminance, float maxLuminance) {
+        glBindVertexArray(m_VAO);
+        glDisable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+
+        luminance.use();
+        luminance.setInt("scene", 0);
+        glBindTexture(GL_TEXTURE_2D, scene);
+        draw(m_LuminanceFBO, Size);
+        glBindTexture(GL_TEXTURE_2D, m_Luminance);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        int previous = m_Current;
+        m_Current = 1 - m_Current;
+        adapt.use();
+        adapt.setInt("logLuminance", 0);
+        adapt.setInt("previousLuminance", 1);
+        adapt.setFloat("lastLevel", (float)(Levels - 1));
+        adapt.setFloat("deltaTime", deltaTime);
+        adapt.setFloat("speedUp", speedUp);
+        adapt.setFloat("speedDown", speedDown);
+        adapt.setFloat("minLuminance", minLuminance);
+        adapt.setFloat("maxLuminance", maxLuminance);
+        adapt.setFloat("previousValid", m_Valid ? 1.0f : 0.0f);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_Adapted[previous]);
+        glActiveTexture(GL_TEXTURE0);
+        draw(m_AdaptedFBO[m_Current], 1);
+        m_Valid = true;
+
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // 1x1 R32F, the adapted scene luminance; the composite exposes with key / luminance
+    GLuint AdaptedLuminance() const {
+        return m_Adapted[m_Current];
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
@@ -0,0 +1,149 @@
+#ifndef PROJECT_BASE_BLOOMCHAIN_H
+#define PROJECT_BASE_BLOOMCHAIN_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <rg/RenderTargetPool.h>
+
+#include <algorithm>
+
+namespace rg {
+
+// Bloom as a chain of ever smaller R11G11B10F targets. The bright pass keeps what is brighter than the
+// threshold, easing in over a soft knee, and downsamples the scene into level 0 at half resolution.
+// Emissive surfaces bloom regardless of their brightness: they write 0 into the scene colour's alpha,
+// lit surfaces and the sky write 1. Every further level is a 13-tap downsample of the one before, which
+// is a wide blur for a few fetches per pixel. On the way back up each level gets a 3x3 tent upsample of
+// the next smaller one added to it, so level 0 ends up with the sum of all of them. No full resolution
+// pass is involved past the bright pass's reads.
+//
+// Level 0, OutputDesc, is the caller's: the bright pass writes it and the composite reads it. The smaller
+// levels come from the render target pool while Blur runs. The passes draw one screen covering triangle
+// from an empty vertex array, see bloom_chain.vs.
+class BloomChain {
+public:
+    static const int MaxLevels = 6;
+    // the chain stops before a level gets smaller than this
+    static const int MinLevelSize = 8;
+
+private:
+    int m_Widths[MaxLevels] = {}, m_Heights[MaxLevels] = {};
+    int m_Levels = 0;
+    int m_Width = 0, m_Height = 0;
+    GLuint m_VAO = 0;
+
+    RenderTargetDesc levelDesc(int level) const {
+        return RenderTargetDesc(m_Widths[level], m_Heights[level], GL_R11F_G11F_B10F);
+    }
+
+    void drawLevel(RenderTargetPool& pool, GLuint target, int level) const {
+        glBindFramebuffer(GL_FRAMEBUFFER, pool.Framebuffer({target}));
+        glViewport(0, 0, m_Widths[level], m_Heights[level]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+public:
+    // width and height of the scene colour the chain is fed from; call again when it changes
+    void Create(int width, int height) {
+        m_Width = width;
+        m_Height = height;
+        m_Levels = 0;
+        int levelWidth = std::max(1, width / 2), levelHeight = std::max(1, height / 2);
+        while (m_Levels < MaxLevels && (m_Levels == 0 || std::min(levelWidth, levelHeight) >= MinLevelSize)) {
+            m_Widths[m_Levels] = levelWidth;
+            m_Heights[m_Levels] = levelHeight;
+            ++m_Levels;
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+        if (!m_VAO)
+            glGenVertexArrays(1, &m_VAO);
+    }
+
+    void Destroy() {
+        if (m_VAO)
+            glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+        m_Levels = 0;
+    }
+
+    int Levels() const {
+        return m_Levels;
+    }
+
+    // Extracts the bright part of the scene colour texture into output, a target of OutputDesc. threshold
+    // is the brightness bloom starts at, knee how far below it bloom fades in; emissive scales the bloom of
+    // emissive surfaces. Leaves the default framebuffer bound with the scene's viewport.
+    void BrightPass(RenderTargetPool& pool, GLuint scene, GLuint output, Shader& brightPass, float threshold,
+                    float knee, float emissive) const {
+        glBindVertexArray(m_VAO);
+        glDisable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+        brightPass.use();
+        brightPass.setInt("source", 0);
+        brightPass.setVec2("sourceTexel", 1.0f / (float)m_Width, 1.0f / (float)m_Height);
+        brightPass.setFloat("threshold", threshold);
+        brightPass.setFloat("knee", knee);
+        brightPass.setFloat("emissive", emissive);
+        glBindTexture(GL_TEXTURE_2D, scene);
+        drawLevel(pool, output, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, m_Width, m_Height);
+    }
+
+    // Runs the chain over the bright pass's output, which ends up holding the result; radius scales the
+    // upsample tent, in texels of the smaller level, so larger values spread the glow further. Same state
+    // on return as BrightPass.
+    void Blur(RenderTargetPool& pool, GLuint output, Shader& downsample, Shader& upsample, float radius) const {
+        GLuint levels[MaxLevels] = {output};
+        for (int level = 1; level < m_Levels; ++level)
+            levels[level] = pool.Acquire(levelDesc(level));
+        glBindVertexArray(m_VAO);
+        glDisable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+        downsample.use();
+        downsample.setInt("source", 0);
+        for (int level = 1; level < m_Levels; ++level) {
+            downsample.setVec2("sourceTexel", 1.0f / (float)m_Widths[level - 1], 1.0f / (float)m_Heights[level - 1]);
+            glBindTexture(GL_TEXTURE_2D, levels[level - 1]);
+            drawLevel(pool, levels[level], level);
+        }
+
+        // each level keeps its own downsample and adds the blurred smaller levels on top
+        upsample.use();
+        upsample.setInt("source", 0);
+        upsample.setFloat("radius", radius);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (int level = m_Levels - 2; level >= 0; --level) {
+            upsample.setVec2("sourceTexel", 1.0f / (float)m_Widths[level + 1], 1.0f / (float)m_Heights[level + 1]);
+            glBindTexture(GL_TEXTURE_2D, levels[level + 1]);
+            drawLevel(pool, levels[level], level);
+        }
+        glDisable(GL_BLEND);
+
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, m_Width, m_Height);
+        for (int level = 1; level < m_Levels; ++level)
+            pool.Release(levels[level]);
+    }
+
+    // level 0, the bright pass's output: half the scene's size
+    RenderTargetDesc OutputDesc() const {
+        return levelDesc(0);
+    }
+
+    // after Blur level 0 holds the sum of every level; this brings it back to the brightness of one
+    float OutputScale() const {
+        return m_Levels ? 1.0f / (float)m_Levels : 0.0f;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BLOOMCHAIN_H
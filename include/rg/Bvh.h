@@ -0,0 +1,323 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Float4.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Four rays in structure-of-arrays layout. Rays of a packet should start close together and point
+// roughly the same way, then they visit mostly the same nodes.
+struct RayPacket {
+    float origin[3][4];
+    float direction[3][4];
+    float tMax[4];
+};
+
+struct PacketHit {
+    float t[4];
+    uint32_t triangle[4]; // NoHit where the ray missed
+    float u[4], v[4];     // barycentrics of vertices 1 and 2
+};
+
+// Bounding volume hierarchy over a triangle soup, for the offline baker. Built top-down with binned SAH
+// into a flat depth-first array, where an inner node's children are adjacent. Traversal runs four rays
+// at once, a node is entered when any active ray of the packet hits its box.
+class Bvh {
+public:
+    static const uint32_t NoHit = 0xffffffffu;
+
+private:
+    struct Node {
+        glm::vec3 min;
+        uint32_t leftFirst; // left child for inner nodes, first triangle index for leaves
+        glm::vec3 max;
+        uint32_t count;     // triangles in a leaf, 0 for inner nodes
+    };
+
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    static const int Bins = 8;
+    static const uint32_t MaxLeafSize = 4;
+    // traversal stack entries kept on the stack, deeper trees fall back to the heap
+    static const uint32_t InlineStackSize = 64;
+
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_Indices;
+    std::vector<Triangle> m_Triangles;
+    std::vector<glm::vec3> m_Centroids;
+    uint32_t m_Depth = 0; // of the deepest leaf, the root is at 0
+
+    struct Bounds {
+        glm::vec3 min = glm::vec3(1e30f), max = glm::vec3(-1e30f);
+
+        void Grow(const glm::vec3& p) {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        void Grow(const Bounds& b) {
+            min = glm::min(min, b.min);
+            max = glm::max(max, b.max);
+        }
+        float Area() const {
+            glm::vec3 e = max - min;
+            return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+    };
+
+    Bounds triangleBounds(uint32_t triangle) const {
+        const Triangle& tri = m_Triangles[triangle];
+        Bounds b;
+        b.Grow(tri.v0);
+        b.Grow(tri.v0 + tri.e1);
+        b.Grow(tri.v0 + tri.e2);
+        return b;
+    }
+
+    void updateBounds(Node& node) const {
+        Bounds b;
+        for (uint32_t i = 0; i < node.count; ++i)
+            b.Grow(triangleBounds(m_Indices[node.leftFirst + i]));
+        node.min = b.min;
+        node.max = b.max;
+    }
+
+    // best split of a node over binned centroids, false if keeping the leaf is cheaper
+    bool findSplit(const Node& node, int& axis, float& position) const {
+        Bounds centroidBounds;
+        for (uint32_t i = 0; i < node.count; ++i)
+            centroidBounds.Grow(m_Centroids[m_Indices[node.leftFirst + i]]);
+        float bestCost = 1e30f;
+        for (int a = 0; a < 3; ++a) {
+            float lo = centroidBounds.min[a], hi = centroidBounds.max[a];
+            if (hi <= lo)
+                continue;
+            Bounds bins[Bins];
+            uint32_t counts[Bins] = {};
+            float scale = Bins / (hi - lo);
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t triangle = m_Indices[node.leftFirst + i];
+                int bin = std::min(Bins - 1, (int)((m_Centroids[triangle][a] - lo) * scale));
+                ++counts[bin];
+                bins[bin].Grow(triangleBounds(triangle));
+            }
+            // sweep from both sides
+            float leftArea[Bins - 1], rightArea[Bins - 1];
+            uint32_t leftCount[Bins - 1], rightCount[Bins - 1];
+            Bounds left, right;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < Bins - 1; ++i) {
+                leftSum += counts[i];
+                left.Grow(bins[i]);
+                leftCount[i] = leftSum;
+                leftArea[i] = left.Area();
+                rightSum += counts[Bins - 1 - i];
+                right.Grow(bins[Bins - 1 - i]);
+                rightCount[Bins - 2 - i] = rightSum;
+                rightArea[Bins - 2 - i] = right.Area();
+            }
+            for (int i = 0; i < Bins - 1; ++i) {
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (leftCount[i] && rightCount[i] && cost < bestCost) {
+                    bestCost = cost;
+                    axis = a;
+                    position = lo + (i + 1) / scale;
+                }
+            }
+        }
+        Bounds nodeBounds;
+        nodeBounds.min = node.min;
+        nodeBounds.max = node.max;
+        return bestCost < node.count * nodeBounds.Area();
+    }
+
+public:
+    // positions holds three vertices per triangle
+    void Build(const std::vector<glm::vec3>& positions) {
+        size_t triangleCount = positions.size() / 3;
+        m_Triangles.resize(triangleCount);
+        m_Centroids.resize(triangleCount);
+        m_Indices.resize(triangleCount);
+        for (size_t i = 0; i < triangleCount; ++i) {
+            const glm::vec3* v = &positions[3 * i];
+            m_Triangles[i] = Triangle{v[0], v[1] - v[0], v[2] - v[0]};
+            m_Centroids[i] = (v[0] + v[1] + v[2]) / 3.0f;
+            m_Indices[i] = (uint32_t)i;
+        }
+        m_Nodes.clear();
+        m_Nodes.reserve(std::max<size_t>(1, 2 * triangleCount));
+        Node root;
+        root.leftFirst = 0;
+        root.count = (uint32_t)triangleCount;
+        updateBounds(root);
+        m_Nodes.push_back(root);
+        m_Depth = 0;
+
+        // node indices with their depth
+        std::vector<std::pair<uint32_t, uint32_t>> stack(1, std::make_pair(0u, 0u));
+        while (!stack.empty()) {
+            uint32_t index = stack.back().first, depth = stack.back().second;
+            stack.pop_back();
+            m_Depth = std::max(m_Depth, depth);
+            Node node = m_Nodes[index];
+            int axis = 0;
+            float position = 0.0f;
+            if (node.count <= MaxLeafSize || !findSplit(node, axis, position))
+                continue;
+            // partition the node's triangles around the split plane
+            uint32_t* first = m_Indices.data() + node.leftFirst;
+            uint32_t* middle = std::partition(first, first + node.count, [&](uint32_t triangle) {
+                return m_Centroids[triangle][axis] < position;
+            });
+            uint32_t leftCount = (uint32_t)(middle - first);
+            if (leftCount == 0 || leftCount == node.count)
+                continue;
+            Node left, right;
+            left.leftFirst = node.leftFirst;
+            left.count = leftCount;
+            right.leftFirst = node.leftFirst + leftCount;
+            right.count = node.count - leftCount;
+            updateBounds(left);
+            updateBounds(right);
+            uint32_t leftIndex = (uint32_t)m_Nodes.size();
+            m_Nodes.push_back(left);
+            m_Nodes.push_back(right);
+            m_Nodes[index].leftFirst = leftIndex;
+            m_Nodes[index].count = 0;
+            stack.push_back(std::make_pair(leftIndex, depth + 1));
+            stack.push_back(std::make_pair(leftIndex + 1, depth + 1));
+        }
+        m_Centroids.clear();
+        m_Centroids.shrink_to_fit();
+    }
+
+    size_t NodeCount() const {
+        return m_Nodes.size();
+    }
+
+    size_t TriangleCount() const {
+        return m_Triangles.size();
+    }
+
+    // Closest hits of the rays in activeMask (bit i for ray i), within (0, tMax).
+    void Intersect(const RayPacket& packet, PacketHit& hit, int activeMask = 0xf) const {
+        traverse<false>(packet, hit, activeMask);
+    }
+
+    // Mask of the rays in activeMask that hit anything within (0, tMax).
+    int Occluded(const RayPacket& packet, int activeMask = 0xf) const {
+        PacketHit hit;
+        return traverse<true>(packet, hit, activeMask);
+    }
+
+private:
+    template<bool AnyHit>
+    int traverse(const RayPacket& packet, PacketHit& hit, int activeMask) const {
+        Float4 origin[3], direction[3], inverse[3];
+        for (int a = 0; a < 3; ++a) {
+            origin[a] = Float4::Load(packet.origin[a]);
+            direction[a] = Float4::Load(packet.direction[a]);
+            inverse[a] = Float4(1.0f) / direction[a];
+        }
+        // inactive rays get a negative range, they never hit anything
+        float activeT[4];
+        for (int i = 0; i < 4; ++i)
+            activeT[i] = (activeMask >> i) & 1 ? packet.tMax[i] : -1.0f;
+        Float4 closest = Float4::Load(activeT);
+        Float4 hitU, hitV;
+        Float4 hitTriangle = Float4::FromBits(NoHit);
+        int occluded = 0;
+
+        if (m_Nodes.empty() || !activeMask) {
+            closest.Store(hit.t);
+            for (uint32_t& triangle : hit.triangle)
+                triangle = NoHit;
+            return 0;
+        }
+
+        // popping a node and pushing its two children grows the stack by one per level
+        uint32_t inlineStack[InlineStackSize];
+        std::vector<uint32_t> heapStack;
+        uint32_t* stack = inlineStack;
+        if (m_Depth + 1 > InlineStackSize) {
+            heapStack.resize(m_Depth + 1);
+            stack = heapStack.data();
+        }
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        const Float4 epsilon(1e-4f), zero(0.0f), one(1.0f);
+        while (stackSize) {
+            const Node& node = m_Nodes[stack[--stackSize]];
+            // slab test against the node's box
+            Float4 tNear = zero, tFar = closest;
+            for (int a = 0; a < 3; ++a) {
+                Float4 t0 = (Float4(node.min[a]) - origin[a]) * inverse[a];
+                Float4 t1 = (Float4(node.max[a]) - origin[a]) * inverse[a];
+                tNear = Float4::Max(tNear, Float4::Min(t0, t1));
+                tFar = Float4::Min(tFar, Float4::Max(t0, t1));
+            }
+            int mask = (tNear <= tFar).Mask() & activeMask & ~occluded;
+            if (!mask)
+                continue;
+            if (node.count == 0) {
+                stack[stackSize++] = node.leftFirst + 1;
+                stack[stackSize++] = node.leftFirst;
+                continue;
+            }
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t triangleIndex = m_Indices[node.leftFirst + i];
+                const Triangle& tri = m_Triangles[triangleIndex];
+                Float4 e1[3] = {Float4(tri.e1.x), Float4(tri.e1.y), Float4(tri.e1.z)};
+                Float4 e2[3] = {Float4(tri.e2.x), Float4(tri.e2.y), Float4(tri.e2.z)};
+                // Moeller-Trumbore for all four rays
+                Float4 p[3] = {direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2],
+                               direction[0] * e2[1] - direction[1] * e2[0]};
+                Float4 det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+                Float4 inverseDet = one / det;
+                Float4 s[3] = {origin[0] - Float4(tri.v0.x), origin[1] - Float4(tri.v0.y), origin[2] - Float4(tri.v0.z)};
+                Float4 u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDet;
+                Float4 q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+                Float4 v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverseDet;
+                Float4 t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverseDet;
+                Float4 valid = (Float4::Abs(det) > Float4(1e-12f)) & (u >= zero) & (v >= zero) & (u + v <= one) &
+                               (t > epsilon) & (t < closest);
+                int validMask = valid.Mask() & activeMask;
+                if (!validMask)
+                    continue;
+                if (AnyHit) {
+                    occluded |= validMask;
+                    if (occluded == activeMask)
+                        return occluded;
+                    continue;
+                }
+                closest = Float4::Select(closest, t, valid);
+                hitU = Float4::Select(hitU, u, valid);
+                hitV = Float4::Select(hitV, v, valid);
+                hitTriangle = Float4::Select(hitTriangle, Float4::FromBits(triangleIndex), valid);
+            }
+        }
+        if (!AnyHit) {
+            closest.Store(hit.t);
+            hitU.Store(hit.u);
+            hitV.Store(hit.v);
+            float triangles[4];
+            hitTriangle.Store(triangles);
+            std::memcpy(hit.triangle, triangles, sizeof(hit.triangle));
+        }
+        return occluded;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,309 @@
+#ifndef PROJECT_BASE_CASCADEDSHADOWS_H
+#define PROJECT_BASE_CASCADEDSHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/DrawData.h>
+#include <rg/Scene.h>
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct ShadowStats {
+    unsigned staticCascadesDrawn = 0; // cascades whose static casters were re-rendered this frame
+    unsigned casterDraws = 0;
+    bool cached = true;
+};
+
+// Cascaded shadow maps of the directional light, the cascades side by side in one depth atlas.
+//
+// Static casters are rendered into a separate cached atlas, and a cascade is only redrawn when its
+// bounds change. Each frame the cache is blitted into the atlas the shaders sample, and the dynamic
+// casters are drawn on top. To keep the bounds stable, every cascade is a square around the bounding
+// sphere of its frustum slice, padded by a quarter of the radius. Its centre snaps to a grid of that
+// quarter radius, rounded to whole texels, so the bounds only move when the camera has moved that far.
+// The depth range spans the static scene bounds, which lets casters outside the view frustum be drawn.
+class CascadedShadowMap {
+public:
+    static const int Cascades = 3; // matches shadowMatrices[3] in lighting.glsl
+    static const GLuint TextureUnit = 11;
+
+private:
+    struct Cascade {
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        glm::mat4 shadowMatrix = glm::mat4(1.0f); // world -> atlas texture coordinates and depth
+        glm::vec2 center = glm::vec2(0.0f);       // light space
+        glm::ivec2 cell = glm::ivec2(0);
+        float extent = 0.0f;                      // half the side of the square
+        float splitFar = 0.0f;                    // view depth where the next cascade takes over
+        bool staticValid = false;
+    };
+
+    Cascade m_Cascades[Cascades];
+    int m_Resolution = 0;
+    GLuint m_FBO = 0, m_Depth = 0;
+    GLuint m_StaticFBO = 0, m_StaticDepth = 0;
+    glm::vec3 m_LightDirection = glm::vec3(0.0f);
+    glm::vec2 m_DepthRange = glm::vec2(0.0f);
+    float m_MaxDistance = 60.0f;
+    bool m_CacheEnabled = true;
+    ShadowStats m_Stats;
+
+    static GLuint createAtlas(int width, int height, GLuint& texture) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLuint fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow atlas framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return fbo;
+    }
+
+    bool intersects(const Cascade& cascade, const ShadowCaster& caster) const {
+        glm::vec3 p = glm::vec3(cascade.view * glm::vec4(caster.center, 1.0f));
+        return std::abs(p.x - cascade.center.x) <= cascade.extent + caster.radius &&
+               std::abs(p.y - cascade.center.y) <= cascade.extent + caster.radius;
+    }
+
+    void drawCascade(int index, const std::vector<ShadowCaster>& casters, size_t begin, size_t end,
+                     const DrawDataBuffer& drawData, size_t firstRecord, Shader& depthShader, bool clear) {
+        const Cascade& cascade = m_Cascades[index];
+        glViewport(index * m_Resolution, 0, m_Resolution, m_Resolution);
+        if (clear) {
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(index * m_Resolution, 0, m_Resolution, m_Resolution);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+        }
+        depthShader.setMat4("view", cascade.view);
+        depthShader.setMat4("projection", cascade.projection);
+        bool cullFaces = true;
+        glEnable(GL_CULL_FACE);
+        for (size_t i = begin; i < end; ++i) {
+            const ShadowCaster& caster = casters[i];
+            if (!intersects(cascade, caster))
+                continue;
+            if (caster.cullFaces != cullFaces) {
+                cullFaces = caster.cullFaces;
+                if (cullFaces)
+                    glEnable(GL_CULL_FACE);
+                else
+                    glDisable(GL_CULL_FACE);
+            }
+            drawData.Select(firstRecord + i);
+            caster.model->DrawDepth();
+            ++m_Stats.casterDraws;
+        }
+        glEnable(GL_CULL_FACE);
+    }
+
+public:
+    void Create(int resolution = 2048) {
+        Destroy();
+        m_Resolution = resolution;
+        m_FBO = createAtlas(resolution * Cascades, resolution, m_Depth);
+        m_StaticFBO = createAtlas(resolution * Cascades, resolution, m_StaticDepth);
+        for (Cascade& cascade : m_Cascades)
+            cascade.staticValid = false;
+    }
+
+    void Destroy() {
+        if (!m_FBO)
+            return;
+        GLuint fbos[2] = {m_FBO, m_StaticFBO};
+        GLuint textures[2] = {m_Depth, m_StaticDepth};
+        glDeleteFramebuffers(2, fbos);
+        glDeleteTextures(2, textures);
+        m_FBO = m_StaticFBO = m_Depth = m_StaticDepth = 0;
+    }
+
+    // off: every caster is drawn every frame, for comparison
+    void SetCacheEnabled(bool enabled) {
+        m_CacheEnabled = enabled;
+    }
+
+    // redraws the static casters of every cascade, e.g. after static objects were added or removed
+    void Invalidate() {
+        for (Cascade& cascade : m_Cascades)
+            cascade.staticValid = false;
+    }
+
+    // Fits the cascades to the camera frustum up to the shadow distance and invalidates the cached
+    // static depth of every cascade whose bounds changed.
+    void Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane,
+                const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax) {
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+        // depth range over the static scene, so casters between the light and the view frustum are kept
+        float zMin = 1e30f, zMax = -1e30f;
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 p((corner & 1) ? sceneMax.x : sceneMin.x, (corner & 2) ? sceneMax.y : sceneMin.y,
+                        (corner & 4) ? sceneMax.z : sceneMin.z);
+            float z = (lightView * glm::vec4(p, 1.0f)).z;
+            zMin = glm::min(zMin, z);
+            zMax = glm::max(zMax, z);
+        }
+        glm::vec2 depthRange(-zMax - 1.0f, -zMin + 1.0f);
+        bool lightChanged = direction != m_LightDirection || depthRange != m_DepthRange;
+        m_LightDirection = direction;
+        m_DepthRange = depthRange;
+
+        // practical split scheme, between uniform and logarithmic
+        float shadowFar = glm::min(farPlane, m_MaxDistance);
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+        float sliceNear = nearPlane;
+        for (int i = 0; i < Cascades; ++i) {
+            Cascade& cascade = m_Cascades[i];
+            float t = (float)(i + 1) / Cascades;
+            float sliceFar = glm::mix(nearPlane + (shadowFar - nearPlane) * t,
+                                      nearPlane * std::pow(shadowFar / nearPlane, t), 0.75f);
+
+            // bounding sphere of the slice; its radius only depends on the projection
+            glm::vec3 corners[8];
+            glm::vec3 centroid(0.0f);
+            for (int corner = 0; corner < 8; ++corner) {
+                float depth = (corner & 4) ? sliceFar : sliceNear;
+                glm::vec4 p((corner & 1 ? 1.0f : -1.0f) * depth * tanX, (corner & 2 ? 1.0f : -1.0f) * depth * tanY,
+                            -depth, 1.0f);
+                corners[corner] = glm::vec3(inverseView * p);
+                centroid += corners[corner] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3& corner : corners)
+                radius = glm::max(radius, glm::length(corner - centroid));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            float extent = radius * 1.25f;
+            float texel = 2.0f * extent / (float)m_Resolution;
+            float step = glm::max(1.0f, std::floor(radius * 0.25f / texel)) * texel;
+            glm::vec2 lightCenter = glm::vec2(lightView * glm::vec4(centroid, 1.0f));
+            glm::ivec2 cell((int)std::floor(lightCenter.x / step + 0.5f), (int)std::floor(lightCenter.y / step + 0.5f));
+
+            if (lightChanged || cell != cascade.cell || extent != cascade.extent)
+                cascade.staticValid = false;
+            cascade.cell = cell;
+            cascade.extent = extent;
+            cascade.center = glm::vec2(cell) * step;
+            cascade.splitFar = sliceFar;
+            cascade.view = lightView;
+            cascade.projection = glm::ortho(cascade.center.x - extent, cascade.center.x + extent,
+                                            cascade.center.y - extent, cascade.center.y + extent,
+                                            depthRange.x, depthRange.y);
+            // clip space -> this cascade's part of the atlas
+            glm::mat4 atlas = glm::translate(glm::mat4(1.0f), glm::vec3((i + 0.5f) / Cascades, 0.5f, 0.5f)) *
+                              glm::scale(glm::mat4(1.0f), glm::vec3(0.5f / Cascades, 0.5f, 0.5f));
+            cascade.shadowMatrix = atlas * cascade.projection * cascade.view;
+            sliceNear = sliceFar;
+        }
+    }
+
+    // whether this frame's Render needs the static casters
+    bool NeedsStaticCasters() const {
+        if (!m_CacheEnabled)
+            return true;
+        for (const Cascade& cascade : m_Cascades) {
+            if (!cascade.staticValid)
+                return true;
+        }
+        return false;
+    }
+
+    // Draws the casters with the depth-only shader; casters[i] uses the draw record firstRecord + i.
+    // Casters before dynamicBegin are static. Leaves the atlas framebuffer bound and the viewport changed.
+    void Render(const std::vector<ShadowCaster>& casters, size_t dynamicBegin, const DrawDataBuffer& drawData,
+                size_t firstRecord, Shader& depthShader) {
+        m_Stats = ShadowStats();
+        m_Stats.cached = m_CacheEnabled;
+        depthShader.use();
+        drawData.Bind();
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        if (m_CacheEnabled) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_StaticFBO);
+            for (int i = 0; i < Cascades; ++i) {
+                if (m_Cascades[i].staticValid)
+                    continue;
+                drawCascade(i, casters, 0, dynamicBegin, drawData, firstRecord, depthShader, true);
+                m_Cascades[i].staticValid = true;
+                ++m_Stats.staticCascadesDrawn;
+            }
+            int width = m_Resolution * Cascades;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_StaticFBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
+            glBlitFramebuffer(0, 0, width, m_Resolution, 0, 0, width, m_Resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+            for (int i = 0; i < Cascades; ++i) {
+                drawCascade(i, casters, 0, dynamicBegin, drawData, firstRecord, depthShader, true);
+                m_Cascades[i].staticValid = false; // the cache is stale once it is turned back on
+                ++m_Stats.staticCascadesDrawn;
+            }
+        }
+        for (int i = 0; i < Cascades; ++i)
+            drawCascade(i, casters, dynamicBegin, casters.size(), drawData, firstRecord, depthShader, false);
+
+        DrawDataBuffer::SetDrawId(0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+    }
+
+    // binds the atlas and sets the cascade uniforms of a lighting shader
+    void Apply(Shader& shader) const {
+        glActiveTexture(GL_TEXTURE0 + TextureUnit);
+        glBindTexture(GL_TEXTURE_2D, m_Depth);
+        glActiveTexture(GL_TEXTURE0);
+        shader.use();
+        for (int i = 0; i < Cascades; ++i) {
+            std::string index = "[" + std::to_string(i) + "]";
+            shader.setMat4("shadowMatrices" + index, m_Cascades[i].shadowMatrix);
+        }
+        shader.setVec3("cascadeSplits", m_Cascades[0].splitFar, m_Cascades[1].splitFar, m_Cascades[2].splitFar);
+        shader.setVec3("cascadeTexelSizes", 2.0f * m_Cascades[0].extent / (float)m_Resolution,
+                       2.0f * m_Cascades[1].extent / (float)m_Resolution, 2.0f * m_Cascades[2].extent / (float)m_Resolution);
+        shader.setVec2("shadowAtlasTexel", 1.0f / (float)(m_Resolution * Cascades), 1.0f / (float)m_Resolution);
+    }
+
+    // call once per lighting program
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("shadowAtlas", TextureUnit);
+    }
+
+    const ShadowStats& Stats() const {
+        return m_Stats;
+    }
+
+    int Resolution() const {
+        return m_Resolution;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_CASCADEDSHADOWS_H
@@ -0,0 +1,292 @@
+#ifndef PROJECT_BASE_CLUSTEREDLIGHTS_H
+#define PROJECT_BASE_CLUSTEREDLIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/JobSystem.h>
+#include <rg/Light.h>
+#include <rg/StreamBuffer.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rg {
+
+// Light as read by the lighting shader from the lightData buffer texture, 6 RGBA32F texels.
+struct LightRecord {
+    glm::vec4 positionRange;
+    glm::vec4 diffuseConstant;
+    glm::vec4 specularLinear;
+    glm::vec4 ambientQuadratic;
+    glm::vec4 directionCutOff;
+    glm::vec4 outerCutOffShadow;
+
+    void Set(const Light& light) {
+        positionRange = glm::vec4(light.position, light.range);
+        diffuseConstant = glm::vec4(light.diffuse, light.constant);
+        specularLinear = glm::vec4(light.specular, light.linear);
+        ambientQuadratic = glm::vec4(light.ambient, light.quadratic);
+        directionCutOff = glm::vec4(glm::normalize(light.direction), light.cutOff);
+        outerCutOffShadow = glm::vec4(light.outerCutOff, (float)light.shadowFace, light.shadowTexelAngle,
+                                      light.baked ? 1.0f : 0.0f);
+    }
+};
+static_assert(sizeof(LightRecord) == 6 * 4 * sizeof(float), "LightRecord must match the shader side layout");
+
+struct ClusterStats {
+    unsigned lightCount = 0;
+    unsigned indexCount = 0;
+    unsigned maxLightsPerCluster = 0;
+    double buildMs = 0.0;
+};
+
+// Clustered forward lighting. The view frustum is split into screen tiles and exponentially spaced
+// depth slices (froxels); every frame the lights are assigned to the froxels their range touches, on the
+// job system with one job per slice. The lights, the per-cluster (offset, count) grid and the light
+// index lists go to the shaders as buffer textures, so each fragment only loops over its own cluster.
+class ClusteredLights {
+public:
+    static const int TilesX = 16;
+    static const int TilesY = 9;
+    static const int Slices = 24;
+    static const int ClusterCount = TilesX * TilesY * Slices;
+    static const GLuint LightUnit = 12;
+    static const GLuint GridUnit = 13;
+    static const GLuint IndexUnit = 14;
+
+private:
+    struct LightRect {
+        uint16_t light;
+        uint8_t x0, x1, y0, y1;
+    };
+
+    struct Slice {
+        std::vector<LightRect> rects;
+        std::vector<uint16_t> indices;
+        uint32_t counts[TilesX * TilesY];
+        uint32_t offsets[TilesX * TilesY];
+        uint32_t base = 0;
+    };
+
+    std::vector<Light> m_Lights;
+    std::vector<glm::vec4> m_ViewSpheres; // view space center with depth along the view direction, radius
+    Slice m_Slices[Slices];
+    StreamTexture m_LightBuffer, m_GridBuffer, m_IndexBuffer;
+    size_t m_LightCount = 0;
+    float m_Near = 0.1f, m_Far = 100.0f;
+    glm::vec2 m_TileSize = glm::vec2(1.0f);
+    ClusterStats m_Stats;
+
+    float sliceDepth(int slice) const {
+        return m_Near * std::pow(m_Far / m_Near, (float)slice / (float)Slices);
+    }
+
+    // screen tiles covered by the sphere between depths d0 and d1, false if none
+    bool tileRect(const glm::vec4& sphere, float d0, float d1, const glm::mat4& projection,
+                  const glm::vec2& screenSize, LightRect& rect) const {
+        float r = sphere.w;
+        float dNear = glm::max(glm::max(d0, sphere.z - r), 1e-4f);
+        float dFar = glm::max(glm::min(d1, sphere.z + r), dNear);
+        // x / d is monotonic in d, so the extremes of the sphere's box lie at the nearest or farthest depth
+        glm::vec2 lo(1e30f), hi(-1e30f);
+        for (float d : {dNear, dFar}) {
+            for (float sx : {-r, r}) {
+                float x = (sphere.x + sx) * projection[0][0] / d;
+                lo.x = glm::min(lo.x, x);
+                hi.x = glm::max(hi.x, x);
+            }
+            for (float sy : {-r, r}) {
+                float y = (sphere.y + sy) * projection[1][1] / d;
+                lo.y = glm::min(lo.y, y);
+                hi.y = glm::max(hi.y, y);
+            }
+        }
+        if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f)
+            return false;
+        glm::vec2 tilesLo = (glm::clamp(lo, -1.0f, 1.0f) * 0.5f + 0.5f) * screenSize / m_TileSize;
+        glm::vec2 tilesHi = (glm::clamp(hi, -1.0f, 1.0f) * 0.5f + 0.5f) * screenSize / m_TileSize;
+        rect.x0 = (uint8_t)glm::clamp((int)tilesLo.x, 0, TilesX - 1);
+        rect.x1 = (uint8_t)glm::clamp((int)tilesHi.x, 0, TilesX - 1);
+        rect.y0 = (uint8_t)glm::clamp((int)tilesLo.y, 0, TilesY - 1);
+        rect.y1 = (uint8_t)glm::clamp((int)tilesHi.y, 0, TilesY - 1);
+        return true;
+    }
+
+    void buildSlice(int s, const glm::mat4& projection, const glm::vec2& screenSize) {
+        Slice& slice = m_Slices[s];
+        float d0 = sliceDepth(s), d1 = sliceDepth(s + 1);
+        slice.rects.clear();
+        for (size_t i = 0; i < m_ViewSpheres.size(); ++i) {
+            const glm::vec4& sphere = m_ViewSpheres[i];
+            if (sphere.z + sphere.w < d0 || sphere.z - sphere.w > d1)
+                continue;
+            LightRect rect;
+            rect.light = (uint16_t)i;
+            if (tileRect(sphere, d0, d1, projection, screenSize, rect))
+                slice.rects.push_back(rect);
+        }
+
+        // count, prefix sum, fill
+        std::memset(slice.counts, 0, sizeof(slice.counts));
+        for (const LightRect& rect : slice.rects) {
+            for (int y = rect.y0; y <= rect.y1; ++y) {
+                for (int x = rect.x0; x <= rect.x1; ++x)
+                    ++slice.counts[y * TilesX + x];
+            }
+        }
+        uint32_t total = 0;
+        for (int tile = 0; tile < TilesX * TilesY; ++tile) {
+            slice.offsets[tile] = total;
+            total += slice.counts[tile];
+        }
+        slice.indices.resize(total);
+        uint32_t cursor[TilesX * TilesY];
+        std::memcpy(cursor, slice.offsets, sizeof(cursor));
+        for (const LightRect& rect : slice.rects) {
+            for (int y = rect.y0; y <= rect.y1; ++y) {
+                for (int x = rect.x0; x <= rect.x1; ++x)
+                    slice.indices[cursor[y * TilesX + x]++] = rect.light;
+            }
+        }
+    }
+
+public:
+    void Create() {
+        m_LightBuffer.Create(GL_RGBA32F, sizeof(glm::vec4), 256 * sizeof(LightRecord) / sizeof(glm::vec4));
+        m_GridBuffer.Create(GL_RG32UI, 2 * sizeof(uint32_t), ClusterCount);
+        m_IndexBuffer.Create(GL_R16UI, sizeof(uint16_t), 16 * 1024);
+    }
+
+    void Destroy() {
+        m_LightBuffer.Destroy();
+        m_GridBuffer.Destroy();
+        m_IndexBuffer.Destroy();
+    }
+
+    void Clear() {
+        m_Lights.clear();
+    }
+
+    void Add(const Light& light) {
+        if (m_Lights.size() < 65536)
+            m_Lights.push_back(light);
+    }
+
+    const ClusterStats& Stats() const {
+        return m_Stats;
+    }
+
+    // assigns the lights to clusters and uploads everything for this frame
+    void Build(JobSystem& jobs, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+               int width, int height) {
+        auto start = std::chrono::high_resolution_clock::now();
+        m_Near = nearPlane;
+        m_Far = farPlane;
+        glm::vec2 screenSize((float)glm::max(width, 1), (float)glm::max(height, 1));
+        m_TileSize = glm::ceil(screenSize / glm::vec2((float)TilesX, (float)TilesY));
+
+        m_ViewSpheres.resize(m_Lights.size());
+        for (size_t i = 0; i < m_Lights.size(); ++i) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(m_Lights[i].position, 1.0f));
+            m_ViewSpheres[i] = glm::vec4(center.x, center.y, -center.z, m_Lights[i].range);
+        }
+        jobs.ParallelFor(Slices, 1, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s)
+                buildSlice((int)s, projection, screenSize);
+        });
+
+        uint32_t total = 0;
+        unsigned maxPerCluster = 0;
+        for (Slice& slice : m_Slices) {
+            slice.base = total;
+            total += (uint32_t)slice.indices.size();
+            for (uint32_t count : slice.counts)
+                maxPerCluster = glm::max(maxPerCluster, (unsigned)count);
+        }
+
+        // lights
+        size_t lightTexels = m_Lights.size() * sizeof(LightRecord) / sizeof(glm::vec4);
+        LightRecord* records = lightTexels ? (LightRecord*)m_LightBuffer.Begin(lightTexels) : nullptr;
+        m_LightCount = records ? lightTexels * sizeof(glm::vec4) / sizeof(LightRecord) : 0;
+        for (size_t i = 0; i < m_LightCount; ++i)
+            records[i].Set(m_Lights[i]);
+        if (records)
+            m_LightBuffer.End();
+
+        // light index lists, slice after slice
+        size_t indexCount = total;
+        uint16_t* indices = indexCount ? (uint16_t*)m_IndexBuffer.Begin(indexCount) : nullptr;
+        if (indices) {
+            for (const Slice& slice : m_Slices) {
+                if (slice.base >= indexCount)
+                    break;
+                size_t count = glm::min(slice.indices.size(), indexCount - slice.base);
+                std::memcpy(indices + slice.base, slice.indices.data(), count * sizeof(uint16_t));
+            }
+            m_IndexBuffer.End();
+        } else {
+            indexCount = 0;
+        }
+
+        // (offset, count) per cluster, clusters whose lists didn't fit or whose lights were dropped stay empty
+        size_t gridTexels = ClusterCount;
+        uint32_t* grid = (uint32_t*)m_GridBuffer.Begin(gridTexels);
+        if (grid) {
+            for (int s = 0; s < Slices; ++s) {
+                const Slice& slice = m_Slices[s];
+                for (int tile = 0; tile < TilesX * TilesY; ++tile) {
+                    uint32_t* cell = grid + 2 * (s * TilesX * TilesY + tile);
+                    uint32_t offset = slice.base + slice.offsets[tile];
+                    bool fits = offset + slice.counts[tile] <= indexCount && m_LightCount == m_Lights.size();
+                    cell[0] = offset;
+                    cell[1] = fits ? slice.counts[tile] : 0;
+                }
+            }
+            m_GridBuffer.End();
+        }
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        m_Stats.buildMs = std::chrono::duration<double, std::milli>(stop - start).count();
+        m_Stats.lightCount = (unsigned)m_Lights.size();
+        m_Stats.indexCount = (unsigned)total;
+        m_Stats.maxLightsPerCluster = maxPerCluster;
+    }
+
+    // binds the buffer textures and sets the cluster uniforms of a clustered lighting program
+    void Apply(Shader& shader) const {
+        m_LightBuffer.Bind(LightUnit);
+        m_GridBuffer.Bind(GridUnit);
+        m_IndexBuffer.Bind(IndexUnit);
+        shader.use();
+        glUniform3i(glGetUniformLocation(shader.ID, "clusterBase"), (GLint)(m_LightBuffer.FirstTexel()),
+                    (GLint)m_GridBuffer.FirstTexel(), (GLint)m_IndexBuffer.FirstTexel());
+        glUniform3i(glGetUniformLocation(shader.ID, "clusterDims"), TilesX, TilesY, Slices);
+        shader.setVec2("clusterTileSize", m_TileSize);
+        float scale = (float)Slices / std::log(m_Far / m_Near);
+        shader.setVec2("clusterSliceScaleBias", glm::vec2(scale, -std::log(m_Near) * scale));
+    }
+
+    // call once per program
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("lightData", LightUnit);
+        shader.setInt("clusterGrid", GridUnit);
+        shader.setInt("lightIndices", IndexUnit);
+    }
+
+    // after the last draw reading this frame's lights
+    void EndFrame() {
+        m_LightBuffer.EndFrame();
+        m_GridBuffer.EndFrame();
+        m_IndexBuffer.EndFrame();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_CLUSTEREDLIGHTS_H
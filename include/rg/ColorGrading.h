@@ -0,0 +1,222 @@
+#ifndef PROJECT_BASE_COLORGRADING_H
+#define PROJECT_BASE_COLORGRADING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// The grade applied on top of the tone curve; gamma is the composite's display gamma.
+struct ColorGradeParams {
+    float gamma = 1.3f;
+    float contrast = 1.0f;   // in log space around mid-grey, before the tone curve
+    float saturation = 1.0f; // 0 is greyscale
+    glm::vec3 colorFilter = glm::vec3(1.0f);
+
+    bool operator==(const ColorGradeParams& other) const {
+        return gamma == other.gamma && contrast == other.contrast && saturation == other.saturation &&
+               colorFilter == other.colorFilter;
+    }
+};
+
+// A 3D LUT in the Adobe/Resolve .cube format: LUT_3D_SIZE, optional DOMAIN_MIN/DOMAIN_MAX, then one
+// "r g b" line per entry with red changing fastest. It maps display colours, after gamma, to graded ones.
+struct CubeLut {
+    // the format allows up to 256 entries per side, more than any grade needs
+    static const int MaxSize = 256;
+
+    int size = 0;
+    glm::vec3 domainMin = glm::vec3(0.0f), domainMax = glm::vec3(1.0f);
+    std::vector<glm::vec3> table;
+
+    bool Empty() const {
+        return table.empty();
+    }
+
+    // false for a missing or malformed file, an empty domain or a size past MaxSize, which leaves the LUT empty
+    bool Load(const std::string& path) {
+        *this = CubeLut();
+        std::ifstream in(path);
+        std::string line;
+        std::vector<glm::vec3> entries;
+        int lutSize = 0;
+        glm::vec3 lo(0.0f), hi(1.0f);
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string keyword;
+            if (!(fields >> keyword) || keyword[0] == '#' || keyword == "TITLE")
+                continue;
+            if (keyword == "LUT_3D_SIZE") {
+                fields >> lutSize;
+            } else if (keyword == "DOMAIN_MIN") {
+                fields >> lo.r >> lo.g >> lo.b;
+            } else if (keyword == "DOMAIN_MAX") {
+                fields >> hi.r >> hi.g >> hi.b;
+            } else if (keyword == "LUT_1D_SIZE") {
+                return false;
+            } else if (std::isalpha((unsigned char)keyword[0])) {
+                continue; // other keywords don't change the mapping
+            } else {
+                glm::vec3 entry;
+                std::istringstream values(line);
+                if (!(values >> entry.r >> entry.g >> entry.b))
+                    return false;
+                entries.push_back(entry);
+            }
+        }
+        if (lutSize < 2 || lutSize > MaxSize || entries.size() != (size_t)lutSize * lutSize * lutSize)
+            return false;
+        // Sample divides by the domain's extent
+        for (int c = 0; c < 3; ++c) {
+            if (!(hi[c] > lo[c]))
+                return false;
+        }
+        size = lutSize;
+        domainMin = lo;
+        domainMax = hi;
+        table.swap(entries);
+        return true;
+    }
+
+    // trilinear, the way the GPU would filter it
+    glm::vec3 Sample(const glm::vec3& color) const {
+        glm::vec3 position = glm::clamp((color - domainMin) / (domainMax - domainMin), 0.0f, 1.0f) *
+                             (float)(size - 1);
+        int base[3];
+        glm::vec3 f;
+        for (int i = 0; i < 3; ++i) {
+            base[i] = std::min((int)position[i], size - 2);
+            f[i] = position[i] - (float)base[i];
+        }
+        auto at = [&](int r, int g, int b) {
+            return table[((size_t)(base[2] + b) * size + (size_t)(base[1] + g)) * size + (size_t)(base[0] + r)];
+        };
+        glm::vec3 c00 = glm::mix(at(0, 0, 0), at(1, 0, 0), f.r), c10 = glm::mix(at(0, 1, 0), at(1, 1, 0), f.r);
+        glm::vec3 c01 = glm::mix(at(0, 0, 1), at(1, 0, 1), f.r), c11 = glm::mix(at(0, 1, 1), at(1, 1, 1), f.r);
+        return glm::mix(glm::mix(c00, c10, f.g), glm::mix(c01, c11, f.g), f.b);
+    }
+};
+
+// The composite's tone curve, grade and gamma baked into one 32^3 3D texture, so the composite does a
+// single trilinear fetch instead of the ALU of each. The LUT is indexed by the log2 of the exposed scene
+// colour per channel, which spreads its entries evenly over the stops from MinLog2 to MaxLog2 instead of
+// spending most of them on highlights the tone curve flattens anyway; below MinLog2 is black to 8 bits,
+// above MaxLog2 the curve is at white.
+//
+// Baking runs on the CPU whenever the parameters or the .cube grade change, a few milliseconds at most.
+class ColorGrading {
+public:
+    static const int Size = 32;
+    static const GLuint LutUnit = 3;
+    static constexpr float MinLog2 = -12.0f;
+    static constexpr float MaxLog2 = 4.0f;
+
+private:
+    GLuint m_Texture = 0;
+    ColorGradeParams m_Baked;
+    bool m_Dirty = true;
+    CubeLut m_Cube;
+    std::vector<glm::vec3> m_Texels;
+
+    glm::vec3 grade(glm::vec3 color, const ColorGradeParams& params) const {
+        const glm::vec3 luma(0.2126f, 0.7152f, 0.0722f);
+        const float midGrey = 0.18f;
+        color = midGrey * glm::pow(color / midGrey, glm::vec3(params.contrast));
+        color *= params.colorFilter;
+        float luminance = glm::dot(color, luma);
+        color = glm::max(glm::vec3(luminance) + (color - glm::vec3(luminance)) * params.saturation, glm::vec3(0.0f));
+        // the exponential tone curve the composite used to evaluate, then gamma
+        color = glm::vec3(1.0f) - glm::exp(-color);
+        color = glm::pow(color, glm::vec3(1.0f / params.gamma));
+        if (!m_Cube.Empty())
+            color = m_Cube.Sample(color);
+        return glm::clamp(color, 0.0f, 1.0f);
+    }
+
+    void bake(const ColorGradeParams& params) {
+        float stops[Size];
+        for (int i = 0; i < Size; ++i)
+            stops[i] = std::exp2(MinLog2 + (MaxLog2 - MinLog2) * (float)i / (float)(Size - 1));
+        m_Texels.resize((size_t)Size * Size * Size);
+        size_t texel = 0;
+        for (int b = 0; b < Size; ++b) {
+            for (int g = 0; g < Size; ++g) {
+                for (int r = 0; r < Size; ++r)
+                    m_Texels[texel++] = grade(glm::vec3(stops[r], stops[g], stops[b]), params);
+            }
+        }
+        glBindTexture(GL_TEXTURE_3D, m_Texture);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, Size, Size, Size, GL_RGB, GL_FLOAT, m_Texels.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        m_Baked = params;
+        m_Dirty = false;
+    }
+
+public:
+    // Once per program that samples the LUT: its unit and the mapping from log2 colour to texture
+    // coordinates, which puts MinLog2 and MaxLog2 at the centres of the first and last texels.
+    static void SetUniforms(Shader& shader) {
+        const float scale = (float)(Size - 1) / (float)Size / (MaxLog2 - MinLog2);
+        shader.use();
+        shader.setInt("colorLut", LutUnit);
+        shader.setFloat("lutScale", scale);
+        shader.setFloat("lutOffset", 0.5f / (float)Size - MinLog2 * scale);
+    }
+
+    void Create() {
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_3D, m_Texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, Size, Size, Size, 0, GL_RGB, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        m_Dirty = true;
+    }
+
+    void Destroy() {
+        glDeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+
+    // Reads a .cube grade applied after gamma, an empty path drops it. False if the file could not be
+    // read, which drops it as well. Takes effect at the next Update.
+    bool LoadCube(const std::string& path) {
+        m_Dirty = true;
+        if (path.empty()) {
+            m_Cube = CubeLut();
+            return true;
+        }
+        return m_Cube.Load(path);
+    }
+
+    bool HasCube() const {
+        return !m_Cube.Empty();
+    }
+
+    // rebakes if params changed since the last bake
+    void Update(const ColorGradeParams& params) {
+        if (m_Dirty || !(params == m_Baked))
+            bake(params);
+    }
+
+    GLuint Texture() const {
+        return m_Texture;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_COLORGRADING_H
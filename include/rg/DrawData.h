@@ -0,0 +1,141 @@
+#ifndef PROJECT_BASE_DRAWDATA_H
+#define PROJECT_BASE_DRAWDATA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/StreamBuffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rg {
+
+// Per-draw data as the vertex shaders read it from the drawData buffer texture, 8 RGBA32F texels.
+struct DrawRecord {
+    glm::vec4 model[4];
+    glm::vec4 normalMatrix[3];
+    glm::vec4 params; // x: shininess, y: material index, z: lightmap region or -1
+
+    void Set(const glm::mat4& transform, const glm::mat3& normal, float shininess, uint32_t materialIndex,
+             int lightmapRegion = -1) {
+        for (int i = 0; i < 4; ++i)
+            model[i] = transform[i];
+        for (int i = 0; i < 3; ++i)
+            normalMatrix[i] = glm::vec4(normal[i], 0.0f);
+        params = glm::vec4(shininess, (float)materialIndex, (float)lightmapRegion, 0.0f);
+    }
+};
+static_assert(sizeof(DrawRecord) == 8 * 4 * sizeof(float), "DrawRecord must match the shader side layout");
+
+// Streams DrawRecords through StreamTextures exposed to shaders as a samplerBuffer. Draws select their
+// record with the aDrawId vertex attribute. The attribute array stays disabled, so its value is the
+// current generic attribute set with Select, which is much cheaper than uploading uniforms per draw.
+// A buffer texture holds GL_MAX_TEXTURE_BUFFER_SIZE texels at most, as few as 65536 on some drivers, so
+// frames with more records spill onto further pages, each a stream texture of its own; Select rebinds
+// the texture when a draw's record is on another page than the last one.
+class DrawDataBuffer {
+public:
+    static const GLuint DrawIdLocation = 5;
+    static const GLuint TextureUnit = 15;
+    static const size_t TexelsPerRecord = sizeof(DrawRecord) / sizeof(glm::vec4);
+
+private:
+    struct Page {
+        StreamTexture stream;
+        DrawRecord* records = nullptr;
+        uint32_t firstDrawId = 0;
+    };
+
+    std::vector<std::unique_ptr<Page>> m_Pages;
+    size_t m_PageRecords = 0;
+    size_t m_UsedPages = 0;
+    size_t m_DroppedDraws = 0;
+    mutable size_t m_BoundPage = 0;
+
+    void addPage(size_t capacity) {
+        m_Pages.emplace_back(new Page());
+        m_Pages.back()->stream.Create(GL_RGBA32F, sizeof(glm::vec4), capacity * TexelsPerRecord);
+    }
+
+public:
+    void Create(size_t capacity) {
+        addPage(capacity);
+        m_PageRecords = m_Pages[0]->stream.MaxCapacity() / TexelsPerRecord;
+    }
+
+    void Destroy() {
+        m_Pages.clear();
+        m_UsedPages = 0;
+    }
+
+    // Maps room for count records of this frame, adding pages as needed. False if the driver could not
+    // map them; count is then 0 and the draws are counted in DroppedDraws.
+    bool Begin(size_t& count) {
+        size_t pages = std::max<size_t>(1, (count + m_PageRecords - 1) / m_PageRecords);
+        while (m_Pages.size() < pages)
+            addPage(m_PageRecords);
+        m_UsedPages = pages;
+        bool mapped = true;
+        for (size_t i = 0; i < pages; ++i) {
+            Page& page = *m_Pages[i];
+            size_t texels = std::min(count - i * m_PageRecords, m_PageRecords) * TexelsPerRecord;
+            page.records = (DrawRecord*)page.stream.Begin(texels);
+            page.firstDrawId = (uint32_t)(page.stream.FirstTexel() / TexelsPerRecord);
+            mapped = mapped && page.records;
+        }
+        m_DroppedDraws = mapped ? 0 : count;
+        if (!mapped)
+            count = 0;
+        return mapped;
+    }
+
+    // the record at index i of this frame, between Begin and End
+    DrawRecord& Record(size_t i) {
+        return m_Pages[i / m_PageRecords]->records[i % m_PageRecords];
+    }
+
+    void End() {
+        for (size_t i = 0; i < m_UsedPages; ++i)
+            m_Pages[i]->stream.End();
+    }
+
+    // after the last draw of the frame
+    void EndFrame() {
+        for (size_t i = 0; i < m_UsedPages; ++i)
+            m_Pages[i]->stream.EndFrame();
+    }
+
+    void Bind() const {
+        m_Pages[0]->stream.Bind(TextureUnit);
+        m_BoundPage = 0;
+    }
+
+    // points the next draws at the record written at index i this frame, after Bind
+    void Select(size_t i) const {
+        size_t page = i / m_PageRecords;
+        if (page != m_BoundPage) {
+            m_Pages[page]->stream.Bind(TextureUnit);
+            m_BoundPage = page;
+        }
+        SetDrawId(m_Pages[page]->firstDrawId + (uint32_t)(i % m_PageRecords));
+    }
+
+    static void SetDrawId(uint32_t drawId) {
+        glVertexAttribI1i(DrawIdLocation, (GLint)drawId);
+    }
+
+    // records of the last Begin that could not be mapped
+    size_t DroppedDraws() const {
+        return m_DroppedDraws;
+    }
+
+    bool Persistent() const {
+        return m_Pages[0]->stream.Persistent();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_DRAWDATA_H
@@ -0,0 +1,123 @@
+#ifndef PROJECT_BASE_DYNAMICRESOLUTION_H
+#define PROJECT_BASE_DYNAMICRESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rg {
+
+// The scale the scene renders at, from the GPU time of the frames before. GPU time comes from GL_TIMESTAMP
+// query pairs around the frame's passes, read a few frames late like the profiler's so reading them never
+// stalls. GPU time goes roughly with the pixel count, so the controller steps the scale down to where
+// that puts the frame under the target, and back up one step at a time while the next step up would still
+// leave some headroom. The scale moves in sixteenths, which keeps the render target pool down to a few
+// sizes, and holds still for a while after each change until frames at the new size are measured.
+class DynamicResolution {
+    static const int Latency = 4;
+    static const int Steps = 16;
+    // frames after a change whose timing is not trusted, the queries in flight are of the old size
+    static const int SettleFrames = 2 * Latency;
+    // frames measured before the controller acts on them
+    static const unsigned MinSamples = Latency;
+
+    GLuint m_Queries[Latency][2] = {};
+    bool m_Pending[Latency] = {};
+    int m_Frame = 0;
+    int m_Step = Steps;
+    int m_Settle = 0;
+    double m_GpuMs = 0.0; // smoothed
+    unsigned m_Samples = 0;
+
+    void collect() {
+        int slot = m_Frame % Latency;
+        if (!m_Pending[slot])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(m_Queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return; // still in flight, the slot gets reused anyway
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(m_Queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(m_Queries[slot][1], GL_QUERY_RESULT, &end);
+        m_Pending[slot] = false;
+        if (m_Settle > 0)
+            return;
+        double ms = (double)(end - start) / 1e6;
+        m_GpuMs = m_Samples == 0 ? ms : m_GpuMs * 0.8 + ms * 0.2;
+        ++m_Samples;
+    }
+
+    void setStep(int step) {
+        if (step == m_Step)
+            return;
+        m_Step = step;
+        m_Settle = SettleFrames;
+        m_Samples = 0;
+    }
+
+public:
+    void Create() {
+        glGenQueries(Latency * 2, &m_Queries[0][0]);
+    }
+
+    void Destroy() {
+        glDeleteQueries(Latency * 2, &m_Queries[0][0]);
+    }
+
+    // Once per frame before the render size is picked: reads the finished queries and moves the scale
+    // towards targetMs, never below minScale. Disabled, the scene renders at full size.
+    void Update(bool enabled, float targetMs, float minScale) {
+        ++m_Frame;
+        collect();
+        if (m_Settle > 0)
+            --m_Settle;
+        int minStep = std::min(Steps, std::max(1, (int)std::ceil(minScale * (float)Steps)));
+        if (!enabled) {
+            setStep(Steps);
+            return;
+        }
+        if (m_Step < minStep) {
+            setStep(minStep);
+            return;
+        }
+        if (m_Settle > 0 || m_Samples < MinSamples || m_GpuMs <= 0.0)
+            return;
+        float scale = Scale();
+        if (m_GpuMs > targetMs && m_Step > minStep) {
+            float fit = scale * (float)std::sqrt(targetMs / m_GpuMs);
+            setStep(std::max(minStep, std::min(m_Step - 1, (int)std::floor(fit * (float)Steps))));
+        } else if (m_Step < Steps) {
+            float up = (float)(m_Step + 1) / (float)Steps;
+            double predictedMs = m_GpuMs * (double)(up * up) / (double)(scale * scale);
+            if (predictedMs < targetMs * 0.9)
+                setStep(m_Step + 1);
+        }
+    }
+
+    // around the GPU work the scale applies to
+    void Begin() {
+        glQueryCounter(m_Queries[m_Frame % Latency][0], GL_TIMESTAMP);
+    }
+
+    void End() {
+        int slot = m_Frame % Latency;
+        glQueryCounter(m_Queries[slot][1], GL_TIMESTAMP);
+        m_Pending[slot] = true;
+    }
+
+    // of the window's size, per axis
+    float Scale() const {
+        return (float)m_Step / (float)Steps;
+    }
+
+    // smoothed, a few frames late; 0 until frames at the current scale were measured
+    double GpuMs() const {
+        return m_Samples ? m_GpuMs : 0.0;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_DYNAMICRESOLUTION_H
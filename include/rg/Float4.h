@@ -0,0 +1,86 @@
+#ifndef PROJECT_BASE_FLOAT4_H
+#define PROJECT_BASE_FLOAT4_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RG_SSE 1
+#endif
+
+namespace rg {
+
+// Four floats processed together; SSE2 where available, plain loops otherwise.
+struct Float4 {
+#ifdef RG_SSE
+    __m128 v;
+
+    Float4() : v(_mm_setzero_ps()) {}
+    Float4(__m128 value) : v(value) {}
+    explicit Float4(float s) : v(_mm_set1_ps(s)) {}
+    static Float4 Load(const float* p) { return Float4(_mm_loadu_ps(p)); }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+    static Float4 FromBits(uint32_t bits) { return Float4(_mm_castsi128_ps(_mm_set1_epi32((int)bits))); }
+
+    Float4 operator+(const Float4& o) const { return _mm_add_ps(v, o.v); }
+    Float4 operator-(const Float4& o) const { return _mm_sub_ps(v, o.v); }
+    Float4 operator*(const Float4& o) const { return _mm_mul_ps(v, o.v); }
+    Float4 operator/(const Float4& o) const { return _mm_div_ps(v, o.v); }
+    // comparisons give all-ones lanes where true
+    Float4 operator<(const Float4& o) const { return _mm_cmplt_ps(v, o.v); }
+    Float4 operator<=(const Float4& o) const { return _mm_cmple_ps(v, o.v); }
+    Float4 operator>(const Float4& o) const { return _mm_cmpgt_ps(v, o.v); }
+    Float4 operator>=(const Float4& o) const { return _mm_cmpge_ps(v, o.v); }
+    Float4 operator&(const Float4& o) const { return _mm_and_ps(v, o.v); }
+    Float4 operator|(const Float4& o) const { return _mm_or_ps(v, o.v); }
+    static Float4 Min(const Float4& a, const Float4& b) { return _mm_min_ps(a.v, b.v); }
+    static Float4 Max(const Float4& a, const Float4& b) { return _mm_max_ps(a.v, b.v); }
+    static Float4 Abs(const Float4& a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    static Float4 Sqrt(const Float4& a) { return _mm_sqrt_ps(a.v); }
+    // lanes of b where mask is set, of a elsewhere
+    static Float4 Select(const Float4& a, const Float4& b, const Float4& mask) {
+        return _mm_or_ps(_mm_andnot_ps(mask.v, a.v), _mm_and_ps(mask.v, b.v));
+    }
+    int Mask() const { return _mm_movemask_ps(v); }
+#else
+    float v[4];
+
+    Float4() : v{0.0f, 0.0f, 0.0f, 0.0f} {}
+    explicit Float4(float s) : v{s, s, s, s} {}
+    static Float4 Load(const float* p) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+    void Store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+    static Float4 FromBits(uint32_t bits) { Float4 r; for (float& f : r.v) std::memcpy(&f, &bits, 4); return r; }
+
+    template<typename Op>
+    Float4 apply(const Float4& o, Op op) const { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = op(v[i], o.v[i]); return r; }
+    static float bits(bool b) { uint32_t u = b ? ~0u : 0u; float f; std::memcpy(&f, &u, 4); return f; }
+    static uint32_t raw(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+
+    Float4 operator+(const Float4& o) const { return apply(o, [](float a, float b) { return a + b; }); }
+    Float4 operator-(const Float4& o) const { return apply(o, [](float a, float b) { return a - b; }); }
+    Float4 operator*(const Float4& o) const { return apply(o, [](float a, float b) { return a * b; }); }
+    Float4 operator/(const Float4& o) const { return apply(o, [](float a, float b) { return a / b; }); }
+    Float4 operator<(const Float4& o) const { return apply(o, [](float a, float b) { return bits(a < b); }); }
+    Float4 operator<=(const Float4& o) const { return apply(o, [](float a, float b) { return bits(a <= b); }); }
+    Float4 operator>(const Float4& o) const { return apply(o, [](float a, float b) { return bits(a > b); }); }
+    Float4 operator>=(const Float4& o) const { return apply(o, [](float a, float b) { return bits(a >= b); }); }
+    Float4 operator&(const Float4& o) const { return apply(o, [](float a, float b) { float f; uint32_t u = raw(a) & raw(b); std::memcpy(&f, &u, 4); return f; }); }
+    Float4 operator|(const Float4& o) const { return apply(o, [](float a, float b) { float f; uint32_t u = raw(a) | raw(b); std::memcpy(&f, &u, 4); return f; }); }
+    static Float4 Min(const Float4& a, const Float4& b) { return a.apply(b, [](float x, float y) { return y < x ? y : x; }); }
+    static Float4 Max(const Float4& a, const Float4& b) { return a.apply(b, [](float x, float y) { return y > x ? y : x; }); }
+    static Float4 Abs(const Float4& a) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::fabs(a.v[i]); return r; }
+    static Float4 Sqrt(const Float4& a) { Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+    static Float4 Select(const Float4& a, const Float4& b, const Float4& mask) {
+        Float4 r;
+        for (int i = 0; i < 4; ++i) r.v[i] = raw(mask.v[i]) ? b.v[i] : a.v[i];
+        return r;
+    }
+    int Mask() const { int m = 0; for (int i = 0; i < 4; ++i) m |= (raw(v[i]) >> 31) << i; return m; }
+#endif
+};
+
+}
+
+#endif //PROJECT_BASE_FLOAT4_H
@@ -0,0 +1,85 @@
+#ifndef PROJECT_BASE_GBUFFER_H
+#define PROJECT_BASE_GBUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <rg/RenderTargetPool.h>
+
+namespace rg {
+
+// Geometry buffer of the deferred path, 12 bytes per pixel:
+//  0: RGBA8     albedo, specular intensity
+//  1: RGB10_A2  octahedral normal, shininess / 256
+//  depth: DEPTH_COMPONENT24, world positions are reconstructed from it
+// The depth format matches the HDR framebuffer's depth buffer, so BlitDepth can hand it over to the
+// forward passes that run after the lighting pass. The targets are render graph resources of these
+// descriptors; the geometry pass hands them over with SetTargets.
+class GBuffer {
+public:
+    static const GLuint AlbedoSpecularUnit = 0;
+    static const GLuint NormalShininessUnit = 1;
+    static const GLuint DepthUnit = 2;
+    static const int BytesPerPixel = 4 + 4 + 4;
+
+    static RenderTargetDesc AlbedoSpecularDesc(int width, int height) {
+        return RenderTargetDesc(width, height, GL_RGBA8);
+    }
+
+    static RenderTargetDesc NormalShininessDesc(int width, int height) {
+        return RenderTargetDesc(width, height, GL_RGB10_A2);
+    }
+
+    static RenderTargetDesc DepthDesc(int width, int height) {
+        return RenderTargetDesc(width, height, GL_DEPTH_COMPONENT24);
+    }
+
+private:
+    GLuint m_FBO = 0;
+    GLuint m_AlbedoSpecular = 0;
+    GLuint m_NormalShininess = 0;
+    GLuint m_Depth = 0;
+    int m_Width = 0, m_Height = 0;
+
+public:
+    // this frame's targets and the framebuffer they are attached to, albedo and normal in that order
+    void SetTargets(GLuint framebuffer, GLuint albedoSpecular, GLuint normalShininess, GLuint depth, int width,
+                    int height) {
+        m_FBO = framebuffer;
+        m_AlbedoSpecular = albedoSpecular;
+        m_NormalShininess = normalShininess;
+        m_Depth = depth;
+        m_Width = width;
+        m_Height = height;
+    }
+
+    void BindTextures() const {
+        glActiveTexture(GL_TEXTURE0 + AlbedoSpecularUnit);
+        glBindTexture(GL_TEXTURE_2D, m_AlbedoSpecular);
+        glActiveTexture(GL_TEXTURE0 + NormalShininessUnit);
+        glBindTexture(GL_TEXTURE_2D, m_NormalShininess);
+        glActiveTexture(GL_TEXTURE0 + DepthUnit);
+        glBindTexture(GL_TEXTURE_2D, m_Depth);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // copies the scene depth into the target framebuffer, which is left bound
+    void BlitDepth(GLuint targetFBO) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+        glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    }
+
+    // call once per lighting program
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("gAlbedoSpecular", AlbedoSpecularUnit);
+        shader.setInt("gNormalShininess", NormalShininessUnit);
+        shader.setInt("gDepth", DepthUnit);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_GBUFFER_H
@@ -0,0 +1,133 @@
+#ifndef PROJECT_BASE_GLEXT_H
+#define PROJECT_BASE_GLEXT_H
+
+#include <glad/glad.h>
+#include <cstring>
+
+// glad in libs/ is generated for plain GL 3.3 core without extensions. Everything newer that we
+// can take advantage of is loaded here at runtime and must be checked for before use.
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+
+typedef void (APIENTRYP RG_PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (APIENTRYP RG_PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP RG_PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP RG_PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP RG_PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+typedef void (APIENTRYP RG_PFNGLDISPATCHCOMPUTEPROC)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+typedef void (APIENTRYP RG_PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP RG_PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+
+namespace rg {
+
+struct GLExtensions {
+    int major = 3;
+    int minor = 3;
+
+    // GL 4.4 / ARB_buffer_storage
+    bool bufferStorage = false;
+    RG_PFNGLBUFFERSTORAGEPROC BufferStorage = nullptr;
+
+    // GL 4.1 / ARB_get_program_binary, and the driver offers at least one binary format
+    bool programBinary = false;
+    RG_PFNGLGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+    RG_PFNGLPROGRAMBINARYPROC ProgramBinary = nullptr;
+    RG_PFNGLPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+
+    // KHR/ARB_parallel_shader_compile: compiles run on driver threads and GL_COMPLETION_STATUS_KHR can be
+    // polled without blocking
+    bool parallelShaderCompile = false;
+    RG_PFNGLMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads = nullptr;
+
+    // GL 4.3 compute shaders, with the GL 4.2 image load/store they write through
+    bool computeShaders = false;
+    RG_PFNGLDISPATCHCOMPUTEPROC DispatchCompute = nullptr;
+    RG_PFNGLBINDIMAGETEXTUREPROC BindImageTexture = nullptr;
+    RG_PFNGLMEMORYBARRIERPROC MemoryBarrier = nullptr;
+
+    bool AtLeast(int wantMajor, int wantMinor) const {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+};
+
+inline GLExtensions& glext() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load) {
+    GLExtensions& ext = glext();
+    glGetIntegerv(GL_MAJOR_VERSION, &ext.major);
+    glGetIntegerv(GL_MINOR_VERSION, &ext.minor);
+
+    if (ext.AtLeast(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+        ext.BufferStorage = (RG_PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    ext.bufferStorage = ext.BufferStorage != nullptr;
+
+    if (ext.AtLeast(4, 1) || hasGLExtension("GL_ARB_get_program_binary")) {
+        ext.GetProgramBinary = (RG_PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        ext.ProgramBinary = (RG_PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        ext.ProgramParameteri = (RG_PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    }
+    GLint binaryFormats = 0;
+    if (ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    ext.programBinary = binaryFormats > 0;
+
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (RG_PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (RG_PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+    ext.parallelShaderCompile = ext.MaxShaderCompilerThreads != nullptr;
+    if (ext.parallelShaderCompile)
+        ext.MaxShaderCompilerThreads(0xffffffffu); // as many as the driver likes
+
+    if (ext.AtLeast(4, 3)) {
+        ext.DispatchCompute = (RG_PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+        ext.BindImageTexture = (RG_PFNGLBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+        ext.MemoryBarrier = (RG_PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+    }
+    ext.computeShaders = ext.DispatchCompute && ext.BindImageTexture && ext.MemoryBarrier;
+}
+
+}
+
+#endif //PROJECT_BASE_GLEXT_H
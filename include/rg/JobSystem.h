@@ -0,0 +1,169 @@
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg {
+
+// Counts the jobs of one batch that are still in flight; JobSystem::Wait blocks on it.
+struct JobCounter {
+    std::atomic<int> pending{0};
+};
+
+// Work-stealing thread pool. Every thread owns a queue: the owner pushes and pops at the back,
+// idle threads steal from the front of the others. Queue 0 belongs to the thread that created
+// the pool (the GL thread), which helps out with the work while it waits on a counter.
+class JobSystem {
+    struct Job {
+        std::function<void()> task;
+        JobCounter* counter;
+    };
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+    std::vector<std::thread> m_Workers;
+    std::mutex m_SleepMutex;
+    std::condition_variable m_WakeUp;
+    std::atomic<bool> m_Running{true};
+    std::atomic<int> m_QueuedJobs{0};
+    std::atomic<unsigned> m_NextQueue{0};
+
+    static int& threadQueueIndex() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    bool popLocal(int queueIndex, Job& job) {
+        WorkQueue& queue = *m_Queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            return false;
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(int thiefIndex, Job& job) {
+        int queueCount = (int)m_Queues.size();
+        for (int offset = 1; offset < queueCount; ++offset) {
+            WorkQueue& queue = *m_Queues[(thiefIndex + offset) % queueCount];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool tryRunOne(int queueIndex) {
+        Job job;
+        if (!popLocal(queueIndex, job) && !steal(queueIndex, job))
+            return false;
+        m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        job.task();
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void workerLoop(int queueIndex) {
+        threadQueueIndex() = queueIndex;
+        while (m_Running.load(std::memory_order_acquire)) {
+            if (tryRunOne(queueIndex))
+                continue;
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_WakeUp.wait(lock, [this] {
+                return !m_Running.load(std::memory_order_acquire) || m_QueuedJobs.load(std::memory_order_relaxed) > 0;
+            });
+        }
+    }
+
+public:
+    // threadCount includes the calling thread, so 1 runs every job inline inside Wait.
+    explicit JobSystem(unsigned threadCount = std::thread::hardware_concurrency()) {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; ++i)
+            m_Queues.emplace_back(new WorkQueue);
+        threadQueueIndex() = 0;
+        for (unsigned i = 1; i < threadCount; ++i)
+            m_Workers.emplace_back(&JobSystem::workerLoop, this, (int)i);
+    }
+
+    ~JobSystem() {
+        m_Running.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+        }
+        m_WakeUp.notify_all();
+        for (std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned ThreadCount() const {
+        return (unsigned)m_Queues.size();
+    }
+
+    void Submit(JobCounter& counter, std::function<void()> task) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        int queueIndex = threadQueueIndex();
+        // jobs submitted from the GL thread are spread over the workers' queues
+        if (queueIndex == 0 && m_Queues.size() > 1)
+            queueIndex = 1 + (int)(m_NextQueue.fetch_add(1, std::memory_order_relaxed) % (m_Queues.size() - 1));
+        {
+            WorkQueue& queue = *m_Queues[queueIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Job{std::move(task), &counter});
+        }
+        m_QueuedJobs.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+        }
+        m_WakeUp.notify_one();
+    }
+
+    // runs queued jobs on the calling thread until every job counted by counter finished
+    void Wait(JobCounter& counter) {
+        int queueIndex = threadQueueIndex();
+        while (counter.pending.load(std::memory_order_acquire) > 0) {
+            if (!tryRunOne(queueIndex))
+                std::this_thread::yield();
+        }
+    }
+
+    // splits [0, count) into chunks of at most grainSize and calls body(begin, end) for each of them
+    template<typename Body>
+    void ParallelFor(size_t count, size_t grainSize, const Body& body) {
+        if (count == 0)
+            return;
+        grainSize = std::max<size_t>(1, grainSize);
+        if (count <= grainSize || m_Queues.size() == 1) {
+            body(size_t(0), count);
+            return;
+        }
+        JobCounter counter;
+        for (size_t begin = 0; begin < count; begin += grainSize) {
+            size_t end = std::min(count, begin + grainSize);
+            Submit(counter, [&body, begin, end] { body(begin, end); });
+        }
+        Wait(counter);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
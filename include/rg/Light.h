@@ -0,0 +1,75 @@
+#ifndef PROJECT_BASE_LIGHT_H
+#define PROJECT_BASE_LIGHT_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+namespace rg {
+
+// Point or spot light with the same parameters the lighting shaders always used
+struct Light {
+    glm::vec3 position = glm::vec3(0.0f);
+    // not shaded any more, ambient light comes from the sky (rg::SkyIrradiance)
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(1.0f);
+    glm::vec3 specular = glm::vec3(1.0f);
+    float constant = 1.0f;
+    float linear = 0.0f;
+    float quadratic = 1.0f;
+    // spot lights: cone axis and cosines of the inner and outer cone angles; the defaults
+    // put every direction inside the inner cone, which makes it a point light
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float cutOff = -2.0f;
+    float outerCutOff = -3.0f;
+    // lighting is faded out towards this distance, the clusters only reference lights within it
+    float range = 0.0f;
+    // first face in the LightShadowAtlas, -1 for no shadows, and the angle one of its texels covers
+    int shadowFace = -1;
+    float shadowTexelAngle = 0.0f;
+    // static light the lightmap baker accounted for, lightmapped surfaces skip it
+    bool baked = false;
+
+    static Light Point(const glm::vec3& position, const glm::vec3& ambient, const glm::vec3& diffuse,
+                       const glm::vec3& specular, float constant, float linear, float quadratic) {
+        Light light;
+        light.position = position;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        light.ComputeRange();
+        return light;
+    }
+
+    static Light Spot(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& ambient,
+                      const glm::vec3& diffuse, const glm::vec3& specular, float constant, float linear,
+                      float quadratic, float cutOff, float outerCutOff) {
+        Light light = Point(position, ambient, diffuse, specular, constant, linear, quadratic);
+        light.direction = direction;
+        light.cutOff = cutOff;
+        light.outerCutOff = outerCutOff;
+        return light;
+    }
+
+    // distance at which the attenuated light falls below 1/256 of an 8-bit step
+    void ComputeRange() {
+        float peak = glm::max(glm::max(glm::max(diffuse.r, diffuse.g), diffuse.b),
+                              glm::max(glm::max(specular.r, specular.g), specular.b));
+        float target = glm::max(peak * 256.0f, constant);
+        if (quadratic > 0.0f) {
+            float c = constant - target;
+            range = (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+        } else if (linear > 0.0f) {
+            range = (target - constant) / linear;
+        } else {
+            range = 1000.0f;
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LIGHT_H
@@ -0,0 +1,295 @@
+#ifndef PROJECT_BASE_LIGHTSHADOWATLAS_H
+#define PROJECT_BASE_LIGHTSHADOWATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/ClusteredLights.h>
+#include <rg/DrawData.h>
+#include <rg/Scene.h>
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct LightShadowStats {
+    unsigned lightCount = 0;  // lights with faces in the atlas
+    unsigned faceCount = 0;
+    unsigned dirtyFaces = 0;  // faces that wanted an update this frame
+    unsigned facesDrawn = 0;  // at most the budget
+    unsigned casterDraws = 0;
+};
+
+// Shadows of point and spot lights, every face in a tile of one shared depth atlas: six 90 degree faces
+// per point light, in +X -X +Y -Y +Z -Z order, and one per spot light.
+//
+// A face is cached until it has to change. That is when its light moved, or when an animated caster is
+// inside its frustum now or was at its last update, so the caster's old shadow gets cleared too. Faces
+// that need an update are drawn round-robin under a per-frame budget; the rest wait for a later frame
+// and keep showing their previous shadows meanwhile. Emissive light sources don't cast, their meshes
+// enclose their own lights.
+class LightShadowAtlas {
+public:
+    static const int TilesX = 6;
+    static const int TilesY = 4;
+    // lighting.glsl hardcodes the 6x4 tiles and lightShadowMatrices[24]
+    static const int MaxFaces = TilesX * TilesY;
+    static const GLuint TextureUnit = 10;
+
+private:
+    struct Face {
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        glm::mat4 shadowMatrix = glm::mat4(1.0f); // world -> atlas texture coordinates and depth
+        Frustum frustum;
+        bool valid = false;
+        bool hadDynamic = false; // an animated caster was drawn into it at its last update
+        bool dirty = false;
+    };
+
+    struct TrackedLight {
+        Light light;
+        int firstFace = -1;
+        int faceCount = 0;
+    };
+
+    std::vector<TrackedLight> m_Lights;
+    Face m_Faces[MaxFaces];
+    int m_FaceCount = 0;
+    int m_Cursor = 0;
+    int m_Budget = 6;
+    std::vector<int> m_Scheduled;
+    int m_TileResolution = 0;
+    GLuint m_FBO = 0, m_Depth = 0;
+    LightShadowStats m_Stats;
+
+    static bool isPoint(const Light& light) {
+        return light.cutOff < -1.0f;
+    }
+
+    // of a face, a spot light's face covers its outer cone
+    static float fieldOfView(const Light& light) {
+        return isPoint(light) ? glm::radians(90.0f) : 2.0f * std::acos(glm::clamp(light.outerCutOff, -1.0f, 1.0f));
+    }
+
+    static bool sameLight(const Light& a, const Light& b) {
+        return a.position == b.position && a.direction == b.direction && a.range == b.range &&
+               a.outerCutOff == b.outerCutOff;
+    }
+
+    void setupFaces(const TrackedLight& tracked) {
+        const Light& light = tracked.light;
+        static const glm::vec3 directions[6] = {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+                                                glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+                                                glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+        float fov = fieldOfView(light);
+        glm::mat4 projection = glm::perspective(fov, 1.0f, 0.05f, glm::max(light.range, 0.1f));
+        for (int i = 0; i < tracked.faceCount; ++i) {
+            int index = tracked.firstFace + i;
+            Face& face = m_Faces[index];
+            glm::vec3 forward = isPoint(light) ? directions[i] : glm::normalize(light.direction);
+            glm::vec3 up = std::abs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            face.view = glm::lookAt(light.position, light.position + forward, up);
+            face.projection = projection;
+            face.frustum = Frustum::FromMatrix(projection * face.view);
+            // clip space -> this face's tile of the atlas, it commutes with the perspective divide
+            glm::vec2 tile((float)(index % TilesX), (float)(index / TilesX));
+            glm::mat4 atlas = glm::translate(glm::mat4(1.0f), glm::vec3((tile.x + 0.5f) / TilesX,
+                                                                        (tile.y + 0.5f) / TilesY, 0.5f)) *
+                              glm::scale(glm::mat4(1.0f), glm::vec3(0.5f / TilesX, 0.5f / TilesY, 0.5f));
+            face.shadowMatrix = atlas * projection * face.view;
+            face.valid = false;
+        }
+    }
+
+public:
+    void Create(int tileResolution = 512) {
+        Destroy();
+        m_TileResolution = tileResolution;
+        glGenTextures(1, &m_Depth);
+        glBindTexture(GL_TEXTURE_2D, m_Depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, tileResolution * TilesX, tileResolution * TilesY, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &m_FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_Depth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Light shadow atlas framebuffer not complete!" << std::endl;
+        // faces that were never drawn read as fully lit
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        Invalidate();
+    }
+
+    void Destroy() {
+        if (!m_FBO)
+            return;
+        glDeleteFramebuffers(1, &m_FBO);
+        glDeleteTextures(1, &m_Depth);
+        m_FBO = m_Depth = 0;
+    }
+
+    // faces drawn per frame at most
+    void SetBudget(int faces) {
+        m_Budget = glm::max(faces, 1);
+    }
+
+    // every face is redrawn, e.g. after static objects were added or removed
+    void Invalidate() {
+        for (Face& face : m_Faces)
+            face.valid = false;
+    }
+
+    // Gives the light with the given slot shadow faces and returns it with its first face set, for
+    // ClusteredLights::Add. Slots are allocated in order of first use; once the atlas is full, new lights
+    // stay unshadowed.
+    Light Track(size_t slot, Light light) {
+        if (slot >= m_Lights.size())
+            m_Lights.resize(slot + 1);
+        TrackedLight& tracked = m_Lights[slot];
+        if (tracked.firstFace < 0) {
+            int faceCount = isPoint(light) ? 6 : 1;
+            if (m_FaceCount + faceCount > MaxFaces)
+                return light;
+            tracked.firstFace = m_FaceCount;
+            tracked.faceCount = faceCount;
+            m_FaceCount += faceCount;
+            tracked.light = light;
+            setupFaces(tracked);
+        } else if (!sameLight(tracked.light, light)) {
+            tracked.light = light;
+            setupFaces(tracked);
+        }
+        light.shadowFace = tracked.firstFace;
+        light.shadowTexelAngle = 2.0f * std::tan(fieldOfView(light) * 0.5f) / (float)m_TileResolution;
+        return light;
+    }
+
+    // Picks this frame's faces: the dirty ones, round-robin from where the last frame stopped, up to the
+    // budget. Only the animated casters, from dynamicBegin on, are looked at.
+    void Schedule(const std::vector<ShadowCaster>& casters, size_t dynamicBegin) {
+        m_Stats = LightShadowStats();
+        m_Scheduled.clear();
+        for (int i = 0; i < m_FaceCount; ++i) {
+            Face& face = m_Faces[i];
+            bool dynamic = false;
+            for (size_t c = dynamicBegin; c < casters.size() && !dynamic; ++c) {
+                dynamic = casters[c].pass != ShadingPass::LightSource &&
+                          face.frustum.IntersectsSphere(casters[c].center, casters[c].radius);
+            }
+            face.dirty = !face.valid || dynamic || face.hadDynamic;
+            if (face.dirty)
+                ++m_Stats.dirtyFaces;
+        }
+        for (int n = 0; n < m_FaceCount && (int)m_Scheduled.size() < m_Budget; ++n) {
+            int index = (m_Cursor + n) % m_FaceCount;
+            if (m_Faces[index].dirty)
+                m_Scheduled.push_back(index);
+        }
+        if (!m_Scheduled.empty())
+            m_Cursor = (m_Scheduled.back() + 1) % m_FaceCount;
+        for (const TrackedLight& tracked : m_Lights) {
+            if (tracked.firstFace >= 0)
+                ++m_Stats.lightCount;
+        }
+        m_Stats.faceCount = (unsigned)m_FaceCount;
+    }
+
+    // a scheduled face is redrawn with every caster, static ones included
+    bool NeedsStaticCasters() const {
+        return !m_Scheduled.empty();
+    }
+
+    // Draws the scheduled faces with the depth-only shader; casters[i] uses the draw record firstRecord + i.
+    // Casters before dynamicBegin are static. Leaves the atlas framebuffer bound and the viewport changed.
+    void Render(const std::vector<ShadowCaster>& casters, size_t dynamicBegin, const DrawDataBuffer& drawData,
+                size_t firstRecord, Shader& depthShader) {
+        if (m_Scheduled.empty())
+            return;
+        depthShader.use();
+        drawData.Bind();
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        glEnable(GL_SCISSOR_TEST);
+        for (int index : m_Scheduled) {
+            Face& face = m_Faces[index];
+            int x = (index % TilesX) * m_TileResolution, y = (index / TilesX) * m_TileResolution;
+            glViewport(x, y, m_TileResolution, m_TileResolution);
+            glScissor(x, y, m_TileResolution, m_TileResolution);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depthShader.setMat4("view", face.view);
+            depthShader.setMat4("projection", face.projection);
+            bool cullFaces = true;
+            glEnable(GL_CULL_FACE);
+            face.hadDynamic = false;
+            for (size_t i = 0; i < casters.size(); ++i) {
+                const ShadowCaster& caster = casters[i];
+                if (caster.pass == ShadingPass::LightSource || !face.frustum.IntersectsSphere(caster.center, caster.radius))
+                    continue;
+                if (caster.cullFaces != cullFaces) {
+                    cullFaces = caster.cullFaces;
+                    if (cullFaces)
+                        glEnable(GL_CULL_FACE);
+                    else
+                        glDisable(GL_CULL_FACE);
+                }
+                drawData.Select(firstRecord + i);
+                caster.model->DrawDepth();
+                ++m_Stats.casterDraws;
+                face.hadDynamic |= i >= dynamicBegin;
+            }
+            face.valid = true;
+            ++m_Stats.facesDrawn;
+        }
+        glEnable(GL_CULL_FACE);
+        glDisable(GL_SCISSOR_TEST);
+        DrawDataBuffer::SetDrawId(0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+    }
+
+    // binds the atlas and sets the face matrices of a lighting shader
+    void Apply(Shader& shader) const {
+        glActiveTexture(GL_TEXTURE0 + TextureUnit);
+        glBindTexture(GL_TEXTURE_2D, m_Depth);
+        glActiveTexture(GL_TEXTURE0);
+        shader.use();
+        for (int i = 0; i < m_FaceCount; ++i)
+            shader.setMat4("lightShadowMatrices[" + std::to_string(i) + "]", m_Faces[i].shadowMatrix);
+        shader.setVec2("lightShadowTexel", 1.0f / (float)(m_TileResolution * TilesX),
+                       1.0f / (float)(m_TileResolution * TilesY));
+    }
+
+    // call once per lighting program
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("lightShadowAtlas", TextureUnit);
+    }
+
+    const LightShadowStats& Stats() const {
+        return m_Stats;
+    }
+
+    int Budget() const {
+        return m_Budget;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LIGHTSHADOWATLAS_H
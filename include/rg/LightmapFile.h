@@ -0,0 +1,102 @@
+#ifndef PROJECT_BASE_LIGHTMAPFILE_H
+#define PROJECT_BASE_LIGHTMAPFILE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Shared exponent HDR texel, the layout of GL_RGB9_E5 with GL_UNSIGNED_INT_5_9_9_9_REV
+inline uint32_t PackRGB9E5(const glm::vec3& color) {
+    const float maxValue = 65408.0f; // (511 / 512) * 2^(31 - 15)
+    float r = glm::clamp(color.r, 0.0f, maxValue), g = glm::clamp(color.g, 0.0f, maxValue),
+          b = glm::clamp(color.b, 0.0f, maxValue);
+    float maxChannel = std::max(r, std::max(g, b));
+    int exponent = std::max(-16, (int)std::floor(std::log2(std::max(maxChannel, 1e-30f)))) + 1 + 15;
+    float scale = std::pow(2.0f, (float)(exponent - 15 - 9));
+    if ((int)std::floor(maxChannel / scale + 0.5f) == 512) {
+        scale *= 2.0f;
+        ++exponent;
+    }
+    uint32_t rm = (uint32_t)std::floor(r / scale + 0.5f), gm = (uint32_t)std::floor(g / scale + 0.5f),
+             bm = (uint32_t)std::floor(b / scale + 0.5f);
+    return (uint32_t)exponent << 27 | bm << 18 | gm << 9 | rm;
+}
+
+// What tools/lightmap_baker writes and rg::Lightmaps reads: irradiance from the static lanterns for every
+// static lit object of ShackScene.h, in one RGB9E5 atlas.
+//
+// Lightmap UVs are per model, so instances share them. Every triangle has its own chart, a right triangle
+// in a square cell of texels with a one texel border. The model's charts are packed into one rectangle,
+// and each object gets its own copy of that rectangle in the atlas.
+struct LightmapFile {
+    static const uint32_t Magic = 0x4D4C4752; // "RGLM"
+    static const uint32_t Version = 2;
+
+    struct ModelCharts {
+        uint32_t model = 0;                  // ShackModel
+        std::vector<uint32_t> meshTriangles; // per mesh, in Model's mesh order
+        std::vector<glm::vec2> uvs;          // three per triangle over all meshes, 0..1 across the rectangle
+    };
+
+    uint32_t width = 0, height = 0;
+    std::vector<ModelCharts> models;
+    std::vector<glm::vec4> regions; // per ShackLitObjects() entry: atlas offset xy, scale zw
+    std::vector<uint32_t> texels;   // RGB9E5, width * height
+
+    bool Write(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        uint32_t header[6] = {Magic, Version, width, height, (uint32_t)models.size(), (uint32_t)regions.size()};
+        out.write((const char*)header, sizeof(header));
+        for (const ModelCharts& charts : models) {
+            uint32_t modelHeader[2] = {charts.model, (uint32_t)charts.meshTriangles.size()};
+            out.write((const char*)modelHeader, sizeof(modelHeader));
+            out.write((const char*)charts.meshTriangles.data(), charts.meshTriangles.size() * sizeof(uint32_t));
+            out.write((const char*)charts.uvs.data(), charts.uvs.size() * sizeof(glm::vec2));
+        }
+        out.write((const char*)regions.data(), regions.size() * sizeof(glm::vec4));
+        out.write((const char*)texels.data(), texels.size() * sizeof(uint32_t));
+        return (bool)out;
+    }
+
+    // false for a missing, truncated or outdated file
+    bool Read(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        uint32_t header[6] = {};
+        if (!in.read((char*)header, sizeof(header)) || header[0] != Magic || header[1] != Version)
+            return false;
+        width = header[2];
+        height = header[3];
+        models.resize(header[4]);
+        for (ModelCharts& charts : models) {
+            uint32_t modelHeader[2] = {};
+            if (!in.read((char*)modelHeader, sizeof(modelHeader)))
+                return false;
+            charts.model = modelHeader[0];
+            charts.meshTriangles.resize(modelHeader[1]);
+            in.read((char*)charts.meshTriangles.data(), charts.meshTriangles.size() * sizeof(uint32_t));
+            size_t triangles = 0;
+            for (uint32_t count : charts.meshTriangles)
+                triangles += count;
+            charts.uvs.resize(3 * triangles);
+            in.read((char*)charts.uvs.data(), charts.uvs.size() * sizeof(glm::vec2));
+        }
+        regions.resize(header[5]);
+        in.read((char*)regions.data(), regions.size() * sizeof(glm::vec4));
+        texels.resize((size_t)width * height);
+        in.read((char*)texels.data(), texels.size() * sizeof(uint32_t));
+        return (bool)in;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LIGHTMAPFILE_H
@@ -0,0 +1,160 @@
+#ifndef PROJECT_BASE_LIGHTMAPS_H
+#define PROJECT_BASE_LIGHTMAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/LightmapFile.h>
+#include <rg/ShackScene.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Baked lantern light for the static lit objects, as written by tools/lightmap_baker. The atlas is an
+// RGB9E5 texture; which part of it an object samples comes from its region, a texel of the regions buffer
+// texture picked with DrawRecord params.z. Lights the baker accounted for are marked Light::baked, and
+// lightmapped fragments skip them (LIGHTMAP in lighting.glsl).
+class Lightmaps {
+public:
+    static const GLuint TextureUnit = 8;
+    static const GLuint RegionUnit = 9;
+
+private:
+    GLuint m_Texture = 0;
+    GLuint m_RegionBuffer = 0;
+    GLuint m_RegionTexture = 0;
+    size_t m_RegionCount = 0;
+    glm::ivec2 m_Size = glm::ivec2(0);
+
+    // the file has to describe exactly the meshes that were loaded, or its UVs land on the wrong triangles
+    static bool matches(const LightmapFile& file, Model* const models[(int)ShackModel::Count]) {
+        if (file.regions.size() != ShackLitObjects().size())
+            return false;
+        for (const LightmapFile::ModelCharts& charts : file.models) {
+            if (charts.model >= (uint32_t)ShackModel::Count || !models[charts.model])
+                return false;
+            const Model& model = *models[charts.model];
+            if (charts.meshTriangles.size() != model.meshes.size())
+                return false;
+            for (size_t i = 0; i < model.meshes.size(); ++i)
+                if (charts.meshTriangles[i] != model.meshes[i].indices.size() / 3)
+                    return false;
+        }
+        return true;
+    }
+
+public:
+    // Loads the atlas and gives the models its lightmap UVs; models is indexed by ShackModel. Returns
+    // false, with nothing changed, when the file is missing, was baked from other meshes or the atlas can't
+    // be uploaded; the lanterns then have to be lit at runtime.
+    bool Load(const std::string& path, Model* const models[(int)ShackModel::Count]) {
+        LightmapFile file;
+        if (!file.Read(path))
+            return false;
+        if (!matches(file, models)) {
+            std::cout << path << " was baked from other models, run lightmap_baker again" << std::endl;
+            return false;
+        }
+        // the baker limits each model's layout, not the atlas of all of them
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        if (file.width > (uint32_t)maxSize || file.height > (uint32_t)maxSize) {
+            std::cout << path << ": the " << file.width << "x" << file.height << " atlas is larger than the "
+                      << maxSize << " texels this GL supports" << std::endl;
+            return false;
+        }
+        Destroy();
+
+        while (glGetError() != GL_NO_ERROR) {
+        }
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_2D, m_Texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB9_E5, (GLsizei)file.width, (GLsizei)file.height, 0, GL_RGB,
+                     GL_UNSIGNED_INT_5_9_9_9_REV, file.texels.data());
+        if (glGetError() != GL_NO_ERROR) {
+            std::cout << path << ": could not upload the " << file.width << "x" << file.height << " atlas"
+                      << std::endl;
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDeleteTextures(1, &m_Texture);
+            m_Texture = 0;
+            return false;
+        }
+        // no mips: charts are padded by one texel only, minification would bleed across them
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenBuffers(1, &m_RegionBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_RegionBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, file.regions.size() * sizeof(glm::vec4), file.regions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &m_RegionTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_RegionTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_RegionBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        // only now that the atlas is there, the meshes get the UVs to sample it
+        for (const LightmapFile::ModelCharts& charts : file.models) {
+            std::vector<Mesh>& meshes = models[charts.model]->meshes;
+            size_t first = 0;
+            for (size_t i = 0; i < meshes.size(); ++i) {
+                size_t corners = 3 * (size_t)charts.meshTriangles[i];
+                meshes[i].SetLightmapUVs(std::vector<glm::vec2>(charts.uvs.begin() + first,
+                                                                charts.uvs.begin() + first + corners));
+                first += corners;
+            }
+        }
+
+        m_RegionCount = file.regions.size();
+        m_Size = glm::ivec2((int)file.width, (int)file.height);
+        return true;
+    }
+
+    void Destroy() {
+        if (!m_Texture)
+            return;
+        glDeleteTextures(1, &m_Texture);
+        glDeleteTextures(1, &m_RegionTexture);
+        glDeleteBuffers(1, &m_RegionBuffer);
+        m_Texture = m_RegionTexture = m_RegionBuffer = 0;
+        m_RegionCount = 0;
+    }
+
+    bool Loaded() const {
+        return m_Texture != 0;
+    }
+
+    glm::ivec2 Size() const {
+        return m_Size;
+    }
+
+    // region of the given ShackLitObjects() entry, -1 while nothing is loaded
+    int Region(size_t litObject) const {
+        return Loaded() && litObject < m_RegionCount ? (int)litObject : -1;
+    }
+
+    void Bind() const {
+        glActiveTexture(GL_TEXTURE0 + TextureUnit);
+        glBindTexture(GL_TEXTURE_2D, m_Texture);
+        glActiveTexture(GL_TEXTURE0 + RegionUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_RegionTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("lightmap", TextureUnit);
+        shader.setInt("lightmapRegions", RegionUnit);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LIGHTMAPS_H
@@ -0,0 +1,232 @@
+#ifndef PROJECT_BASE_PROFILER_H
+#define PROJECT_BASE_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+struct PassTiming {
+    std::string name;
+    double cpuMs = 0.0;  // smoothed
+    double gpuMs = 0.0;  // smoothed, a few frames late
+    double cpuTotalMs = 0.0;
+    double gpuTotalMs = 0.0;
+    unsigned cpuSamples = 0;
+    unsigned gpuSamples = 0;
+    // draws or other work items the pass reported, for per-item CPU cost
+    unsigned items = 0;
+    double itemsTotal = 0.0;
+
+    double CpuMicrosecondsPerItem() const {
+        return itemsTotal > 0.0 ? cpuTotalMs * 1000.0 / itemsTotal : 0.0;
+    }
+};
+
+// CPU and GPU time per named pass. GPU time comes from GL_TIMESTAMP query pairs, so scopes may nest,
+// and results are only collected once they are available, a few frames later, so reading them never
+// stalls the pipeline.
+class Profiler {
+    static const int Latency = 4;
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Scope {
+        PassTiming timing;
+        GLuint queries[Latency][2] = {};
+        bool pending[Latency] = {};
+        Clock::time_point cpuStart;
+        int usedInFrame = -1;
+    };
+
+    std::vector<Scope> m_Scopes;
+    std::vector<int> m_Stack;
+    int m_Frame = 0;
+    bool m_Enabled = true;
+
+    int find(const char* name) {
+        for (size_t i = 0; i < m_Scopes.size(); ++i) {
+            if (m_Scopes[i].timing.name == name)
+                return (int)i;
+        }
+        m_Scopes.emplace_back();
+        Scope& scope = m_Scopes.back();
+        scope.timing.name = name;
+        glGenQueries(Latency * 2, &scope.queries[0][0]);
+        return (int)m_Scopes.size() - 1;
+    }
+
+    static void accumulate(double& smoothed, double& total, unsigned& samples, double value) {
+        smoothed = samples == 0 ? value : smoothed * 0.9 + value * 0.1;
+        total += value;
+        ++samples;
+    }
+
+public:
+    // must run while the GL context is still alive
+    void Destroy() {
+        for (Scope& scope : m_Scopes)
+            glDeleteQueries(Latency * 2, &scope.queries[0][0]);
+        m_Scopes.clear();
+    }
+
+    void SetEnabled(bool enabled) {
+        m_Enabled = enabled;
+    }
+
+    // collects the finished queries of older frames
+    void BeginFrame() {
+        ++m_Frame;
+        int slot = m_Frame % Latency;
+        for (Scope& scope : m_Scopes) {
+            if (!scope.pending[slot])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(scope.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue; // still in flight, the slot gets reused anyway
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(scope.queries[slot][0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(scope.queries[slot][1], GL_QUERY_RESULT, &end);
+            accumulate(scope.timing.gpuMs, scope.timing.gpuTotalMs, scope.timing.gpuSamples, (double)(end - start) / 1e6);
+            scope.pending[slot] = false;
+        }
+    }
+
+    void Begin(const char* name) {
+        if (!m_Enabled)
+            return;
+        int index = find(name);
+        Scope& scope = m_Scopes[index];
+        int slot = m_Frame % Latency;
+        glQueryCounter(scope.queries[slot][0], GL_TIMESTAMP);
+        scope.cpuStart = Clock::now();
+        scope.usedInFrame = m_Frame;
+        scope.timing.items = 0;
+        m_Stack.push_back(index);
+    }
+
+    // adds count work items to the innermost open scope
+    void CountItems(unsigned count) {
+        if (!m_Enabled || m_Stack.empty())
+            return;
+        m_Scopes[m_Stack.back()].timing.items += count;
+    }
+
+    void End() {
+        if (!m_Enabled || m_Stack.empty())
+            return;
+        Scope& scope = m_Scopes[m_Stack.back()];
+        m_Stack.pop_back();
+        int slot = m_Frame % Latency;
+        glQueryCounter(scope.queries[slot][1], GL_TIMESTAMP);
+        scope.pending[slot] = true;
+        double cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - scope.cpuStart).count();
+        accumulate(scope.timing.cpuMs, scope.timing.cpuTotalMs, scope.timing.cpuSamples, cpuMs);
+        scope.timing.itemsTotal += scope.timing.items;
+    }
+
+    // passes that ran during the last few frames, in first-use order
+    std::vector<const PassTiming*> Timings() const {
+        std::vector<const PassTiming*> timings;
+        for (const Scope& scope : m_Scopes) {
+            if (m_Frame - scope.usedInFrame < Latency * 4)
+                timings.push_back(&scope.timing);
+        }
+        return timings;
+    }
+
+    void ResetTotals() {
+        for (Scope& scope : m_Scopes) {
+            scope.timing.cpuTotalMs = scope.timing.gpuTotalMs = 0.0;
+            scope.timing.cpuSamples = scope.timing.gpuSamples = 0;
+            scope.timing.itemsTotal = 0.0;
+        }
+    }
+
+    // average per frame since the last ResetTotals
+    void PrintTotals(const std::string& title, std::ostream& out = std::cout) const {
+        out << "== " << title << "\n";
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-28s %10s %10s %12s\n", "pass", "cpu ms", "gpu ms", "cpu us/item");
+        out << line;
+        for (const Scope& scope : m_Scopes) {
+            const PassTiming& t = scope.timing;
+            if (t.cpuSamples == 0)
+                continue;
+            std::snprintf(line, sizeof(line), "%-28s %10.3f %10.3f %12.3f\n", t.name.c_str(), t.cpuTotalMs / t.cpuSamples,
+                          t.gpuSamples ? t.gpuTotalMs / t.gpuSamples : 0.0, t.CpuMicrosecondsPerItem());
+            out << line;
+        }
+        out << std::flush;
+    }
+};
+
+// RAII helper for a profiler scope
+class ProfileScope {
+    Profiler& m_Profiler;
+public:
+    ProfileScope(Profiler& profiler, const char* name) : m_Profiler(profiler) {
+        m_Profiler.Begin(name);
+    }
+    ~ProfileScope() {
+        m_Profiler.End();
+    }
+};
+
+// Runs every registered configuration for a fixed number of frames and prints the profiler totals
+// of each one, used by the --bench command line mode.
+class Benchmark {
+    struct Config {
+        std::string name;
+        std::function<void()> apply;
+    };
+    std::vector<Config> m_Configs;
+    size_t m_Current = 0;
+    int m_Frame = 0;
+    int m_WarmupFrames;
+    int m_Frames;
+    std::string m_Label;
+
+public:
+    explicit Benchmark(int frames = 0, int warmupFrames = 30) : m_WarmupFrames(warmupFrames), m_Frames(frames) {}
+
+    bool Enabled() const {
+        return m_Frames > 0;
+    }
+
+    void SetLabel(const std::string& label) {
+        m_Label = label;
+    }
+
+    void AddConfig(const std::string& name, std::function<void()> apply) {
+        m_Configs.push_back(Config{name, std::move(apply)});
+    }
+
+    // call once per frame before rendering, returns false once every configuration was measured
+    bool Step(Profiler& profiler) {
+        if (m_Current >= m_Configs.size())
+            return false;
+        if (m_Frame == 0)
+            m_Configs[m_Current].apply();
+        if (m_Frame == m_WarmupFrames)
+            profiler.ResetTotals();
+        if (m_Frame == m_WarmupFrames + m_Frames) {
+            profiler.PrintTotals(m_Label + m_Configs[m_Current].name);
+            ++m_Current;
+            m_Frame = 0;
+            return Step(profiler);
+        }
+        ++m_Frame;
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_PROFILER_H
@@ -0,0 +1,151 @@
+#ifndef PROJECT_BASE_PROGRAMCACHE_H
+#define PROJECT_BASE_PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <rg/GLExt.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// FNV-1a, 64 bit
+inline uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Linked program binaries kept in one file between runs. Entries are keyed by a hash of the
+// preprocessed sources, which include the defines, and of the GL vendor, renderer and version strings,
+// so a driver update or a shader edit simply misses. The driver may still reject a binary, in which
+// case Load returns false and the caller compiles from source and stores the new binary.
+class ProgramCache {
+    static const uint32_t Magic = 0x43504752; // "RGPC"
+    static const uint32_t Version = 1;
+
+    struct Entry {
+        GLenum format = 0;
+        std::vector<char> binary;
+    };
+
+    std::unordered_map<uint64_t, Entry> m_Entries;
+    std::string m_Path;
+    std::string m_Driver;
+    bool m_Dirty = false;
+
+public:
+    // reads the cache file, a missing or outdated file just starts an empty cache
+    void Open(const std::string& path) {
+        m_Path = path;
+        m_Entries.clear();
+        m_Dirty = false;
+        if (!glext().programBinary)
+            return;
+        m_Driver = std::string((const char*)glGetString(GL_VENDOR)) + "\n" + (const char*)glGetString(GL_RENDERER) +
+                   "\n" + (const char*)glGetString(GL_VERSION) + "\n";
+
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        const std::streamoff fileSize = in ? (std::streamoff)in.tellg() : 0;
+        in.seekg(0);
+        uint32_t header[3] = {};
+        if (!in.read((char*)header, sizeof(header)) || header[0] != Magic || header[1] != Version)
+            return;
+        for (uint32_t i = 0; i < header[2]; ++i) {
+            uint64_t key;
+            uint32_t format, size;
+            in.read((char*)&key, sizeof(key));
+            in.read((char*)&format, sizeof(format));
+            in.read((char*)&size, sizeof(size));
+            // a truncated or corrupt file: its sizes can't be trusted, so none of it is used
+            if (!in || (std::streamoff)size > fileSize - (std::streamoff)in.tellg()) {
+                std::cout << "Shader cache " << path << " is corrupt, starting an empty one" << std::endl;
+                m_Entries.clear();
+                return;
+            }
+            Entry entry;
+            entry.format = format;
+            entry.binary.resize(size);
+            in.read(entry.binary.data(), size);
+            m_Entries[key] = std::move(entry);
+        }
+    }
+
+    // writes the cache back if anything was added or dropped
+    void Save() {
+        if (!m_Dirty || m_Path.empty())
+            return;
+        std::ofstream out(m_Path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "Could not write the shader cache " << m_Path << std::endl;
+            return;
+        }
+        uint32_t header[3] = {Magic, Version, (uint32_t)m_Entries.size()};
+        out.write((const char*)header, sizeof(header));
+        for (const auto& entry : m_Entries) {
+            uint32_t format = entry.second.format, size = (uint32_t)entry.second.binary.size();
+            out.write((const char*)&entry.first, sizeof(entry.first));
+            out.write((const char*)&format, sizeof(format));
+            out.write((const char*)&size, sizeof(size));
+            out.write(entry.second.binary.data(), size);
+        }
+        m_Dirty = false;
+    }
+
+    bool Enabled() const {
+        return glext().programBinary && !m_Path.empty();
+    }
+
+    uint64_t Key(const std::string& sources) const {
+        return hashString(sources, hashString(m_Driver));
+    }
+
+    // call before linking a program that is going to be stored
+    static void MarkRetrievable(GLuint program) {
+        if (glext().programBinary)
+            glext().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // loads the cached binary into program, false on a miss or when the driver rejects it
+    bool Load(uint64_t key, GLuint program) {
+        if (!Enabled())
+            return false;
+        auto it = m_Entries.find(key);
+        if (it == m_Entries.end())
+            return false;
+        glext().ProgramBinary(program, it->second.format, it->second.binary.data(), (GLsizei)it->second.binary.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            m_Entries.erase(it);
+            m_Dirty = true;
+        }
+        return success == GL_TRUE;
+    }
+
+    // keeps the binary of a freshly linked program
+    void Store(uint64_t key, GLuint program) {
+        if (!Enabled())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Entry entry;
+        entry.binary.resize((size_t)length);
+        glext().GetProgramBinary(program, length, nullptr, &entry.format, entry.binary.data());
+        m_Entries[key] = std::move(entry);
+        m_Dirty = true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_PROGRAMCACHE_H
@@ -0,0 +1,321 @@
+#ifndef PROJECT_BASE_RENDERGRAPH_H
+#define PROJECT_BASE_RENDERGRAPH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/Profiler.h>
+#include <rg/RenderTargetPool.h>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// a resource of the frame's render graph, see RenderGraph::Create and Import
+typedef int RenderResource;
+
+struct RenderGraphStats {
+    unsigned passCount = 0;      // declared this frame
+    unsigned culledCount = 0;    // declared, but nothing needed what they write
+    unsigned clearCount = 0;     // targets cleared before their first writer
+    unsigned transientCount = 0; // targets taken from the pool
+};
+
+// The frame as passes that declare the resources they read and write, rebuilt every frame. Execute then
+//  - culls the passes nothing needs: a pass runs if it writes the frame's output or something a later,
+//    running pass reads, or if it was declared with SideEffect,
+//  - runs the others in the order they were declared, which is the order their dependencies allow: a
+//    pass sees what the passes declared before it wrote,
+//  - acquires each transient target from the pool just before its first user runs and releases it after
+//    its last one, so targets with the same descriptor and disjoint lifetimes share a texture,
+//  - binds the framebuffer of the pass's Write and Overwrite targets with their viewport, and clears a
+//    transient target only before its first Write: targets whose first writer Overwrites them and
+//    imported ones like the default framebuffer are never cleared,
+//  - wraps each pass in a profiler scope of its name, which gives the per-pass timing table.
+//
+// Write is for draws that keep what is there, depth tested geometry say; Overwrite for passes that cover
+// every texel, full screen quads and blits; Store for writes outside the bound framebuffer, image stores,
+// framebuffers the pass binds itself or state imported from outside the graph, like shadow maps.
+class RenderGraph {
+    enum Access { ReadAccess, WriteAccess, OverwriteAccess, StoreAccess };
+
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        glm::vec4 clearColor;
+        GLuint texture = 0;
+        bool imported = false;
+        bool output = false;
+        // first and last running pass that uses it
+        int firstPass = -1, lastPass = -1;
+    };
+
+    struct Use {
+        RenderResource resource;
+        Access access;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Use> uses;
+        std::function<void()> execute;
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    GLuint m_Framebuffer = 0;
+    RenderGraphStats m_Stats;
+    bool m_Reported = false;
+
+    static bool attached(Access access) {
+        return access == WriteAccess || access == OverwriteAccess;
+    }
+
+    // walks back from the outputs, keeping the resources whose current contents a running pass still needs
+    void cull() {
+        std::vector<bool> live(m_Resources.size());
+        for (size_t i = 0; i < m_Resources.size(); ++i)
+            live[i] = m_Resources[i].output;
+        for (size_t i = m_Passes.size(); i-- > 0;) {
+            Pass& pass = m_Passes[i];
+            bool needed = pass.sideEffect;
+            for (const Use& use : pass.uses)
+                needed = needed || (use.access != ReadAccess && live[use.resource]);
+            pass.culled = !needed;
+            if (!needed)
+                continue;
+            // what an Overwrite replaces is dead, unless the pass reads it too
+            for (const Use& use : pass.uses) {
+                if (use.access == OverwriteAccess)
+                    live[use.resource] = false;
+            }
+            for (const Use& use : pass.uses) {
+                if (use.access != OverwriteAccess)
+                    live[use.resource] = true;
+            }
+        }
+    }
+
+    void computeLifetimes() {
+        for (Resource& resource : m_Resources)
+            resource.firstPass = resource.lastPass = -1;
+        for (size_t i = 0; i < m_Passes.size(); ++i) {
+            const Pass& pass = m_Passes[i];
+            if (pass.culled)
+                continue;
+            for (const Use& use : pass.uses) {
+                Resource& resource = m_Resources[use.resource];
+                if (resource.firstPass < 0) {
+                    resource.firstPass = (int)i;
+                    if (use.access == ReadAccess && !resource.imported && !m_Reported) {
+                        std::cout << "Render graph: pass " << pass.name << " reads " << resource.name
+                                  << " before any pass wrote it" << std::endl;
+                        m_Reported = true;
+                    }
+                }
+                resource.lastPass = (int)i;
+            }
+        }
+    }
+
+    // the framebuffer of the pass's attachments, cleared where this is their first writer
+    void bindAttachments(RenderTargetPool& pool, const Pass& pass, int index) {
+        std::vector<GLuint> colors;
+        GLuint depth = 0;
+        bool backbuffer = false;
+        const RenderTargetDesc* size = nullptr;
+        for (const Use& use : pass.uses) {
+            if (!attached(use.access))
+                continue;
+            const Resource& resource = m_Resources[use.resource];
+            if (resource.imported && !resource.texture)
+                backbuffer = true;
+            else if (RenderTargetPool::IsDepth(resource.desc.format))
+                depth = resource.texture;
+            else
+                colors.push_back(resource.texture);
+            size = &resource.desc;
+        }
+        m_Framebuffer = 0;
+        if (!size)
+            return;
+        m_Framebuffer = backbuffer ? 0 : pool.Framebuffer(colors, depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glViewport(0, 0, size->width, size->height);
+
+        GLint drawBuffer = 0;
+        for (const Use& use : pass.uses) {
+            if (!attached(use.access))
+                continue;
+            const Resource& resource = m_Resources[use.resource];
+            bool depthTarget = RenderTargetPool::IsDepth(resource.desc.format);
+            if (use.access == WriteAccess && !resource.imported && resource.firstPass == index) {
+                if (depthTarget) {
+                    const GLfloat far = 1.0f;
+                    glDepthMask(GL_TRUE);
+                    glClearBufferfv(GL_DEPTH, 0, &far);
+                } else {
+                    glClearBufferfv(GL_COLOR, drawBuffer, &resource.clearColor[0]);
+                }
+                ++m_Stats.clearCount;
+            }
+            if (!depthTarget)
+                ++drawBuffer;
+        }
+    }
+
+public:
+    class PassBuilder {
+        RenderGraph& m_Graph;
+        size_t m_Pass;
+
+        PassBuilder& use(RenderResource resource, Access access) {
+            m_Graph.m_Passes[m_Pass].uses.push_back({resource, access});
+            return *this;
+        }
+
+    public:
+        PassBuilder(RenderGraph& graph, size_t pass) : m_Graph(graph), m_Pass(pass) {}
+
+        PassBuilder& Read(RenderResource resource) {
+            return use(resource, ReadAccess);
+        }
+
+        PassBuilder& Read(const std::vector<RenderResource>& resources) {
+            for (RenderResource resource : resources)
+                use(resource, ReadAccess);
+            return *this;
+        }
+
+        PassBuilder& Write(RenderResource resource) {
+            return use(resource, WriteAccess);
+        }
+
+        PassBuilder& Overwrite(RenderResource resource) {
+            return use(resource, OverwriteAccess);
+        }
+
+        PassBuilder& Store(RenderResource resource) {
+            return use(resource, StoreAccess);
+        }
+
+        // runs even if nothing reads what it writes
+        PassBuilder& SideEffect() {
+            m_Graph.m_Passes[m_Pass].sideEffect = true;
+            return *this;
+        }
+
+        void Execute(std::function<void()> execute) {
+            m_Graph.m_Passes[m_Pass].execute = std::move(execute);
+        }
+    };
+
+    // forgets the last frame's passes and resources
+    void Reset() {
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Framebuffer = 0;
+    }
+
+    // a target the graph takes from the pool for the passes that use it; clearColor is what it holds
+    // before its first Write, depth targets clear to 1
+    RenderResource Create(const std::string& name, const RenderTargetDesc& desc,
+                          const glm::vec4& clearColor = glm::vec4(0.0f)) {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        resource.clearColor = clearColor;
+        m_Resources.push_back(resource);
+        return (RenderResource)m_Resources.size() - 1;
+    }
+
+    // A texture owned outside the graph, never cleared or released by it; texture 0 attaches the default
+    // framebuffer. Without a texture, state kept outside the graph for passes to Store into and Read.
+    RenderResource Import(const std::string& name, GLuint texture = 0,
+                          const RenderTargetDesc& desc = RenderTargetDesc()) {
+        RenderResource resource = Create(name, desc);
+        m_Resources[resource].texture = texture;
+        m_Resources[resource].imported = true;
+        return resource;
+    }
+
+    RenderResource ImportBackbuffer(int width, int height) {
+        return Import("backbuffer", 0, RenderTargetDesc(width, height, GL_RGBA8));
+    }
+
+    // what the frame is for; the passes that lead up to it are the ones that run
+    void Output(RenderResource resource) {
+        m_Resources[resource].output = true;
+    }
+
+    PassBuilder AddPass(const std::string& name) {
+        m_Passes.emplace_back();
+        m_Passes.back().name = name;
+        return PassBuilder(*this, m_Passes.size() - 1);
+    }
+
+    // Culls, then runs the passes. Leaves the default framebuffer bound; the transient targets are all
+    // released again, EndFrame of the pool can follow.
+    void Execute(RenderTargetPool& pool, Profiler& profiler) {
+        m_Stats = RenderGraphStats();
+        m_Stats.passCount = (unsigned)m_Passes.size();
+        cull();
+        computeLifetimes();
+        for (size_t i = 0; i < m_Passes.size(); ++i) {
+            Pass& pass = m_Passes[i];
+            if (pass.culled) {
+                ++m_Stats.culledCount;
+                continue;
+            }
+            for (const Use& use : pass.uses) {
+                Resource& resource = m_Resources[use.resource];
+                if (!resource.imported && !resource.texture) {
+                    resource.texture = pool.Acquire(resource.desc);
+                    ++m_Stats.transientCount;
+                }
+            }
+            profiler.Begin(pass.name.c_str());
+            bindAttachments(pool, pass, (int)i);
+            if (pass.execute)
+                pass.execute();
+            profiler.End();
+            for (const Use& use : pass.uses) {
+                Resource& resource = m_Resources[use.resource];
+                if (!resource.imported && resource.lastPass == (int)i && resource.texture) {
+                    pool.Release(resource.texture);
+                    resource.texture = 0;
+                }
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_Framebuffer = 0;
+    }
+
+    // while a pass runs: the texture behind one of its resources
+    GLuint Texture(RenderResource resource) const {
+        return m_Resources[resource].texture;
+    }
+
+    const RenderTargetDesc& Desc(RenderResource resource) const {
+        return m_Resources[resource].desc;
+    }
+
+    // while a pass runs: the framebuffer the graph bound for it, 0 for the default one or none
+    GLuint Framebuffer() const {
+        return m_Framebuffer;
+    }
+
+    RenderGraphStats Stats() const {
+        return m_Stats;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERGRAPH_H
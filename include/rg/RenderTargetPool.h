@@ -0,0 +1,249 @@
+#ifndef PROJECT_BASE_RENDERTARGETPOOL_H
+#define PROJECT_BASE_RENDERTARGETPOOL_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace rg {
+
+// What a render target is made of. format is a sized internal format; samples above 1 make a
+// multisampled texture.
+struct RenderTargetDesc {
+    int width = 0, height = 0;
+    GLenum format = GL_RGBA8;
+    int samples = 1;
+
+    RenderTargetDesc() = default;
+    RenderTargetDesc(int width, int height, GLenum format, int samples = 1)
+            : width(width), height(height), format(format), samples(samples) {}
+
+    bool operator==(const RenderTargetDesc& other) const {
+        return width == other.width && height == other.height && format == other.format && samples == other.samples;
+    }
+};
+
+struct RenderTargetStats {
+    unsigned textureCount = 0;
+    size_t totalBytes = 0;     // every texture the pool holds
+    size_t framePeakBytes = 0; // the most acquired at once during the last frame
+};
+
+// Screen sized textures handed out by descriptor. A pass acquires its targets when it starts writing
+// them and releases them after their last reader, and the next Acquire of the same descriptor in the
+// frame gets the released texture back: targets whose lifetimes don't overlap share one texture. Targets
+// nobody acquired for a few frames are deleted, so after a resize the old sizes go away by themselves
+// and no owner has to recreate anything. Targets kept across frames are simply never released.
+//
+// Framebuffers are cached per set of attachments and deleted along with their textures.
+class RenderTargetPool {
+    // frames a released target is kept for an Acquire before it is deleted
+    static const unsigned MaxIdleFrames = 3;
+
+    struct Target {
+        RenderTargetDesc desc;
+        GLuint texture = 0;
+        bool inUse = false;
+        unsigned lastUsedFrame = 0;
+    };
+
+    std::vector<Target> m_Targets;
+    // colour attachments then depth, 0 for none
+    std::map<std::vector<GLuint>, GLuint> m_Framebuffers;
+    unsigned m_Frame = 0;
+    size_t m_Bytes = 0;
+    size_t m_InUseBytes = 0, m_PeakInUseBytes = 0, m_FramePeakBytes = 0;
+
+    const Target* find(GLuint texture) const {
+        for (const Target& target : m_Targets) {
+            if (target.texture == texture)
+                return &target;
+        }
+        return nullptr;
+    }
+
+    GLenum textureTarget(GLuint texture) const {
+        const Target* target = find(texture);
+        return target && target->desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    }
+
+    void markInUse(Target& target) {
+        target.inUse = true;
+        target.lastUsedFrame = m_Frame;
+        m_InUseBytes += Bytes(target.desc);
+        m_PeakInUseBytes = m_InUseBytes > m_PeakInUseBytes ? m_InUseBytes : m_PeakInUseBytes;
+    }
+
+    static GLuint createTexture(const RenderTargetDesc& desc) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        if (desc.samples > 1) {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.width, desc.height,
+                                    GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+            return texture;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (desc.format == GL_DEPTH24_STENCIL8)
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, GL_DEPTH_STENCIL,
+                         GL_UNSIGNED_INT_24_8, nullptr);
+        else if (IsDepth(desc.format))
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+                         nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        // colour targets are read with bilinear taps by the post passes, depth is read per texel
+        GLint filter = IsDepth(desc.format) ? GL_NEAREST : GL_LINEAR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void deleteFramebuffersWith(GLuint texture) {
+        for (auto it = m_Framebuffers.begin(); it != m_Framebuffers.end();) {
+            bool attached = false;
+            for (GLuint attachment : it->first)
+                attached = attached || attachment == texture;
+            if (attached) {
+                glDeleteFramebuffers(1, &it->second);
+                it = m_Framebuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+public:
+    static bool IsDepth(GLenum format) {
+        return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+               format == GL_DEPTH24_STENCIL8;
+    }
+
+    // bytes per texel of the formats the renderer uses, depth as the drivers usually store it
+    static size_t BytesPerTexel(GLenum format) {
+        switch (format) {
+            case GL_R8: return 1;
+            case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+            case GL_RGBA16F: case GL_RG32F: return 8;
+            case GL_RGBA32F: return 16;
+            default: return 4;
+        }
+    }
+
+    static size_t Bytes(const RenderTargetDesc& desc) {
+        return (size_t)desc.width * (size_t)desc.height * (size_t)(desc.samples > 1 ? desc.samples : 1) *
+               BytesPerTexel(desc.format);
+    }
+
+    // a texture matching desc, allocated only if no released one is free
+    GLuint Acquire(const RenderTargetDesc& desc) {
+        for (Target& target : m_Targets) {
+            if (!target.inUse && target.desc == desc) {
+                markInUse(target);
+                return target.texture;
+            }
+        }
+        Target target;
+        target.desc = desc;
+        target.texture = createTexture(desc);
+        m_Bytes += Bytes(desc);
+        markInUse(target);
+        m_Targets.push_back(target);
+        return target.texture;
+    }
+
+    // hands the texture back for later Acquires; its contents stay until the next owner writes them
+    void Release(GLuint texture) {
+        for (Target& target : m_Targets) {
+            if (target.texture == texture && target.inUse) {
+                target.inUse = false;
+                m_InUseBytes -= Bytes(target.desc);
+                return;
+            }
+        }
+    }
+
+    // The framebuffer with these colour attachments, in draw buffer order, and this depth attachment (0
+    // for none); created on first use.
+    GLuint Framebuffer(const std::vector<GLuint>& colors, GLuint depth = 0) {
+        std::vector<GLuint> key(colors);
+        key.push_back(depth);
+        auto it = m_Framebuffers.find(key);
+        if (it != m_Framebuffers.end())
+            return it->second;
+
+        GLuint fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        std::vector<GLenum> drawBuffers;
+        for (GLuint color : colors) {
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(color), color, 0);
+            drawBuffers.push_back(attachment);
+        }
+        if (depth) {
+            const Target* target = find(depth);
+            GLenum attachment = target && target->desc.format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT
+                                                                                      : GL_DEPTH_ATTACHMENT;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(depth), depth, 0);
+        }
+        if (drawBuffers.empty()) {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        } else {
+            glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Render target framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_Framebuffers[key] = fbo;
+        return fbo;
+    }
+
+    // once per frame, after the last target was released: deletes what sat unused for too long
+    void EndFrame() {
+        for (size_t i = 0; i < m_Targets.size();) {
+            Target& target = m_Targets[i];
+            if (!target.inUse && m_Frame - target.lastUsedFrame >= MaxIdleFrames) {
+                deleteFramebuffersWith(target.texture);
+                glDeleteTextures(1, &target.texture);
+                m_Bytes -= Bytes(target.desc);
+                m_Targets.erase(m_Targets.begin() + (long)i);
+            } else {
+                ++i;
+            }
+        }
+        m_FramePeakBytes = m_PeakInUseBytes;
+        m_PeakInUseBytes = m_InUseBytes;
+        ++m_Frame;
+    }
+
+    void Destroy() {
+        for (auto& framebuffer : m_Framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.second);
+        m_Framebuffers.clear();
+        for (Target& target : m_Targets)
+            glDeleteTextures(1, &target.texture);
+        m_Targets.clear();
+        m_Bytes = m_InUseBytes = m_PeakInUseBytes = m_FramePeakBytes = 0;
+    }
+
+    RenderTargetStats Stats() const {
+        RenderTargetStats stats;
+        stats.textureCount = (unsigned)m_Targets.size();
+        stats.totalBytes = m_Bytes;
+        stats.framePeakBytes = m_FramePeakBytes;
+        return stats;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERTARGETPOOL_H
@@ -0,0 +1,428 @@
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/JobSystem.h>
+#include <rg/ShaderLibrary.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace rg {
+
+// which shader an object is drawn with; it is the most significant part of the sort key
+enum class ShadingPass : uint8_t {
+    Lit = 0,
+    LightSource = 1
+};
+
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann plane extraction, planes point inwards
+    static Frustum FromMatrix(const glm::mat4& m) {
+        Frustum f;
+        for (int i = 0; i < 3; ++i) {
+            glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+            glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+            f.planes[2 * i] = w + row;
+            f.planes[2 * i + 1] = w - row;
+        }
+        for (glm::vec4& plane : f.planes)
+            plane = plane / glm::length(glm::vec3(plane));
+        return f;
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Inverse transpose of the upper 3x3 of a transform, for transforming normals. Rotations with a uniform
+// scale, which is all the scene has, skip the inverse: the result is the matrix itself divided by the
+// squared scale.
+inline glm::mat3 ComputeNormalMatrix(const glm::mat4& transform) {
+    glm::mat3 m = glm::mat3(transform);
+    float x = glm::dot(m[0], m[0]), y = glm::dot(m[1], m[1]), z = glm::dot(m[2], m[2]);
+    float tolerance = 1e-4f * glm::max(x, glm::max(y, z));
+    bool uniformScale = glm::abs(x - y) <= tolerance && glm::abs(x - z) <= tolerance;
+    bool orthogonal = glm::abs(glm::dot(m[0], m[1])) <= tolerance && glm::abs(glm::dot(m[0], m[2])) <= tolerance &&
+                      glm::abs(glm::dot(m[1], m[2])) <= tolerance;
+    if (uniformScale && orthogonal && x > 0.0f)
+        return m * (1.0f / x);
+    return glm::transpose(glm::inverse(m));
+}
+
+// the shader features a model's materials need, see ShaderFeature
+inline uint32_t MaterialFeatures(const Model& model) {
+    return (model.normalMapped ? ShaderFeature::NormalMapping : 0u) | (model.alphaTested ? ShaderFeature::AlphaTest : 0u);
+}
+
+struct ModelLod {
+    Model* model = nullptr;
+    float maxDistance = 1e30f;
+    uint32_t modelId = 0;
+    uint32_t features = 0;
+};
+
+struct SceneObject {
+    static const int MaxLods = 4;
+    ModelLod lods[MaxLods];
+    int lodCount = 0;
+
+    ShadingPass pass = ShadingPass::Lit;
+    bool cullFaces = true;
+    float shininess = 32.0f;
+    // region of the baked lightmap, see rg::Lightmaps; only the finest LOD has lightmap UVs
+    int lightmapRegion = -1;
+
+    // same parameters renderModel used to take
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float angle = 0.0f;
+    bool rotate = false;
+
+    // optional, replaces the static transform for moving objects
+    std::function<glm::mat4(float time)> animation;
+
+    glm::mat4 transform = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f);
+    bool transformDirty = true;
+    // the transform before the last PrepareFrame changed it, for motion vectors; moved tells whether it did
+    glm::mat4 previousTransform = glm::mat4(1.0f);
+    bool moved = false;
+
+    static SceneObject Static(Model& model, ShadingPass pass, const glm::vec3& position, const glm::vec3& scale,
+                              const glm::vec3& rotationAxis, float angle, bool rotate = false) {
+        SceneObject object;
+        object.lods[0].model = &model;
+        object.lodCount = 1;
+        object.pass = pass;
+        object.position = position;
+        object.scale = scale;
+        object.rotationAxis = rotationAxis;
+        object.angle = angle;
+        object.rotate = rotate;
+        return object;
+    }
+
+    static SceneObject Animated(Model& model, ShadingPass pass, std::function<glm::mat4(float)> animation) {
+        SceneObject object;
+        object.lods[0].model = &model;
+        object.lodCount = 1;
+        object.pass = pass;
+        object.animation = std::move(animation);
+        return object;
+    }
+
+    void AddLod(Model& model, float maxDistance) {
+        if (lodCount < MaxLods) {
+            lods[lodCount].model = &model;
+            lods[lodCount].maxDistance = maxDistance;
+            ++lodCount;
+        }
+    }
+
+    glm::mat4 ComputeTransform() const {
+        glm::mat4 modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, position);
+        modelMat = glm::scale(modelMat, scale);
+        if (rotate)
+            modelMat = glm::rotate(modelMat, angle, rotationAxis);
+        return modelMat;
+    }
+};
+
+struct DrawItem {
+    Model* model;
+    glm::mat4 transform;
+    glm::mat3 normalMatrix;
+    // last frame's transform, only meaningful if moving
+    glm::mat4 previousTransform;
+    bool moving;
+    uint64_t sortKey;
+    uint32_t objectIndex;
+    uint32_t materialIndex;
+    float shininess;
+    ShadingPass pass;
+    uint32_t features;
+    bool cullFaces;
+    int lightmapRegion;
+};
+
+// What the shadow passes draw, gathered from every object rather than from the camera's draw list.
+struct ShadowCaster {
+    Model* model;
+    glm::mat4 transform;
+    glm::vec3 center;
+    float radius;
+    bool cullFaces;
+    ShadingPass pass;
+};
+
+struct FramePrepStats {
+    double prepMs = 0.0;
+    unsigned objectCount = 0;
+    unsigned visibleCount = 0;
+    unsigned threadCount = 1;
+};
+
+class Scene {
+    std::vector<SceneObject> m_Objects;
+    std::vector<Model*> m_Models;
+    std::vector<std::vector<DrawItem>> m_ChunkItems;
+    std::vector<DrawItem> m_DrawList, m_MergeScratch;
+    std::vector<size_t> m_Runs;
+    FramePrepStats m_Stats;
+    glm::vec3 m_StaticMin = glm::vec3(0.0f), m_StaticMax = glm::vec3(0.0f);
+    bool m_StaticBoundsDirty = true;
+    uint32_t m_StaticRevision = 0;
+
+    uint32_t modelId(Model* model) {
+        auto it = std::find(m_Models.begin(), m_Models.end(), model);
+        if (it != m_Models.end())
+            return (uint32_t)(it - m_Models.begin());
+        m_Models.push_back(model);
+        return (uint32_t)(m_Models.size() - 1);
+    }
+
+    // world space bounding sphere around the finest LOD
+    static void boundingSphere(const SceneObject& object, glm::vec3& center, float& radius) {
+        const Model& bounds = *object.lods[0].model;
+        glm::vec3 localCenter = (bounds.boundsMin + bounds.boundsMax) * 0.5f;
+        center = glm::vec3(object.transform * glm::vec4(localCenter, 1.0f));
+        float maxScale = glm::max(glm::length(glm::vec3(object.transform[0])),
+                                  glm::max(glm::length(glm::vec3(object.transform[1])),
+                                           glm::length(glm::vec3(object.transform[2]))));
+        radius = glm::length(bounds.boundsMax - bounds.boundsMin) * 0.5f * maxScale;
+    }
+
+    void updateStaticBounds() {
+        bool first = true;
+        for (const SceneObject& object : m_Objects) {
+            if (object.lodCount == 0 || object.animation)
+                continue;
+            glm::vec3 center;
+            float radius;
+            boundingSphere(object, center, radius);
+            glm::vec3 objectMin = center - glm::vec3(radius), objectMax = center + glm::vec3(radius);
+            m_StaticMin = first ? objectMin : glm::min(m_StaticMin, objectMin);
+            m_StaticMax = first ? objectMax : glm::max(m_StaticMax, objectMax);
+            first = false;
+        }
+        m_StaticBoundsDirty = false;
+    }
+
+    // pass | shader features | face culling | model | depth, so that state changes are grouped and each
+    // group is drawn front to back
+    static uint64_t makeSortKey(ShadingPass pass, uint32_t features, bool cullFaces, uint32_t model, float viewDistance,
+                                float farPlane) {
+        uint64_t depth = (uint64_t)(glm::clamp(viewDistance / farPlane, 0.0f, 1.0f) * 16777215.0f);
+        return ((uint64_t)pass << 62) | ((uint64_t)(features & 0xf) << 58) | ((uint64_t)(cullFaces ? 0 : 1) << 57) |
+               ((uint64_t)(model & 0xfffff) << 24) | depth;
+    }
+
+    static bool bySortKey(const DrawItem& a, const DrawItem& b) {
+        return a.sortKey < b.sortKey;
+    }
+
+    // Merges the sorted runs of m_DrawList, bounded by m_Runs, pairwise on the job system until one is left.
+    // Every round is parallel over the pairs and linear in the draw count.
+    void mergeRuns(JobSystem& jobs) {
+        m_MergeScratch.resize(m_DrawList.size());
+        DrawItem* source = m_DrawList.data();
+        DrawItem* destination = m_MergeScratch.data();
+        std::vector<size_t> merged;
+        while (m_Runs.size() > 2) {
+            size_t last = m_Runs.size() - 1;
+            jobs.ParallelFor((last + 1) / 2, 1, [&](size_t begin, size_t end) {
+                for (size_t pair = begin; pair < end; ++pair) {
+                    size_t lo = m_Runs[2 * pair], mid = m_Runs[std::min(2 * pair + 1, last)];
+                    size_t hi = m_Runs[std::min(2 * pair + 2, last)];
+                    std::merge(source + lo, source + mid, source + mid, source + hi, destination + lo, bySortKey);
+                }
+            });
+            merged.clear();
+            for (size_t i = 0; i < last; i += 2)
+                merged.push_back(m_Runs[i]);
+            merged.push_back(m_Runs[last]);
+            m_Runs.swap(merged);
+            std::swap(source, destination);
+        }
+        if (source != m_DrawList.data())
+            m_DrawList.swap(m_MergeScratch);
+    }
+
+public:
+    uint32_t AddObject(SceneObject object) {
+        for (int i = 0; i < object.lodCount; ++i) {
+            object.lods[i].modelId = modelId(object.lods[i].model);
+            object.lods[i].features = MaterialFeatures(*object.lods[i].model);
+        }
+        if (!object.animation)
+            ++m_StaticRevision;
+        m_Objects.push_back(std::move(object));
+        m_StaticBoundsDirty = true;
+        return (uint32_t)(m_Objects.size() - 1);
+    }
+
+    // drops every object added after the first count ones
+    void Truncate(size_t count) {
+        if (count < m_Objects.size()) {
+            m_Objects.resize(count);
+            m_StaticBoundsDirty = true;
+            ++m_StaticRevision;
+        }
+    }
+
+    size_t ObjectCount() const {
+        return m_Objects.size();
+    }
+
+    const std::vector<DrawItem>& DrawList() const {
+        return m_DrawList;
+    }
+
+    const FramePrepStats& Stats() const {
+        return m_Stats;
+    }
+
+    // bounds of every object that doesn't move, valid after PrepareFrame
+    void StaticBounds(glm::vec3& min, glm::vec3& max) const {
+        min = m_StaticMin;
+        max = m_StaticMax;
+    }
+
+    // changes whenever static objects are added or removed, cached shadows go stale with it
+    uint32_t StaticRevision() const {
+        return m_StaticRevision;
+    }
+
+    // Every object as a shadow caster, static ones only if includeStatic. Animated objects are appended
+    // after the static ones, starting at dynamicBegin. Uses the transforms of the last PrepareFrame.
+    void CollectShadowCasters(bool includeStatic, std::vector<ShadowCaster>& casters, size_t& dynamicBegin) const {
+        casters.clear();
+        for (int dynamic = includeStatic ? 0 : 1; dynamic < 2; ++dynamic) {
+            if (dynamic)
+                dynamicBegin = casters.size();
+            for (const SceneObject& object : m_Objects) {
+                if (object.lodCount == 0 || (bool)object.animation != (dynamic == 1))
+                    continue;
+                ShadowCaster caster;
+                caster.model = object.lods[0].model;
+                caster.transform = object.transform;
+                boundingSphere(object, caster.center, caster.radius);
+                caster.cullFaces = object.cullFaces;
+                caster.pass = object.pass;
+                casters.push_back(caster);
+            }
+        }
+    }
+
+    // Transform update, visibility, LOD selection and sort key generation for every object, split into
+    // jobs over the pool; every job sorts its own items and the sorted chunks are merged on the pool as
+    // well. The GL thread only has to walk the resulting compact draw list afterwards.
+    void PrepareFrame(JobSystem& jobs, const glm::mat4& view, const glm::mat4& projection,
+                      const glm::vec3& cameraPosition, float farPlane, float time) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        const size_t grainSize = 256;
+        size_t chunkCount = (m_Objects.size() + grainSize - 1) / grainSize;
+        if (m_ChunkItems.size() < chunkCount)
+            m_ChunkItems.resize(chunkCount);
+
+        jobs.ParallelFor(m_Objects.size(), grainSize, [&](size_t begin, size_t end) {
+            std::vector<DrawItem>& items = m_ChunkItems[begin / grainSize];
+            items.clear();
+            for (size_t i = begin; i < end; ++i) {
+                SceneObject& object = m_Objects[i];
+                if (object.lodCount == 0)
+                    continue;
+
+                // instance transform, static objects keep theirs and its normal matrix between frames
+                object.moved = false;
+                if (object.animation) {
+                    object.previousTransform = object.transform;
+                    object.transform = object.animation(time);
+                    object.normalMatrix = ComputeNormalMatrix(object.transform);
+                    object.moved = true;
+                } else if (object.transformDirty) {
+                    object.previousTransform = object.transform;
+                    object.transform = object.ComputeTransform();
+                    object.normalMatrix = ComputeNormalMatrix(object.transform);
+                    object.transformDirty = false;
+                    object.moved = true;
+                }
+
+                // visibility against a bounding sphere around the finest LOD
+                glm::vec3 worldCenter;
+                float radius;
+                boundingSphere(object, worldCenter, radius);
+                if (!frustum.IntersectsSphere(worldCenter, radius))
+                    continue;
+
+                // LOD selection, objects past their last LOD distance are dropped
+                float distance = glm::max(glm::length(worldCenter - cameraPosition) - radius, 0.0f);
+                int lod = 0;
+                while (lod < object.lodCount && distance > object.lods[lod].maxDistance)
+                    ++lod;
+                if (lod == object.lodCount)
+                    continue;
+
+                DrawItem item;
+                item.model = object.lods[lod].model;
+                item.transform = object.transform;
+                item.normalMatrix = object.normalMatrix;
+                item.moving = object.moved && object.previousTransform != object.transform;
+                item.previousTransform = item.moving ? object.previousTransform : object.transform;
+                const ModelLod& selected = object.lods[lod];
+                item.sortKey = makeSortKey(object.pass, selected.features, object.cullFaces, selected.modelId, distance,
+                                           farPlane);
+                item.objectIndex = (uint32_t)i;
+                item.materialIndex = object.lods[lod].modelId;
+                item.shininess = object.shininess;
+                item.pass = object.pass;
+                item.features = selected.features;
+                item.cullFaces = object.cullFaces;
+                item.lightmapRegion = lod == 0 ? object.lightmapRegion : -1;
+                items.push_back(item);
+            }
+            std::sort(items.begin(), items.end(), bySortKey);
+        });
+
+        if (m_StaticBoundsDirty)
+            updateStaticBounds();
+
+        m_DrawList.clear();
+        m_Runs.assign(1, 0);
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            if (m_ChunkItems[chunk].empty())
+                continue;
+            m_DrawList.insert(m_DrawList.end(), m_ChunkItems[chunk].begin(), m_ChunkItems[chunk].end());
+            m_Runs.push_back(m_DrawList.size());
+        }
+        mergeRuns(jobs);
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        m_Stats.prepMs = std::chrono::duration<double, std::milli>(stop - start).count();
+        m_Stats.objectCount = (unsigned)m_Objects.size();
+        m_Stats.visibleCount = (unsigned)m_DrawList.size();
+        m_Stats.threadCount = jobs.ThreadCount();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENE_H
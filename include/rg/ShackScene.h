@@ -0,0 +1,121 @@
+#ifndef PROJECT_BASE_SHACKSCENE_H
+#define PROJECT_BASE_SHACKSCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <rg/Light.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace rg {
+
+// The static part of the shack scene, shared by the renderer and the headless lightmap baker so both
+// see the same geometry and the same lantern lights.
+
+enum class ShackModel : uint8_t {
+    Shack,
+    DeadTree,
+    OldTap,
+    CactusPot,
+    Plant,
+    Trees,
+    RockA,
+    RockB,
+    RockC,
+    RockD,
+    RockE,
+    RockF,
+    RockG,
+    Count
+};
+
+inline const char* ShackModelPath(ShackModel model) {
+    static const char* paths[(int)ShackModel::Count] = {
+            "resources/objects/shack_scene/untitled.obj",
+            "resources/objects/dead_tree/dead_tree.obj",
+            "resources/objects/old_tap/old_tap.obj",
+            "resources/objects/cactus_pot/CACTUS_CONCRETE_POT_10K.obj",
+            "resources/objects/plant/plant.obj",
+            "resources/objects/trees_pack/trees_pack.obj",
+            "resources/objects/rock_set/rockA.obj",
+            "resources/objects/rock_set/rockB.obj",
+            "resources/objects/rock_set/rockC.obj",
+            "resources/objects/rock_set/rockD.obj",
+            "resources/objects/rock_set/rockE.obj",
+            "resources/objects/rock_set/rockF.obj",
+            "resources/objects/rock_set/rockG.obj"};
+    return paths[(int)model];
+}
+
+// same parameters SceneObject::Static takes; the angle is used as is, in radians
+struct ShackPlacement {
+    ShackModel model;
+    glm::vec3 position;
+    glm::vec3 scale;
+    glm::vec3 rotationAxis;
+    float angle;
+    bool rotate;
+    bool cullFaces;
+};
+
+inline glm::mat4 PlacementTransform(const glm::vec3& position, const glm::vec3& scale, const glm::vec3& rotationAxis,
+                                    float angle, bool rotate) {
+    glm::mat4 transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, position);
+    transform = glm::scale(transform, scale);
+    if (rotate)
+        transform = glm::rotate(transform, angle, rotationAxis);
+    return transform;
+}
+
+// every static lit object; a lightmap, when baked, has one region per entry, in this order
+inline const std::vector<ShackPlacement>& ShackLitObjects() {
+    static const glm::vec3 up(0.0f, 1.0f, 0.0f);
+    static const std::vector<ShackPlacement> placements = {
+            {ShackModel::Shack, glm::vec3(0.0f, -10.0f, -10.0f), glm::vec3(3.0f), glm::vec3(0.0f), 0.0f, false, false},
+            // tree1 - front, right
+            {ShackModel::DeadTree, glm::vec3(20.0f, -10.0f, -10.0f), glm::vec3(3.0f), glm::vec3(0.0f), 0.0f, false, true},
+            // tree2 - back, right
+            {ShackModel::DeadTree, glm::vec3(15.0f, -10.0f, -30.0f), glm::vec3(3.0f), up, 145.0f, true, true},
+            // tree3 - back, left
+            {ShackModel::DeadTree, glm::vec3(-30.0f, -10.0f, -30.0f), glm::vec3(3.0f), up, 55.0f, true, true},
+            // tap & oldTap
+            {ShackModel::OldTap, glm::vec3(-17.0f, -9.0f, -15.5f), glm::vec3(0.4f), up, 90.0f, false, true},
+            // cactus pot
+            {ShackModel::CactusPot, glm::vec3(-10.7f, -4.25f, -16.5f), glm::vec3(4.0f), up, 55.0f, false, true},
+            // plant with big leaves
+            {ShackModel::Plant, glm::vec3(13.0f, -10.0f, -7.0f), glm::vec3(0.2f), up, 30.0f, true, true},
+            // trees
+            {ShackModel::Trees, glm::vec3(-1.0f, -10.0f, -27.0f), glm::vec3(1.0f), up, 55.0f, false, true},
+            // rocks
+            {ShackModel::RockA, glm::vec3(-10.0f, -10.0f, -3.0f), glm::vec3(0.7f), up, 55.0f, false, true},
+            {ShackModel::RockB, glm::vec3(-8.5f, -10.0f, -2.5f), glm::vec3(0.5f), up, 55.0f, true, true},
+            {ShackModel::RockC, glm::vec3(-9.0f, -10.0f, -0.7f), glm::vec3(0.7f), up, 30.0f, true, true},
+            {ShackModel::RockG, glm::vec3(-10.5f, -10.0f, -0.9f), glm::vec3(1.0f), up, 30.0f, true, true},
+            {ShackModel::RockE, glm::vec3(7.0f, -10.0f, -25.0f), glm::vec3(1.0f), up, 30.0f, true, true},
+            {ShackModel::RockF, glm::vec3(8.0f, -10.0f, -26.7f), glm::vec3(1.0f), up, 30.0f, true, true},
+            {ShackModel::RockC, glm::vec3(7.0f, -10.0f, 4.0f), glm::vec3(0.5f), up, 55.0f, false, true},
+            {ShackModel::RockE, glm::vec3(8.0f, -10.0f, 3.0f), glm::vec3(0.5f), up, 55.0f, false, true}};
+    return placements;
+}
+
+// the green, red and bronze lanterns' point lights; they never move, so they can be baked
+inline std::vector<Light> ShackLanterns() {
+    std::vector<Light> lights = {
+            // point light 1 - green lantern
+            Light::Point(glm::vec3(10.0f, -11.0f, -25.0f), glm::vec3(0.05f), glm::vec3(0.94f, 0.98f, 0.78f),
+                         glm::vec3(0.9f, 0.98f, 0.78f), 1.0f, 0.2f, 0.1f),
+            // point light 2 - red lantern
+            Light::Point(glm::vec3(-24.0f, -7.0f, -0.5f), glm::vec3(0.05f), glm::vec3(0.94f, 0.98f, 0.78f),
+                         glm::vec3(0.94f, 0.98f, 0.78f), 1.0f, 0.2f, 0.5f),
+            // point light 3 - bronze lantern
+            Light::Point(glm::vec3(17.0f, -12.5f, -7.0f), glm::vec3(0.05f), glm::vec3(0.94f, 0.98f, 0.78f),
+                         glm::vec3(0.94f, 0.98f, 0.78f), 1.0f, 0.2f, 0.1f)};
+    return lights;
+}
+
+}
+
+#endif //PROJECT_BASE_SHACKSCENE_H
@@ -0,0 +1,469 @@
+#ifndef PROJECT_BASE_SHADERLIBRARY_H
+#define PROJECT_BASE_SHADERLIBRARY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <rg/ProgramCache.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Compile-time features of the scene programs. Each one becomes a #define of the same name in upper
+// snake case. The material bits come from the models, AlphaTest is the highest so those draws, which
+// can't use the depth pre-pass, sort last within their pass.
+struct ShaderFeature {
+    enum : uint32_t {
+        NormalMapping = 1u << 0,
+        Fog = 1u << 1,
+        Bloom = 1u << 2,
+        AlphaTest = 1u << 3,
+        Shadows = 1u << 4,
+        Lightmap = 1u << 5,
+        AmbientOcclusion = 1u << 6
+    };
+    static const int Count = 7;
+
+    static const char* Define(int bit) {
+        static const char* names[Count] = {"NORMAL_MAPPING", "FOG", "BLOOM", "ALPHA_TEST", "SHADOWS", "LIGHTMAP",
+                                           "AMBIENT_OCCLUSION"};
+        return names[bit];
+    }
+};
+
+// A set of #define NAME value lines, kept sorted so that equal sets give equal keys.
+class ShaderDefines {
+    std::vector<std::pair<std::string, std::string>> m_Values;
+
+public:
+    ShaderDefines& Set(const std::string& name, const std::string& value = "1") {
+        auto it = std::lower_bound(m_Values.begin(), m_Values.end(), name,
+                                   [](const std::pair<std::string, std::string>& a, const std::string& b) {
+                                       return a.first < b;
+                                   });
+        if (it != m_Values.end() && it->first == name)
+            it->second = value;
+        else
+            m_Values.insert(it, std::make_pair(name, value));
+        return *this;
+    }
+
+    ShaderDefines& Set(const std::string& name, int value) {
+        return Set(name, std::to_string(value));
+    }
+
+    static ShaderDefines FromFeatures(uint32_t features) {
+        ShaderDefines defines;
+        for (int bit = 0; bit < ShaderFeature::Count; ++bit) {
+            if (features & (1u << bit))
+                defines.Set(ShaderFeature::Define(bit));
+        }
+        return defines;
+    }
+
+    // permutation key, "NAME=value;..."
+    std::string Key() const {
+        std::string key;
+        for (const auto& define : m_Values)
+            key += define.first + "=" + define.second + ";";
+        return key;
+    }
+
+    // lines inserted after #version
+    std::string Preamble() const {
+        std::string preamble;
+        for (const auto& define : m_Values)
+            preamble += "#define " + define.first + " " + define.second + "\n";
+        return preamble;
+    }
+};
+
+// One shader stage after preprocessing. #include "file" is resolved relative to the including file and
+// each file is pasted only once. The defines go right after #version, and #line directives keep the
+// compiler's line numbers pointing into the original files; their second number indexes files.
+struct ShaderSource {
+    std::string code;
+    std::vector<std::string> files;
+    bool ok = true;
+
+    static ShaderSource Load(const std::string& path, const ShaderDefines& defines) {
+        ShaderSource source;
+        source.expand(path, defines.Preamble());
+        return source;
+    }
+
+    // the file table, printed along with compile errors
+    void PrintFiles(std::ostream& out) const {
+        for (size_t i = 0; i < files.size(); ++i)
+            out << "  " << i << ": " << files[i] << "\n";
+    }
+
+private:
+    void expand(const std::string& path, const std::string& preamble) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            ok = false;
+            return;
+        }
+        int fileIndex = (int)files.size();
+        files.push_back(path);
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+
+        std::string line;
+        int lineNumber = 0;
+        std::ostringstream out;
+        while (std::getline(file, line)) {
+            ++lineNumber;
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+                size_t open = line.find('"', start), close = line.find('"', open + 1);
+                if (open == std::string::npos || close == std::string::npos) {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                    ok = false;
+                    continue;
+                }
+                std::string included = directory + line.substr(open + 1, close - open - 1);
+                if (std::find(files.begin(), files.end(), included) != files.end())
+                    continue;
+                code += out.str();
+                out.str("");
+                code += "#line 1 " + std::to_string(files.size()) + "\n";
+                expand(included, preamble);
+                out << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+            } else if (fileIndex == 0 && start != std::string::npos && line.compare(start, 8, "#version") == 0) {
+                out << line << "\n" << preamble << "#line " << lineNumber + 1 << " 0\n";
+            } else {
+                out << line << "\n";
+            }
+        }
+        code += out.str();
+    }
+};
+
+typedef uint32_t ShaderProgramId;
+
+struct ShaderBuildStats {
+    unsigned compiled = 0;
+    unsigned cacheHits = 0;
+    double compileMs = 0.0;
+    double cacheMs = 0.0;
+};
+
+// Programs built from a vertex and fragment file, or a single compute file, with variants compiled on demand per set of defines
+// and cached by permutation key. The init callback runs once on every new variant, for the uniforms
+// that never change such as sampler units. With a program cache open, linked binaries are reused
+// between runs and only programs whose sources changed are compiled.
+//
+// Compiles and links are only issued when a variant is requested; their status is checked later, by
+// Update once the driver reports completion (KHR_parallel_shader_compile) or a frame after issuing
+// without it, so the driver can work on several programs at once. Until a variant is ready, Get hands
+// out the program's fallback variant, so new permutations never stall a frame.
+class ShaderLibrary {
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Variant {
+        std::unique_ptr<Shader> shader;
+        std::string label;
+        // sources and stages, kept until the status check; compute programs use the vertex slot
+        ShaderSource vertexSource, fragmentSource;
+        GLuint vertex = 0, fragment = 0;
+        uint64_t cacheKey = 0;
+        Clock::time_point start;
+        unsigned issueFrame = 0;
+        bool cacheHit = false;
+        bool ready = false;
+        // didn't compile or link: never ready, Get keeps returning the fallback for it
+        bool failed = false;
+    };
+
+    struct Program {
+        std::string vertexPath, fragmentPath;
+        bool compute = false;
+        std::function<void(Shader&)> init;
+        std::map<std::string, Variant> variants;
+        const Variant* fallback = nullptr;
+    };
+
+    std::vector<Program> m_Programs;
+    std::vector<std::pair<ShaderProgramId, Variant*>> m_Pending;
+    size_t m_VariantCount = 0;
+    unsigned m_Frame = 0;
+    ProgramCache m_Cache;
+    ShaderBuildStats m_BuildStats;
+
+    static bool checkStage(GLuint shader, const ShaderSource& source, const std::string& label) {
+        GLint success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[1024];
+            glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR in " << label << "\n" << infoLog << "files:\n";
+            source.PrintFiles(std::cout);
+            std::cout << " -- --------------------------------------------------- -- " << std::endl;
+        }
+        return success == GL_TRUE;
+    }
+
+    static GLuint issueStage(GLenum type, const ShaderSource& source) {
+        GLuint shader = glCreateShader(type);
+        const char* code = source.code.c_str();
+        glShaderSource(shader, 1, &code, nullptr);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    // loads the program cache's binary for these exact sources, otherwise starts compiling and linking
+    // without waiting for either
+    Variant& request(ShaderProgramId id, const ShaderDefines& defines) {
+        Program& program = m_Programs[id];
+        std::string key = defines.Key();
+        auto it = program.variants.find(key);
+        if (it != program.variants.end())
+            return it->second;
+
+        Variant& variant = program.variants[key];
+        variant.label = (program.compute ? program.vertexPath : program.vertexPath + " + " + program.fragmentPath) +
+                        " [" + key + "]";
+        variant.start = Clock::now();
+        variant.issueFrame = m_Frame;
+        variant.vertexSource = ShaderSource::Load(program.vertexPath, defines);
+        if (!program.compute)
+            variant.fragmentSource = ShaderSource::Load(program.fragmentPath, defines);
+        variant.cacheKey = m_Cache.Key(variant.vertexSource.code + '\0' + variant.fragmentSource.code);
+        GLuint programId = glCreateProgram();
+        variant.cacheHit = m_Cache.Load(variant.cacheKey, programId);
+        if (!variant.cacheHit) {
+            // a rejected binary leaves the program unlinked, start over with a clean one
+            glDeleteProgram(programId);
+            programId = glCreateProgram();
+            variant.vertex = issueStage(program.compute ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER, variant.vertexSource);
+            if (!program.compute)
+                variant.fragment = issueStage(GL_FRAGMENT_SHADER, variant.fragmentSource);
+            ProgramCache::MarkRetrievable(programId);
+            glAttachShader(programId, variant.vertex);
+            if (variant.fragment)
+                glAttachShader(programId, variant.fragment);
+            glLinkProgram(programId);
+        }
+        variant.shader.reset(new Shader(programId));
+        ++m_VariantCount;
+        if (variant.cacheHit)
+            finish(program, variant);
+        else
+            m_Pending.push_back(std::make_pair(id, &variant));
+        return variant;
+    }
+
+    bool completed(const Variant& variant) const {
+        if (glext().parallelShaderCompile) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(variant.shader->ID, GL_COMPLETION_STATUS_KHR, &done);
+            return done == GL_TRUE;
+        }
+        return m_Frame != variant.issueFrame;
+    }
+
+    // the status checks, blocking if the driver isn't done yet
+    void finish(Program& program, Variant& variant) {
+        GLuint id = variant.shader->ID;
+        if (!variant.cacheHit) {
+            bool compiled = checkStage(variant.vertex, variant.vertexSource, variant.label);
+            if (variant.fragment)
+                compiled = checkStage(variant.fragment, variant.fragmentSource, variant.label) && compiled;
+            GLint success;
+            glGetProgramiv(id, GL_LINK_STATUS, &success);
+            if (!success) {
+                GLchar infoLog[1024];
+                glGetProgramInfoLog(id, sizeof(infoLog), nullptr, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR in " << variant.label << "\n" << infoLog
+                          << "\n -- --------------------------------------------------- -- " << std::endl;
+                variant.failed = true;
+            } else if (compiled && variant.vertexSource.ok && variant.fragmentSource.ok) {
+                m_Cache.Store(variant.cacheKey, id);
+            }
+            glDeleteShader(variant.vertex);
+            glDeleteShader(variant.fragment);
+            variant.vertex = variant.fragment = 0;
+        }
+        variant.vertexSource = ShaderSource();
+        variant.fragmentSource = ShaderSource();
+
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - variant.start).count();
+        if (variant.cacheHit) {
+            ++m_BuildStats.cacheHits;
+            m_BuildStats.cacheMs += ms;
+        } else {
+            ++m_BuildStats.compiled;
+            m_BuildStats.compileMs += ms;
+        }
+        std::printf("%-9s %8.2f ms  %s\n", variant.cacheHit ? "cached" : (variant.failed ? "failed" : "compiled"), ms,
+                    variant.label.c_str());
+        if (variant.failed)
+            return;
+        if (program.init)
+            program.init(*variant.shader);
+        variant.ready = true;
+    }
+
+    void finishNow(Program& program, Variant& variant) {
+        for (size_t i = 0; i < m_Pending.size(); ++i) {
+            if (m_Pending[i].second == &variant) {
+                m_Pending.erase(m_Pending.begin() + (long)i);
+                break;
+            }
+        }
+        finish(program, variant);
+    }
+
+public:
+    // binaries of linked programs are kept in this file between runs, if the driver supports it
+    void OpenCache(const std::string& path) {
+        m_Cache.Open(path);
+        std::cout << "Shader program cache: " << (m_Cache.Enabled() ? path : "not supported by the driver")
+                  << ", parallel compile: " << (glext().parallelShaderCompile ? "yes" : "no") << std::endl;
+    }
+
+    ShaderProgramId Register(const std::string& vertexPath, const std::string& fragmentPath,
+                             std::function<void(Shader&)> init = nullptr) {
+        Program program;
+        program.vertexPath = vertexPath;
+        program.fragmentPath = fragmentPath;
+        program.init = std::move(init);
+        m_Programs.push_back(std::move(program));
+        return (ShaderProgramId)(m_Programs.size() - 1);
+    }
+
+    // only where glext().computeShaders is set
+    ShaderProgramId RegisterCompute(const std::string& computePath, std::function<void(Shader&)> init = nullptr) {
+        Program program;
+        program.vertexPath = computePath;
+        program.compute = true;
+        program.init = std::move(init);
+        m_Programs.push_back(std::move(program));
+        return (ShaderProgramId)(m_Programs.size() - 1);
+    }
+
+    // starts building a variant without waiting for it
+    void Request(ShaderProgramId id, const ShaderDefines& defines = ShaderDefines()) {
+        request(id, defines);
+    }
+
+    void Request(ShaderProgramId id, uint32_t features) {
+        request(id, ShaderDefines::FromFeatures(features));
+    }
+
+    // the variant drawn with while others of the program are still compiling, built before this returns
+    void SetFallback(ShaderProgramId id, const ShaderDefines& defines) {
+        Program& program = m_Programs[id];
+        Variant& variant = request(id, defines);
+        if (!variant.ready && !variant.failed)
+            finishNow(program, variant);
+        if (variant.ready)
+            program.fallback = &variant;
+    }
+
+    void SetFallback(ShaderProgramId id, uint32_t features) {
+        SetFallback(id, ShaderDefines::FromFeatures(features));
+    }
+
+    // The variant for these defines if it is ready, otherwise the program's fallback while it compiles or
+    // if it failed to. Programs without a fallback wait for the variant; if it failed, there is nothing
+    // better to return than the unlinked program, which draws nothing.
+    Shader& Get(ShaderProgramId id, const ShaderDefines& defines = ShaderDefines()) {
+        Program& program = m_Programs[id];
+        Variant& variant = request(id, defines);
+        if (variant.ready)
+            return *variant.shader;
+        if (program.fallback)
+            return *program.fallback->shader;
+        if (!variant.failed)
+            finishNow(program, variant);
+        return *variant.shader;
+    }
+
+    Shader& Get(ShaderProgramId id, uint32_t features) {
+        return Get(id, ShaderDefines::FromFeatures(features));
+    }
+
+    // once per frame, before the frame's variants are looked up: picks up the finished compiles
+    void Update() {
+        ++m_Frame;
+        for (size_t i = 0; i < m_Pending.size();) {
+            if (completed(*m_Pending[i].second)) {
+                std::pair<ShaderProgramId, Variant*> pending = m_Pending[i];
+                m_Pending.erase(m_Pending.begin() + (long)i);
+                finish(m_Programs[pending.first], *pending.second);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    // waits for every requested variant
+    void Finish() {
+        while (!m_Pending.empty()) {
+            std::pair<ShaderProgramId, Variant*> pending = m_Pending.back();
+            m_Pending.pop_back();
+            finish(m_Programs[pending.first], *pending.second);
+        }
+    }
+
+    // for per-frame uniforms, which every ready variant that may be drawn with needs
+    void ForEachVariant(ShaderProgramId id, const std::function<void(Shader&)>& function) {
+        for (auto& variant : m_Programs[id].variants) {
+            if (variant.second.ready)
+                function(*variant.second.shader);
+        }
+    }
+
+    size_t VariantCount() const {
+        return m_VariantCount;
+    }
+
+    size_t PendingCount() const {
+        return m_Pending.size();
+    }
+
+    size_t ProgramCount() const {
+        return m_Programs.size();
+    }
+
+    const ShaderBuildStats& BuildStats() const {
+        return m_BuildStats;
+    }
+
+    // writes new binaries to the program cache, then deletes every variant
+    void Destroy() {
+        m_Cache.Save();
+        for (auto& pending : m_Pending) {
+            glDeleteShader(pending.second->vertex);
+            glDeleteShader(pending.second->fragment);
+        }
+        m_Pending.clear();
+        for (Program& program : m_Programs) {
+            for (auto& variant : program.variants)
+                glDeleteProgram(variant.second.shader->ID);
+            program.variants.clear();
+            program.fallback = nullptr;
+        }
+        m_VariantCount = 0;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERLIBRARY_H
@@ -0,0 +1,201 @@
+#ifndef PROJECT_BASE_SKYIRRADIANCE_H
+#define PROJECT_BASE_SKYIRRADIANCE_H
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <learnopengl/shader.h>
+#include <rg/Float4.h>
+#include <rg/JobSystem.h>
+#include <rg/ProgramCache.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Diffuse ambient light from the skybox as nine L2 spherical harmonics coefficients per colour channel.
+// The faces are projected once on the CPU and the result is kept in a small file keyed by the images, so
+// later runs skip even decoding them. The coefficients are already convolved with the cosine lobe and
+// divided by pi: the shaders' SkyAmbient(normal) is the ambient light a diffuse surface reflects, with no
+// texture fetch.
+class SkyIrradiance {
+    static const uint32_t Magic = 0x48534752; // "RGSH"
+    static const uint32_t Version = 1;
+
+    glm::vec3 m_Coefficients[9];
+    bool m_Valid = false;
+
+    // partial sums of one face, four texels per lane set
+    struct FaceSums {
+        Float4 channels[9][3];
+        Float4 weight;
+    };
+
+    // cube map face i of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i: direction of face coordinates s, t in -1..1
+    static void faceDirection(int face, const Float4& s, const Float4& t, Float4& x, Float4& y, Float4& z) {
+        const Float4 one(1.0f), zero;
+        switch (face) {
+            case 0: x = one; y = zero - t; z = zero - s; break;
+            case 1: x = zero - one; y = zero - t; z = s; break;
+            case 2: x = s; y = one; z = t; break;
+            case 3: x = s; y = zero - one; z = zero - t; break;
+            case 4: x = s; y = zero - t; z = one; break;
+            default: x = zero - s; y = zero - t; z = zero - one; break;
+        }
+    }
+
+    // rows as stbi hands them out, which is also how loadCubemap uploads them
+    static void projectFace(int face, const unsigned char* pixels, int width, int height, FaceSums& sums) {
+        const float texelArea = (2.0f / (float)width) * (2.0f / (float)height);
+        for (int row = 0; row < height; ++row) {
+            Float4 t(2.0f * ((float)row + 0.5f) / (float)height - 1.0f);
+            for (int column = 0; column < width; column += 4) {
+                float s[4], color[3][4], valid[4];
+                for (int i = 0; i < 4; ++i) {
+                    int c = column + i < width ? column + i : width - 1;
+                    s[i] = 2.0f * ((float)c + 0.5f) / (float)width - 1.0f;
+                    valid[i] = column + i < width ? 1.0f : 0.0f;
+                    const unsigned char* texel = pixels + 3 * ((size_t)row * width + c);
+                    for (int channel = 0; channel < 3; ++channel)
+                        color[channel][i] = texel[channel] * (1.0f / 255.0f);
+                }
+                Float4 x, y, z;
+                Float4 sLanes = Float4::Load(s);
+                faceDirection(face, sLanes, t, x, y, z);
+                // normalize, the solid angle of a texel falls off with the cube of the inverse length
+                Float4 inverseLength = Float4(1.0f) / Float4::Sqrt(x * x + y * y + z * z);
+                x = x * inverseLength;
+                y = y * inverseLength;
+                z = z * inverseLength;
+                Float4 weight = inverseLength * inverseLength * inverseLength * Float4(texelArea) * Float4::Load(valid);
+                Float4 basis[9] = {Float4(0.282095f),
+                                   Float4(0.488603f) * y,
+                                   Float4(0.488603f) * z,
+                                   Float4(0.488603f) * x,
+                                   Float4(1.092548f) * x * y,
+                                   Float4(1.092548f) * y * z,
+                                   Float4(0.315392f) * (Float4(3.0f) * z * z - Float4(1.0f)),
+                                   Float4(1.092548f) * x * z,
+                                   Float4(0.546274f) * (x * x - y * y)};
+                Float4 r = Float4::Load(color[0]) * weight, g = Float4::Load(color[1]) * weight,
+                       b = Float4::Load(color[2]) * weight;
+                for (int i = 0; i < 9; ++i) {
+                    sums.channels[i][0] = sums.channels[i][0] + basis[i] * r;
+                    sums.channels[i][1] = sums.channels[i][1] + basis[i] * g;
+                    sums.channels[i][2] = sums.channels[i][2] + basis[i] * b;
+                }
+                sums.weight = sums.weight + weight;
+            }
+        }
+    }
+
+    static float sumLanes(const Float4& value) {
+        float lanes[4];
+        value.Store(lanes);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+public:
+    // identifies the face images by content, a changed skybox misses the cache
+    static uint64_t Key(const std::vector<std::string>& faces) {
+        uint64_t hash = hashString("sky irradiance " + std::to_string(Version));
+        for (const std::string& path : faces) {
+            std::ifstream in(path, std::ios::binary);
+            std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            hash = hashString(bytes, hash);
+        }
+        return hash;
+    }
+
+    bool LoadCached(const std::string& path, uint64_t key) {
+        std::ifstream in(path, std::ios::binary);
+        uint32_t header[2] = {};
+        uint64_t fileKey = 0;
+        if (!in.read((char*)header, sizeof(header)) || header[0] != Magic || header[1] != Version ||
+            !in.read((char*)&fileKey, sizeof(fileKey)) || fileKey != key)
+            return false;
+        m_Valid = (bool)in.read((char*)m_Coefficients, sizeof(m_Coefficients));
+        return m_Valid;
+    }
+
+    void SaveCache(const std::string& path, uint64_t key) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        uint32_t header[2] = {Magic, Version};
+        out.write((const char*)header, sizeof(header));
+        out.write((const char*)&key, sizeof(key));
+        out.write((const char*)m_Coefficients, sizeof(m_Coefficients));
+    }
+
+    // Decodes and projects the six faces, one job each; faces are in cube map face order like
+    // loadCubemap takes them, with the same stbi vertical flip setting. False if a face failed to load.
+    bool Project(JobSystem& jobs, const std::vector<std::string>& faces) {
+        FaceSums sums[6];
+        bool loaded[6] = {};
+        jobs.ParallelFor(6, 1, [&](size_t begin, size_t end) {
+            for (size_t face = begin; face < end; ++face) {
+                int width = 0, height = 0, channels = 0;
+                unsigned char* pixels = face < faces.size()
+                                                ? stbi_load(faces[face].c_str(), &width, &height, &channels, 3)
+                                                : nullptr;
+                if (!pixels)
+                    continue;
+                projectFace((int)face, pixels, width, height, sums[face]);
+                stbi_image_free(pixels);
+                loaded[face] = true;
+            }
+        });
+        float weight = 0.0f;
+        glm::vec3 coefficients[9] = {};
+        for (int face = 0; face < 6; ++face) {
+            if (!loaded[face])
+                return false;
+            weight += sumLanes(sums[face].weight);
+            for (int i = 0; i < 9; ++i)
+                coefficients[i] += glm::vec3(sumLanes(sums[face].channels[i][0]), sumLanes(sums[face].channels[i][1]),
+                                             sumLanes(sums[face].channels[i][2]));
+        }
+        // the texel solid angles add up to a little less than the sphere, and the cosine lobe convolution
+        // scales the bands by pi, 2pi/3 and pi/4, here already divided by pi
+        const float bandScale[3] = {1.0f, 2.0f / 3.0f, 0.25f};
+        float sphere = 4.0f * 3.14159265f / weight;
+        for (int i = 0; i < 9; ++i)
+            m_Coefficients[i] = coefficients[i] * sphere * bandScale[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+        m_Valid = true;
+        return true;
+    }
+
+    bool Valid() const {
+        return m_Valid;
+    }
+
+    // average ambient over all directions, the constant band
+    glm::vec3 Average() const {
+        return m_Coefficients[0] * 0.282095f;
+    }
+
+    // Sets skyIrradiance[9], scaled so the ambient light averages strength in brightness. The sky keeps its
+    // tint and its direction, the night scene just doesn't take the daylight sky's level.
+    void Apply(Shader& shader, float strength) const {
+        static const char* names[9] = {"skyIrradiance[0]", "skyIrradiance[1]", "skyIrradiance[2]",
+                                       "skyIrradiance[3]", "skyIrradiance[4]", "skyIrradiance[5]",
+                                       "skyIrradiance[6]", "skyIrradiance[7]", "skyIrradiance[8]"};
+        glm::vec3 average = Average();
+        float brightness = (average.r + average.g + average.b) / 3.0f;
+        shader.use();
+        for (int i = 0; i < 9; ++i) {
+            // without a sky, a flat ambient of the same strength
+            glm::vec3 value = i == 0 ? glm::vec3(strength / 0.282095f) : glm::vec3(0.0f);
+            if (m_Valid && brightness > 0.0f)
+                value = m_Coefficients[i] * (strength / brightness);
+            shader.setVec3(names[i], value);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SKYIRRADIANCE_H
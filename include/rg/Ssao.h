@@ -0,0 +1,185 @@
+#ifndef PROJECT_BASE_SSAO_H
+#define PROJECT_BASE_SSAO_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/RenderTargetPool.h>
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+enum class SsaoQuality { Low, Medium, High };
+
+// Screen-space ambient occlusion at half resolution, four passes over a full screen triangle:
+//  depth:     the depth buffer to half resolution linear view depth, the nearest and the farthest of each
+//             2x2 block alternating in a checkerboard so thin features and both sides of edges survive,
+//  occlusion: per half resolution texel, a hemisphere kernel around the normal reconstructed from the
+//             depth, rotated per texel by a 4x4 tiled noise texture; writes the occlusion with the depth
+//             next to it, so the passes after fetch both at once,
+//  blur:      a 4x4 box over the noise tile, skipping texels of other surfaces by their depth,
+//  upsample:  to the render size, the four nearest half resolution texels weighted bilinearly and by how
+//             close their depth is to the pixel's, so occlusion doesn't bleed over silhouettes.
+// The lit passes read the result per pixel to darken the sky's ambient, see lighting.glsl. The kernel
+// samples are denser towards the centre; the quality presets take 8, 16 or 32 of them.
+class Ssao {
+public:
+    static const GLuint OcclusionUnit = 7;
+    static const int MaxSamples = 32;
+    static const int NoiseSize = 4;
+
+    // half resolution targets, rounded up so the upsample has a texel on both sides of every pixel
+    static RenderTargetDesc HalfDepthDesc(int width, int height) {
+        return RenderTargetDesc((width + 1) / 2, (height + 1) / 2, GL_R32F);
+    }
+
+    static RenderTargetDesc HalfOcclusionDesc(int width, int height) {
+        return RenderTargetDesc((width + 1) / 2, (height + 1) / 2, GL_RG16F);
+    }
+
+    // what the lit passes read, at the render size
+    static RenderTargetDesc OcclusionDesc(int width, int height) {
+        return RenderTargetDesc(width, height, GL_R8);
+    }
+
+    static int SampleCount(SsaoQuality quality) {
+        switch (quality) {
+            case SsaoQuality::Low: return 8;
+            case SsaoQuality::Medium: return 16;
+            default: return MaxSamples;
+        }
+    }
+
+    // once per lit program
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("ambientOcclusion", OcclusionUnit);
+    }
+
+    static void Bind(GLuint occlusion) {
+        glActiveTexture(GL_TEXTURE0 + OcclusionUnit);
+        glBindTexture(GL_TEXTURE_2D, occlusion);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    GLuint m_Noise = 0;
+    GLuint m_VAO = 0;
+    std::vector<glm::vec3> m_Kernel;
+
+    // the hemisphere above z, spread over the whole count so every preset reaches out to the radius
+    void buildKernel(int count) {
+        std::mt19937 random(1234u);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        m_Kernel.resize((size_t)count);
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 direction(unit(random) * 2.0f - 1.0f, unit(random) * 2.0f - 1.0f, unit(random));
+            direction = glm::normalize(direction + glm::vec3(0.0f, 0.0f, 1e-3f));
+            float scale = (float)(i + 1) / (float)count;
+            m_Kernel[(size_t)i] = direction * (0.1f + 0.9f * scale * scale) * unit(random);
+        }
+    }
+
+    // draws the triangle into the bound framebuffer, which the render graph sized for the pass
+    void draw() const {
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    static void bindTexture(GLuint unit, GLuint texture) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // view depth = x / (ndc depth + y) for GL perspective projections
+    static glm::vec2 depthParams(const glm::mat4& projection) {
+        return glm::vec2(projection[3][2], projection[2][2]);
+    }
+
+public:
+    void Create() {
+        // rotations of the kernel about the normal, unit vectors in the tangent plane
+        std::mt19937 random(5678u);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        float rotations[NoiseSize * NoiseSize * 2];
+        for (int i = 0; i < NoiseSize * NoiseSize; ++i) {
+            float a = angle(random);
+            rotations[i * 2] = std::cos(a);
+            rotations[i * 2 + 1] = std::sin(a);
+        }
+        glGenTextures(1, &m_Noise);
+        glBindTexture(GL_TEXTURE_2D, m_Noise);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, NoiseSize, NoiseSize, 0, GL_RG, GL_FLOAT, rotations);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenVertexArrays(1, &m_VAO);
+    }
+
+    void Destroy() {
+        glDeleteTextures(1, &m_Noise);
+        glDeleteVertexArrays(1, &m_VAO);
+        m_Noise = m_VAO = 0;
+    }
+
+    // depth is the depth buffer at the render size, projection the one it was drawn with
+    void DownsampleDepth(Shader& shader, GLuint depth, const glm::mat4& projection) const {
+        shader.use();
+        shader.setInt("depth", 0);
+        shader.setVec2("depthParams", depthParams(projection));
+        bindTexture(0, depth);
+        draw();
+    }
+
+    // radius in world units, power sharpens the result
+    void Occlusion(Shader& shader, GLuint halfDepth, const glm::mat4& projection, SsaoQuality quality, float radius,
+                   float power) {
+        int samples = SampleCount(quality);
+        if ((int)m_Kernel.size() != samples)
+            buildKernel(samples);
+        shader.use();
+        shader.setInt("linearDepth", 0);
+        shader.setInt("noise", 1);
+        shader.setMat4("projection", projection);
+        for (int i = 0; i < samples; ++i)
+            shader.setVec3("kernel[" + std::to_string(i) + "]", m_Kernel[(size_t)i]);
+        shader.setInt("sampleCount", samples);
+        shader.setFloat("radius", radius);
+        shader.setFloat("power", power);
+        bindTexture(1, m_Noise);
+        bindTexture(0, halfDepth);
+        draw();
+    }
+
+    void Blur(Shader& shader, GLuint occlusion) const {
+        shader.use();
+        shader.setInt("occlusion", 0);
+        bindTexture(0, occlusion);
+        draw();
+    }
+
+    // to the render size; depth and projection as for DownsampleDepth
+    void Upsample(Shader& shader, GLuint occlusion, GLuint depth, const glm::mat4& projection) const {
+        shader.use();
+        shader.setInt("occlusion", 0);
+        shader.setInt("depth", 1);
+        shader.setVec2("depthParams", depthParams(projection));
+        bindTexture(1, depth);
+        bindTexture(0, occlusion);
+        draw();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SSAO_H
@@ -0,0 +1,243 @@
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include <rg/Error.h>
+#include <rg/GLExt.h>
+
+#include <cstddef>
+
+namespace rg {
+
+// Ring buffer for data that is rewritten every frame. The buffer is split into one region per
+// frame in flight. With GL_ARB_buffer_storage it is mapped once, persistently, and a fence per
+// region keeps us from overwriting data the GPU may still read. Plain GL 3.3 maps each region
+// unsynchronized instead and orphans the whole buffer when the ring wraps around.
+class StreamBuffer {
+public:
+    static const int FramesInFlight = 3;
+
+private:
+    GLenum m_Target = GL_ARRAY_BUFFER;
+    GLuint m_Buffer = 0;
+    size_t m_RegionSize = 0;
+    int m_Region = 0;
+    bool m_Persistent = false;
+    bool m_Mapped = false;
+    char* m_PersistentBase = nullptr;
+    GLsync m_Fences[FramesInFlight] = {};
+
+    void waitForRegion(int region) {
+        GLsync fence = m_Fences[region];
+        if (!fence)
+            return;
+        GLbitfield flags = 0;
+        GLuint64 timeout = 0;
+        while (true) {
+            GLenum result = glClientWaitSync(fence, flags, timeout);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+                break;
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            timeout = 1000000; // 1ms
+        }
+        glDeleteSync(fence);
+        m_Fences[region] = nullptr;
+    }
+
+public:
+    StreamBuffer() = default;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer() {
+        Destroy();
+    }
+
+    void Create(GLenum target, size_t regionSize, bool allowPersistent = true) {
+        Destroy();
+        m_Target = target;
+        m_RegionSize = regionSize;
+        m_Region = 0;
+        m_Persistent = allowPersistent && glext().bufferStorage;
+
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(m_Target, m_Buffer);
+        size_t totalSize = m_RegionSize * FramesInFlight;
+        if (m_Persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glext().BufferStorage(m_Target, (GLsizeiptr)totalSize, nullptr, flags);
+            m_PersistentBase = (char*)glMapBufferRange(m_Target, 0, (GLsizeiptr)totalSize, flags);
+            ASSERT(m_PersistentBase, "Failed to persistently map the stream buffer");
+        } else {
+            glBufferData(m_Target, (GLsizeiptr)totalSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(m_Target, 0);
+    }
+
+    void Destroy() {
+        if (!m_Buffer)
+            return;
+        for (GLsync& fence : m_Fences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (m_Persistent) {
+            glBindBuffer(m_Target, m_Buffer);
+            glUnmapBuffer(m_Target);
+            glBindBuffer(m_Target, 0);
+        }
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+        m_PersistentBase = nullptr;
+    }
+
+    // returns a write pointer to the region of the current frame, valid until Unmap
+    void* Map() {
+        if (m_Persistent) {
+            waitForRegion(m_Region);
+            m_Mapped = true;
+            return m_PersistentBase + Offset();
+        }
+        glBindBuffer(m_Target, m_Buffer);
+        if (m_Region == 0) {
+            // orphan: the driver hands us fresh storage while the GPU keeps reading the old one
+            glBufferData(m_Target, (GLsizeiptr)(m_RegionSize * FramesInFlight), nullptr, GL_STREAM_DRAW);
+        }
+        void* data = glMapBufferRange(m_Target, (GLintptr)Offset(), (GLsizeiptr)m_RegionSize,
+                                      GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(m_Target, 0);
+        m_Mapped = data != nullptr;
+        return data;
+    }
+
+    // must be called before drawing with the data written this frame
+    void Unmap() {
+        if (!m_Mapped)
+            return;
+        m_Mapped = false;
+        if (m_Persistent)
+            return; // coherent mapping, nothing to flush
+        glBindBuffer(m_Target, m_Buffer);
+        glUnmapBuffer(m_Target);
+        glBindBuffer(m_Target, 0);
+    }
+
+    // call after the last draw reading this frame's region
+    void EndFrame() {
+        if (m_Persistent)
+            m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_Region = (m_Region + 1) % FramesInFlight;
+    }
+
+    // byte offset of the current frame's region in the buffer
+    size_t Offset() const {
+        return m_RegionSize * (size_t)m_Region;
+    }
+
+    size_t RegionSize() const {
+        return m_RegionSize;
+    }
+
+    GLuint Buffer() const {
+        return m_Buffer;
+    }
+
+    bool Persistent() const {
+        return m_Persistent;
+    }
+};
+
+// A StreamBuffer read by shaders as a buffer texture. The texture spans the regions of every frame in
+// flight, so shaders add FirstTexel() of the current frame to the indices they fetch.
+class StreamTexture {
+    StreamBuffer m_Stream;
+    GLuint m_Texture = 0;
+    GLenum m_Format = GL_RGBA32F;
+    size_t m_TexelSize = 16;
+    size_t m_Capacity = 0;
+    size_t m_MaxCapacity = 0;
+    size_t m_FirstTexel = 0;
+
+    void allocate(size_t capacity) {
+        m_Capacity = capacity;
+        m_Stream.Create(GL_TEXTURE_BUFFER, m_Capacity * m_TexelSize);
+        glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, m_Format, m_Stream.Buffer());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+public:
+    // format is the sized internal format of one texel (GL_RGBA32F, GL_R16UI, ...), capacity is in texels per frame
+    void Create(GLenum format, size_t texelSize, size_t capacity) {
+        m_Format = format;
+        m_TexelSize = texelSize;
+        GLint maxTexels = 65536;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        // a multiple of 64 texels, so records of several texels never straddle a region boundary
+        m_MaxCapacity = (size_t)maxTexels / StreamBuffer::FramesInFlight / 64 * 64;
+        glGenTextures(1, &m_Texture);
+        allocate(capacity < m_MaxCapacity ? capacity : m_MaxCapacity);
+    }
+
+    void Destroy() {
+        m_Stream.Destroy();
+        if (m_Texture)
+            glDeleteTextures(1, &m_Texture);
+        m_Texture = 0;
+    }
+
+    // Maps room for count texels of this frame, growing the buffer first if needed. count is clamped
+    // to what the hardware supports; when the buffer had to grow, earlier frames' data is gone.
+    void* Begin(size_t& count) {
+        if (count > m_Capacity) {
+            size_t capacity = m_Capacity;
+            while (capacity < count && capacity < m_MaxCapacity)
+                capacity *= 2;
+            if (capacity > m_MaxCapacity)
+                capacity = m_MaxCapacity;
+            if (capacity != m_Capacity)
+                allocate(capacity);
+            if (count > m_Capacity)
+                count = m_Capacity;
+        }
+        m_FirstTexel = m_Stream.Offset() / m_TexelSize;
+        return m_Stream.Map();
+    }
+
+    void End() {
+        m_Stream.Unmap();
+    }
+
+    // after the last draw reading this frame's texels
+    void EndFrame() {
+        m_Stream.EndFrame();
+    }
+
+    void Bind(GLuint unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t FirstTexel() const {
+        return m_FirstTexel;
+    }
+
+    size_t Capacity() const {
+        return m_Capacity;
+    }
+
+    // the most texels per frame the hardware supports for one buffer texture
+    size_t MaxCapacity() const {
+        return m_MaxCapacity;
+    }
+
+    bool Persistent() const {
+        return m_Stream.Persistent();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
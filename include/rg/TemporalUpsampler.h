@@ -0,0 +1,161 @@
+#ifndef PROJECT_BASE_TEMPORALUPSAMPLER_H
+#define PROJECT_BASE_TEMPORALUPSAMPLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/RenderTargetPool.h>
+
+namespace rg {
+
+// Temporal upsampling. The scene renders with a sub-pixel offset that cycles through a Halton (2, 3)
+// sequence, at the render size, and the resolve pass accumulates these frames into a history at the
+// output size, see temporal_resolve.fs. Each output pixel filters this frame's samples around it, then
+// blends in the history reprojected to where the pixel's surface was last frame, clamped to the colour
+// range of this frame's samples so disocclusions and changed shading don't ghost. Where a sample of this
+// frame landed right on the pixel it counts for more.
+//
+// The reprojection is the camera's, from the depth buffer, plus an object motion target that the
+// motion vector pass writes for objects that moved, see motion_vectors.fs. Static surfaces leave it at 0.
+//
+// The two history targets come from the render target pool and are kept across frames. They have the
+// output size, so a changing render scale keeps the history; a resize starts it over.
+class TemporalUpsampler {
+public:
+    static const unsigned JitterPhases = 8;
+    static const GLenum HistoryFormat = GL_RGBA16F;
+    static const GLenum MotionFormat = GL_RG16F;
+
+    // units Resolve binds its inputs to
+    static const GLuint SceneUnit = 0;
+    static const GLuint DepthUnit = 1;
+    static const GLuint MotionUnit = 2;
+    static const GLuint HistoryUnit = 3;
+
+private:
+    GLuint m_History[2] = {};
+    int m_Width = 0, m_Height = 0;
+    int m_Current = 0;
+    bool m_HistoryValid = false;
+    unsigned m_Frame = 0;
+    GLuint m_VAO = 0;
+    // scene texels this frame's geometry is shifted by
+    glm::vec2 m_Jitter = glm::vec2(0.0f);
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f), m_PreviousViewProjection = glm::mat4(1.0f);
+
+    static float halton(unsigned index, unsigned base) {
+        float result = 0.0f, fraction = 1.0f;
+        while (index > 0) {
+            fraction /= (float)base;
+            result += fraction * (float)(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+public:
+    // call once per program that resolves
+    static void SetSamplers(Shader& shader) {
+        shader.use();
+        shader.setInt("scene", SceneUnit);
+        shader.setInt("sceneDepth", DepthUnit);
+        shader.setInt("objectMotion", MotionUnit);
+        shader.setInt("history", HistoryUnit);
+    }
+
+    // the output size, the window's; the history starts over when it changes
+    void Resize(RenderTargetPool& pool, int width, int height) {
+        if (width == m_Width && height == m_Height)
+            return;
+        Destroy(pool);
+        m_Width = width;
+        m_Height = height;
+        for (GLuint& history : m_History)
+            history = pool.Acquire(RenderTargetDesc(width, height, HistoryFormat));
+        if (!m_VAO)
+            glGenVertexArrays(1, &m_VAO);
+    }
+
+    void Destroy(RenderTargetPool& pool) {
+        for (GLuint& history : m_History) {
+            if (history)
+                pool.Release(history);
+            history = 0;
+        }
+        if (m_VAO)
+            glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+        m_Width = m_Height = 0;
+        m_HistoryValid = false;
+    }
+
+    // the next resolve starts from this frame alone, for frames that skipped it or cut the camera
+    void Invalidate() {
+        m_HistoryValid = false;
+    }
+
+    // Once per frame that resolves, before drawing: projection with this frame's sub-pixel offset at the
+    // render size. projection and view are this frame's unjittered ones, kept for the reprojection.
+    glm::mat4 BeginFrame(const glm::mat4& projection, const glm::mat4& view, int renderWidth, int renderHeight) {
+        m_ViewProjection = projection * view;
+        if (!m_HistoryValid)
+            m_PreviousViewProjection = m_ViewProjection;
+        ++m_Frame;
+        unsigned phase = m_Frame % JitterPhases + 1; // the sequence's index 0 is the origin
+        m_Jitter = glm::vec2(halton(phase, 2) - 0.5f, halton(phase, 3) - 0.5f);
+        // the third column scales with view depth, which the perspective divide takes back out: this
+        // shifts every vertex by the same fraction of a pixel
+        glm::mat4 jittered = projection;
+        jittered[2][0] -= m_Jitter.x * 2.0f / (float)renderWidth;
+        jittered[2][1] -= m_Jitter.y * 2.0f / (float)renderHeight;
+        return jittered;
+    }
+
+    // what the motion vector pass projects both positions with
+    const glm::mat4& PreviousViewProjection() const {
+        return m_PreviousViewProjection;
+    }
+
+    // written by this frame's resolve
+    GLuint Output() const {
+        return m_History[m_Current];
+    }
+
+    RenderTargetDesc OutputDesc() const {
+        return RenderTargetDesc(m_Width, m_Height, HistoryFormat);
+    }
+
+    // Draws the resolve into the bound framebuffer, which has Output attached and the output size as its
+    // viewport. scene, depth and motion are this frame's, at the render size.
+    void Resolve(Shader& resolve, GLuint scene, GLuint depth, GLuint motion, int renderWidth, int renderHeight) const {
+        const GLuint textures[4] = {scene, depth, motion, m_History[1 - m_Current]};
+        const GLuint units[4] = {SceneUnit, DepthUnit, MotionUnit, HistoryUnit};
+        for (int i = 0; i < 4; ++i) {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        resolve.use();
+        resolve.setVec2("sceneSize", (float)renderWidth, (float)renderHeight);
+        resolve.setVec2("jitter", m_Jitter.x, m_Jitter.y);
+        resolve.setMat4("reprojection", m_PreviousViewProjection * glm::inverse(m_ViewProjection));
+        resolve.setFloat("historyValid", m_HistoryValid ? 1.0f : 0.0f);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // after the resolve ran: its output is the next frame's history
+    void EndFrame() {
+        m_Current = 1 - m_Current;
+        m_HistoryValid = true;
+        m_PreviousViewProjection = m_ViewProjection;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TEMPORALUPSAMPLER_H
@@ -0,0 +1,248 @@
+#ifndef PROJECT_BASE_TRANSPARENCY_H
+#define PROJECT_BASE_TRANSPARENCY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/JobSystem.h>
+#include <rg/Scene.h>
+#include <rg/StreamBuffer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rg {
+
+struct TransparencyStats {
+    unsigned instanceCount = 0;
+    unsigned visibleCount = 0;
+    unsigned drawCalls = 0;
+    double sortMs = 0.0;
+};
+
+// Gathers every blended or alpha-tested card (grass, foliage) of the frame, sorts the visible ones back
+// to front by view depth and draws them from a per-instance buffer, one instanced call per run of cards
+// sharing a texture. Keys are sorted with a radix sort, so the CPU cost stays linear in the card count.
+class TransparentCards {
+public:
+    struct Instance {
+        glm::vec3 position;
+        float scale;
+        uint32_t batch;
+    };
+
+private:
+    // xyz: position, w: scale, as read by transparent.vs at location 2
+    struct InstanceData {
+        glm::vec4 positionScale;
+    };
+
+    std::vector<GLuint> m_BatchTextures;
+    std::vector<Instance> m_Instances;
+    std::vector<uint32_t> m_Keys, m_KeysTmp;
+    std::vector<uint32_t> m_Order, m_OrderTmp;
+    std::vector<unsigned> m_ChunkVisible;
+    StreamBuffer m_InstanceBuffer;
+    size_t m_Capacity = 0;
+    GLuint m_VAO = 0, m_VBO = 0;
+    GLsizei m_VertexCount = 0;
+    // bounding sphere of the card at scale 1, relative to its position
+    glm::vec3 m_BoundsCenter = glm::vec3(0.0f);
+    float m_BoundsRadius = 1.0f;
+    TransparencyStats m_Stats;
+
+    // float -> unsigned int with the same ordering, then flipped so that far cards come first
+    static uint32_t backToFrontKey(float viewDepth) {
+        uint32_t bits;
+        std::memcpy(&bits, &viewDepth, sizeof(bits));
+        bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        return ~bits;
+    }
+
+    // LSD radix sort of (key, index) pairs, 8 bits per pass
+    void radixSort(size_t count) {
+        m_KeysTmp.resize(count);
+        m_OrderTmp.resize(count);
+        uint32_t* keys = m_Keys.data();
+        uint32_t* order = m_Order.data();
+        uint32_t* keysOut = m_KeysTmp.data();
+        uint32_t* orderOut = m_OrderTmp.data();
+        for (int shift = 0; shift < 32; shift += 8) {
+            size_t histogram[256] = {};
+            for (size_t i = 0; i < count; ++i)
+                ++histogram[(keys[i] >> shift) & 0xff];
+            if (histogram[(keys[0] >> shift) & 0xff] == count)
+                continue; // every key shares this byte
+            size_t offset = 0;
+            for (size_t& bucket : histogram) {
+                size_t size = bucket;
+                bucket = offset;
+                offset += size;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t destination = histogram[(keys[i] >> shift) & 0xff]++;
+                keysOut[destination] = keys[i];
+                orderOut[destination] = order[i];
+            }
+            std::swap(keys, keysOut);
+            std::swap(order, orderOut);
+        }
+        if (keys != m_Keys.data()) {
+            std::memcpy(m_Keys.data(), keys, count * sizeof(uint32_t));
+            std::memcpy(m_Order.data(), order, count * sizeof(uint32_t));
+        }
+    }
+
+    void allocate(size_t capacity) {
+        m_Capacity = capacity;
+        m_InstanceBuffer.Create(GL_ARRAY_BUFFER, m_Capacity * sizeof(InstanceData));
+    }
+
+public:
+    // vertices: interleaved position (3) and texture coordinates (2) of one card, drawn as triangles
+    void Create(const float* vertices, size_t vertexCount) {
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * 5 * sizeof(float), vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)nullptr);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+        m_VertexCount = (GLsizei)vertexCount;
+        // around the centre of the card's box, the card need not be centred on its position
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (size_t i = 0; i < vertexCount; ++i) {
+            glm::vec3 p(vertices[i * 5], vertices[i * 5 + 1], vertices[i * 5 + 2]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        m_BoundsCenter = (lo + hi) * 0.5f;
+        m_BoundsRadius = glm::length(hi - lo) * 0.5f;
+        allocate(1024);
+    }
+
+    void Destroy() {
+        m_InstanceBuffer.Destroy();
+        if (m_VAO) {
+            glDeleteVertexArrays(1, &m_VAO);
+            glDeleteBuffers(1, &m_VBO);
+        }
+        m_VAO = m_VBO = 0;
+    }
+
+    uint32_t AddBatch(GLuint texture) {
+        m_BatchTextures.push_back(texture);
+        return (uint32_t)(m_BatchTextures.size() - 1);
+    }
+
+    void Add(uint32_t batch, const glm::vec3& position, float scale = 1.0f) {
+        m_Instances.push_back(Instance{position, scale, batch});
+    }
+
+    // drops every card added after the first count ones
+    void Truncate(size_t count) {
+        if (count < m_Instances.size())
+            m_Instances.resize(count);
+    }
+
+    size_t Count() const {
+        return m_Instances.size();
+    }
+
+    const TransparencyStats& Stats() const {
+        return m_Stats;
+    }
+
+    // culls, sorts and uploads the cards, then draws them with the currently bound shader
+    void Draw(JobSystem& jobs, const glm::mat4& view, const glm::mat4& projection) {
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t count = m_Instances.size();
+        m_Stats = TransparencyStats();
+        m_Stats.instanceCount = (unsigned)count;
+        if (count == 0)
+            return;
+
+        // view depth keys, cards outside the frustum get the largest key and end up past the visible ones
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        const size_t grainSize = 2048;
+        m_Keys.resize(count);
+        m_Order.resize(count);
+        m_ChunkVisible.assign((count + grainSize - 1) / grainSize, 0);
+        jobs.ParallelFor(count, grainSize, [&](size_t begin, size_t end) {
+            unsigned visible = 0;
+            for (size_t i = begin; i < end; ++i) {
+                const Instance& card = m_Instances[i];
+                m_Order[i] = (uint32_t)i;
+                glm::vec3 center = card.position + m_BoundsCenter * card.scale;
+                if (!frustum.IntersectsSphere(center, m_BoundsRadius * card.scale)) {
+                    m_Keys[i] = 0xffffffffu;
+                    continue;
+                }
+                glm::vec3 viewPosition = glm::vec3(view * glm::vec4(card.position, 1.0f));
+                m_Keys[i] = std::min(backToFrontKey(-viewPosition.z), 0xfffffffeu);
+                ++visible;
+            }
+            m_ChunkVisible[begin / grainSize] = visible;
+        });
+        size_t visibleCount = 0;
+        for (unsigned visible : m_ChunkVisible)
+            visibleCount += visible;
+        m_Stats.visibleCount = (unsigned)visibleCount;
+        if (visibleCount == 0)
+            return;
+        radixSort(count);
+
+        // per-instance data in sorted order
+        if (visibleCount > m_Capacity) {
+            size_t capacity = m_Capacity;
+            while (capacity < visibleCount)
+                capacity *= 2;
+            allocate(capacity);
+        }
+        InstanceData* data = (InstanceData*)m_InstanceBuffer.Map();
+        if (!data)
+            return;
+        jobs.ParallelFor(visibleCount, grainSize, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Instance& card = m_Instances[m_Order[i]];
+                data[i].positionScale = glm::vec4(card.position, card.scale);
+            }
+        });
+        m_InstanceBuffer.Unmap();
+        auto stop = std::chrono::high_resolution_clock::now();
+        m_Stats.sortMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        // one instanced draw per run of cards that share a texture
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer.Buffer());
+        glActiveTexture(GL_TEXTURE0);
+        size_t runStart = 0;
+        while (runStart < visibleCount) {
+            uint32_t batch = m_Instances[m_Order[runStart]].batch;
+            size_t runEnd = runStart + 1;
+            while (runEnd < visibleCount && m_Instances[m_Order[runEnd]].batch == batch)
+                ++runEnd;
+            size_t offset = m_InstanceBuffer.Offset() + runStart * sizeof(InstanceData);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+            glBindTexture(GL_TEXTURE_2D, m_BatchTextures[batch]);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, m_VertexCount, (GLsizei)(runEnd - runStart));
+            ++m_Stats.drawCalls;
+            runStart = runEnd;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        m_InstanceBuffer.EndFrame();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TRANSPARENCY_H
@@ -0,0 +1,28 @@
+#version 330 core
+out float AdaptedLuminance;
+
+// see rg::AutoExposure
+uniform sampler2D logLuminance;
+uniform sampler2D previousLuminance;
+uniform float lastLevel;
+uniform float deltaTime;
+uniform float speedUp;
+uniform float speedDown;
+uniform float minLuminance;
+uniform float maxLuminance;
+uniform float previousValid;
+
+void main()
+{
+    // the 1x1 mip holds the means of the weighted log luminance and of the weights
+    vec2 mean = textureLod(logLuminance, vec2(0.5), lastLevel).rg;
+    float target = clamp(exp2(mean.x / max(mean.y, 1e-4)), minLuminance, maxLuminance);
+    if (previousValid == 0.0) {
+        AdaptedLuminance = target;
+        return;
+    }
+    // eases in exponentially, frame rate independent
+    float previous = texelFetch(previousLuminance, ivec2(0), 0).r;
+    float speed = target > previous ? speedUp : speedDown;
+    AdaptedLuminance = previous + (target - previous) * (1.0 - exp(-deltaTime * speed));
+}
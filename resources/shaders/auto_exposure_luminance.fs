@@ -0,0 +1,21 @@
+#version 330 core
+out vec2 WeightedLogLuminance;
+
+in vec2 TexCoords;
+
+// see rg::AutoExposure
+uniform sampler2D scene;
+
+void main()
+{
+    // four bilinear taps spread over this texel's share of the scene
+    vec2 spread = 0.25 / vec2(256.0);
+    vec3 color = texture(scene, TexCoords + vec2(-spread.x, -spread.y)).rgb +
+                 texture(scene, TexCoords + vec2(spread.x, -spread.y)).rgb +
+                 texture(scene, TexCoords + vec2(-spread.x, spread.y)).rgb +
+                 texture(scene, TexCoords + vec2(spread.x, spread.y)).rgb;
+    float luminance = dot(color * 0.25, vec3(0.2126, 0.7152, 0.0722));
+    // what is in the middle of the screen counts for more than the edges
+    float weight = 1.0 - 0.75 * smoothstep(0.2, 0.7, length(TexCoords - 0.5));
+    WeightedLogLuminance = vec2(log2(max(luminance, 1e-5)) * weight, weight);
+}
@@ -5,25 +5,61 @@ in vec2 TexCoords;
 
 uniform sampler2D scene;
 uniform sampler2D bloomBlur;
-uniform bool bloom;
 uniform float exposure;
+uniform float bloomIntensity;
+
+#ifdef AUTO_EXPOSURE
+// 1x1, the scene's adapted luminance, see rg::AutoExposure; it is exposed to come out at exposureKey
+uniform sampler2D adaptedLuminance;
+uniform float exposureKey;
+#endif
+
+#ifdef COLOR_LUT
+// tone curve, grade and gamma, indexed by the log2 of the exposed colour, see rg::ColorGrading
+uniform sampler3D colorLut;
+uniform float lutScale;
+uniform float lutOffset;
+#endif
+
+#ifdef UPSCALE
+#include "catmull_rom.glsl"
+
+// the scene rendered below the window's size, in texels
+uniform vec2 sceneSize;
+#endif
 
 void main()
 {
     const float gamma = 1.3;
+#ifdef UPSCALE
+    vec3 hdrColor = SampleCatmullRom(scene, TexCoords, sceneSize);
+#else
     vec3 hdrColor = texture(scene, TexCoords).rgb;
+#endif
     vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
 
-    if(bloom){
-        hdrColor += bloomColor; // additive blending
-        // tone mapping
-        vec3 result = vec3(1.0) - exp(-hdrColor * exposure);
-        //vec3 result = hdrColor/(hdrColor + vec3(1.0));
-        // gamma correct
-        result = pow(result, vec3(1.0 / gamma));
+#if defined(BLOOM) || defined(AUTO_EXPOSURE) || defined(COLOR_LUT)
+#ifdef BLOOM
+    hdrColor += bloomColor * bloomIntensity; // additive blending
+#endif
+#ifdef AUTO_EXPOSURE
+    float sceneExposure = exposureKey / max(texelFetch(adaptedLuminance, ivec2(0), 0).r, 1e-4);
+#else
+    float sceneExposure = exposure;
+#endif
+#ifdef COLOR_LUT
+    vec3 logColor = log2(max(hdrColor * sceneExposure, vec3(1e-6)));
+    vec3 result = texture(colorLut, logColor * lutScale + lutOffset).rgb;
+#else
+    // tone mapping
+    vec3 result = vec3(1.0) - exp(-hdrColor * sceneExposure);
+    //vec3 result = hdrColor/(hdrColor + vec3(1.0));
+    // gamma correct
+    result = pow(result, vec3(1.0 / gamma));
+#endif
     FragColor = vec4(result, 1.0);
-    }else{
+#else
     vec3 result = pow(hdrColor, vec3(1.0/gamma));
     FragColor = vec4(result,1.0);
-    }
+#endif
 }
\ No newline at end of file
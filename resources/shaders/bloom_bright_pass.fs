@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "bloom_filters.glsl"
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+uniform float threshold;
+uniform float knee;
+uniform float emissive;
+
+void main()
+{
+    // scene colour with 1 - alpha as the emissive coverage
+    vec4 scene = Downsample13(source, TexCoords, sourceTexel);
+    float brightness = max(scene.r, max(scene.g, scene.b));
+    // quadratic ease from threshold - knee up to threshold + knee, linear above
+    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 1e-4);
+    float weight = max(soft, brightness - threshold) / max(brightness, 1e-4);
+    // emissive surfaces glow at any brightness
+    weight = max(weight, (1.0 - clamp(scene.a, 0.0, 1.0)) * emissive);
+    FragColor = vec4(scene.rgb * weight, 1.0);
+}
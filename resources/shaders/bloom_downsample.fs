@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "bloom_filters.glsl"
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+
+void main()
+{
+    FragColor = vec4(Downsample13(source, TexCoords, sourceTexel).rgb, 1.0);
+}
@@ -0,0 +1,34 @@
+// Filters of rg::BloomChain. texel is the size of one texel of the source.
+
+// 13 bilinear fetches over a 6x6 texel footprint, weighted as four overlapping 4x4 boxes around the
+// centre one. Halves the resolution without the flicker a plain 2x2 box shows on small bright spots.
+// Alpha is filtered along, the bright pass reads its emissive mask from it.
+vec4 Downsample13(sampler2D source, vec2 uv, vec2 texel)
+{
+    vec4 a = texture(source, uv + texel * vec2(-2.0, 2.0));
+    vec4 b = texture(source, uv + texel * vec2(0.0, 2.0));
+    vec4 c = texture(source, uv + texel * vec2(2.0, 2.0));
+    vec4 d = texture(source, uv + texel * vec2(-2.0, 0.0));
+    vec4 e = texture(source, uv);
+    vec4 f = texture(source, uv + texel * vec2(2.0, 0.0));
+    vec4 g = texture(source, uv + texel * vec2(-2.0, -2.0));
+    vec4 h = texture(source, uv + texel * vec2(0.0, -2.0));
+    vec4 i = texture(source, uv + texel * vec2(2.0, -2.0));
+    vec4 j = texture(source, uv + texel * vec2(-1.0, 1.0));
+    vec4 k = texture(source, uv + texel * vec2(1.0, 1.0));
+    vec4 l = texture(source, uv + texel * vec2(-1.0, -1.0));
+    vec4 m = texture(source, uv + texel * vec2(1.0, -1.0));
+    return (j + k + l + m) * 0.125 + e * 0.125 + (a + c + g + i) * 0.03125 + (b + d + f + h) * 0.0625;
+}
+
+// 3x3 tent, radius in source texels
+vec3 UpsampleTent(sampler2D source, vec2 uv, vec2 texel, float radius)
+{
+    vec2 d = texel * radius;
+    vec3 sum = texture(source, uv).rgb * 4.0;
+    sum += (texture(source, uv + vec2(-d.x, 0.0)).rgb + texture(source, uv + vec2(d.x, 0.0)).rgb +
+            texture(source, uv + vec2(0.0, -d.y)).rgb + texture(source, uv + vec2(0.0, d.y)).rgb) * 2.0;
+    sum += texture(source, uv - d).rgb + texture(source, uv + d).rgb + texture(source, uv + vec2(-d.x, d.y)).rgb +
+           texture(source, uv + vec2(d.x, -d.y)).rgb;
+    return sum * (1.0 / 16.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "bloom_filters.glsl"
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+uniform float radius;
+
+void main()
+{
+    // added onto the larger level by the blend state
+    FragColor = vec4(UpsampleTent(source, TexCoords, sourceTexel, radius), 1.0);
+}
@@ -0,0 +1,39 @@
+#version 430 core
+
+// The same 9-tap Gaussian as blur.fs, one direction per variant (HORIZONTAL or not). A work group
+// filters a run of 128 texels along a row or column: the run and its 4 texel apron on each side are
+// fetched into shared memory once, and every tap is read from there.
+layout (local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
+
+const int Run = 128;
+const int Radius = 4;
+const float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
+
+uniform sampler2D image;
+layout (r11f_g11f_b10f, binding = 0) uniform writeonly image2D target;
+
+shared vec3 texels[Run + 2 * Radius];
+
+void main() {
+    ivec2 size = textureSize(image, 0);
+#ifdef HORIZONTAL
+    ivec2 axis = ivec2(1, 0);
+    ivec2 runStart = ivec2(int(gl_WorkGroupID.x) * Run, int(gl_WorkGroupID.y));
+#else
+    ivec2 axis = ivec2(0, 1);
+    ivec2 runStart = ivec2(int(gl_WorkGroupID.y), int(gl_WorkGroupID.x) * Run);
+#endif
+    int local = int(gl_LocalInvocationID.x);
+    // clamped at the edges, like the fragment path's sampler
+    for (int i = local; i < Run + 2 * Radius; i += Run)
+        texels[i] = texelFetch(image, clamp(runStart + axis * (i - Radius), ivec2(0), size - 1), 0).rgb;
+    barrier();
+
+    ivec2 texel = runStart + axis * local;
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+    vec3 result = texels[local + Radius] * weight[0];
+    for (int i = 1; i <= Radius; ++i)
+        result += (texels[local + Radius - i] + texels[local + Radius + i]) * weight[i];
+    imageStore(target, texel, vec4(result, 1.0));
+}
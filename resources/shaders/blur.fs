@@ -5,23 +5,22 @@ in vec2 TexCoords;
 
 uniform sampler2D image;
 
-uniform bool horizontal;
-uniform float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
+// The 9-tap Gaussian in 5 fetches: on each side, taps 1 and 2 and taps 3 and 4 are each merged into one
+// bilinear fetch placed between them by their weights. Compiled once per direction, HORIZONTAL or not.
+const float offset[3] = float[] (0.0, 1.3846153846, 3.2307692308);
+const float weight[3] = float[] (0.2270270270, 0.3162162162, 0.0702702703);
 
 void main() {
-    vec2 tex_offset = 1.0 / textureSize(image, 0);
+#ifdef HORIZONTAL
+    vec2 texelStep = vec2(1.0 / float(textureSize(image, 0).x), 0.0);
+#else
+    vec2 texelStep = vec2(0.0, 1.0 / float(textureSize(image, 0).y));
+#endif
     vec3 result = texture(image, TexCoords).rgb * weight[0];
-    if (horizontal) {
-        for (int i = 1; i < 5; ++i) {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-        }
-    } else {
-        for (int i = 1; i < 5; ++i) {
-            result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-        }
+    for (int i = 1; i < 3; ++i) {
+        result += texture(image, TexCoords + texelStep * offset[i]).rgb * weight[i];
+        result += texture(image, TexCoords - texelStep * offset[i]).rgb * weight[i];
     }
 
     FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+}
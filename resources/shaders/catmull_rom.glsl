@@ -0,0 +1,30 @@
+// Catmull-Rom bicubic from nine bilinear taps: the inner two texels of each axis' four share a tap whose
+// position splits them by their weights. Sharper than a bilinear fetch, for upscaling the scene and for
+// resampling the temporal history. size is the image's size in texels.
+vec3 SampleCatmullRom(sampler2D image, vec2 uv, vec2 size)
+{
+    vec2 samplePos = uv * size;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    vec2 pos0 = (texPos1 - 1.0) / size;
+    vec2 pos3 = (texPos1 + 2.0) / size;
+    vec2 pos12 = (texPos1 + w2 / w12) / size;
+
+    vec3 result = vec3(0.0);
+    result += texture(image, vec2(pos0.x, pos0.y)).rgb * w0.x * w0.y;
+    result += texture(image, vec2(pos12.x, pos0.y)).rgb * w12.x * w0.y;
+    result += texture(image, vec2(pos3.x, pos0.y)).rgb * w3.x * w0.y;
+    result += texture(image, vec2(pos0.x, pos12.y)).rgb * w0.x * w12.y;
+    result += texture(image, vec2(pos12.x, pos12.y)).rgb * w12.x * w12.y;
+    result += texture(image, vec2(pos3.x, pos12.y)).rgb * w3.x * w12.y;
+    result += texture(image, vec2(pos0.x, pos3.y)).rgb * w0.x * w3.y;
+    result += texture(image, vec2(pos12.x, pos3.y)).rgb * w12.x * w3.y;
+    result += texture(image, vec2(pos3.x, pos3.y)).rgb * w3.x * w3.y;
+    // the negative lobes ring below zero next to bright lights
+    return max(result, vec3(0.0));
+}
@@ -0,0 +1,45 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "lighting.glsl"
+
+in vec2 TexCoords;
+
+// G-buffer, see rg::GBuffer
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform mat4 view;
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard; // background, the skybox fills it later
+
+    // properties, the world position comes back from the depth buffer
+    vec4 clipPos = vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 worldPos = inverseViewProjection * clipPos;
+    vec3 FragPos = worldPos.xyz / worldPos.w;
+    float ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+    vec3 norm = DecodeNormal(normalShininess.xy);
+    float shininess = normalShininess.z * 256.0;
+    vec3 albedo = albedoSpecular.rgb;
+    vec3 specularColor = vec3(albedoSpecular.a);
+
+    vec3 result = Shade(FragPos, ViewDepth, norm, albedo, specularColor, shininess);
+    FragColor = vec4(result, 1.0);
+}
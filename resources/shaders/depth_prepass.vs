@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in int aDrawId;
+
+uniform samplerBuffer drawData;
+uniform mat4 view;
+uniform mat4 projection;
+
+// must produce bit-identical depth to the colour pass vertex shaders, which test against it with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    int record = aDrawId * 8;
+    mat4 model = mat4(texelFetch(drawData, record), texelFetch(drawData, record + 1),
+                      texelFetch(drawData, record + 2), texelFetch(drawData, record + 3));
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    gl_Position = projection * (view * worldPos);
+}
\ No newline at end of file
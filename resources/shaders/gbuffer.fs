@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormalShininess;
+
+#include "material.glsl"
+
+flat in float Shininess;
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector -> [0, 1]^2, the octahedron unfolded onto a square
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec3 albedo = SampleAlbedo();
+    gAlbedoSpecular = vec4(albedo, dot(SampleSpecular(), vec3(0.2126, 0.7152, 0.0722)));
+    gNormalShininess = vec4(EncodeNormal(SurfaceNormal()), clamp(Shininess / 256.0, 0.0, 1.0), 0.0);
+}
\ No newline at end of file
@@ -7,5 +7,6 @@ uniform sampler2D texture_diffuse1;
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
-}
\ No newline at end of file
+    // alpha 0 marks the lanterns as emissive for the bloom bright pass
+    FragColor = vec4(texture(texture_diffuse1, TexCoords).rgb, 0.0);
+}
@@ -2,15 +2,22 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in int aDrawId;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
+uniform samplerBuffer drawData;
 uniform mat4 view;
 uniform mat4 projection;
 
+invariant gl_Position;
+
 void main()
 {
-    TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    int record = aDrawId * 8;
+    mat4 model = mat4(texelFetch(drawData, record), texelFetch(drawData, record + 1),
+                      texelFetch(drawData, record + 2), texelFetch(drawData, record + 3));
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    TexCoords = aTexCoords;
+    gl_Position = projection * (view * worldPos);
 }
\ No newline at end of file
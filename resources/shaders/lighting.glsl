@@ -0,0 +1,214 @@
+// Directional and clustered point/spot lighting shared by the forward and deferred paths.
+//  FOG: darken the ground with distance from the scene's centre
+//  SHADOWS: cascaded shadow map of the directional light, atlas of point and spot light shadow faces
+//  LIGHTMAP: baked irradiance of the static lanterns for objects with a lightmap region (forward only)
+//  AMBIENT_OCCLUSION: the sky's ambient darkened by rg::Ssao's occlusion at the fragment's pixel
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform vec3 viewPos;
+uniform DirLight dirLight;
+// L2 spherical harmonics of the skybox, convolved with the cosine lobe, see rg::SkyIrradiance
+uniform vec3 skyIrradiance[9];
+
+// clustered point and spot lights, see rg::ClusteredLights
+uniform samplerBuffer lightData;     // 6 texels per light, see rg::LightRecord
+uniform usamplerBuffer clusterGrid;  // (offset, count) into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterBase;           // first texel of this frame in lightData, clusterGrid, lightIndices
+uniform ivec3 clusterDims;           // tiles x, tiles y, depth slices
+uniform vec2 clusterTileSize;        // in pixels
+uniform vec2 clusterSliceScaleBias;  // slice = log(depth) * x + y
+
+#ifdef SHADOWS
+// cascaded shadow map of dirLight, see rg::CascadedShadowMap
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 shadowMatrices[3];      // world -> atlas coordinates and depth, per cascade
+uniform vec3 cascadeSplits;          // view depth where each cascade ends
+uniform vec3 cascadeTexelSizes;      // world size of a shadow texel, per cascade
+uniform vec2 shadowAtlasTexel;
+
+// fraction of the directional light reaching fragPos, four bilinear comparison taps
+float DirShadow(vec3 fragPos, float viewDepth, vec3 normal)
+{
+    if (viewDepth >= cascadeSplits.z)
+        return 1.0;
+    int cascade = viewDepth < cascadeSplits.x ? 0 : (viewDepth < cascadeSplits.y ? 1 : 2);
+    // look up a little off the surface, against shadow acne
+    vec3 offsetPos = fragPos + normal * (cascadeTexelSizes[cascade] * 1.5);
+    vec3 shadowPos = (shadowMatrices[cascade] * vec4(offsetPos, 1.0)).xyz;
+    float lit = 0.0;
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            lit += texture(shadowAtlas, vec3(shadowPos.xy + (vec2(x, y) - 0.5) * shadowAtlasTexel, shadowPos.z));
+    return lit * 0.25;
+}
+
+// point and spot light shadow faces, see rg::LightShadowAtlas
+uniform sampler2DShadow lightShadowAtlas;
+uniform mat4 lightShadowMatrices[24]; // world -> atlas coordinates and depth, per face
+uniform vec2 lightShadowTexel;
+
+// fraction of a light reaching fragPos; point lights pick one of their six faces by the major axis
+float LightShadow(int face, bool pointLight, vec3 toFrag, vec3 fragPos, vec3 normal, float texelAngle)
+{
+    if (pointLight) {
+        vec3 axis = abs(toFrag);
+        if (axis.x >= axis.y && axis.x >= axis.z)
+            face += toFrag.x > 0.0 ? 0 : 1;
+        else if (axis.y >= axis.z)
+            face += toFrag.y > 0.0 ? 2 : 3;
+        else
+            face += toFrag.z > 0.0 ? 4 : 5;
+    }
+    // the offset against acne grows with the distance, like the texels do
+    vec3 offsetPos = fragPos + normal * (length(toFrag) * texelAngle * 1.5);
+    vec4 shadowPos = lightShadowMatrices[face] * vec4(offsetPos, 1.0);
+    shadowPos.xyz /= shadowPos.w;
+    // stay inside the face's tile, the hardware filter reads one texel around the sample
+    vec2 tileSize = 1.0 / vec2(6.0, 4.0);
+    vec2 tile = vec2(face % 6, face / 6) * tileSize;
+    shadowPos.xy = clamp(shadowPos.xy, tile + lightShadowTexel, tile + tileSize - lightShadowTexel);
+    return texture(lightShadowAtlas, shadowPos.xyz);
+}
+#endif
+
+#ifdef LIGHTMAP
+// rg::Lightmaps, the region was resolved to atlas coordinates in model_lighting.vs
+uniform sampler2D lightmap;
+in vec2 LightmapUV;
+flat in int Lightmapped;
+#endif
+
+#ifdef AMBIENT_OCCLUSION
+// at the render size, the lit passes' viewport
+uniform sampler2D ambientOcclusion;
+#endif
+
+// ambient light reflected by a diffuse surface facing normal, lit by the whole sky
+vec3 SkyAmbient(vec3 n)
+{
+    return skyIrradiance[0] * 0.282095
+         + skyIrradiance[1] * (0.488603 * n.y) + skyIrradiance[2] * (0.488603 * n.z) + skyIrradiance[3] * (0.488603 * n.x)
+         + skyIrradiance[4] * (1.092548 * n.x * n.y) + skyIrradiance[5] * (1.092548 * n.y * n.z)
+         + skyIrradiance[6] * (0.315392 * (3.0 * n.z * n.z - 1.0)) + skyIrradiance[7] * (1.092548 * n.x * n.z)
+         + skyIrradiance[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+}
+
+// calculates the color when using a directional light plus the sky's ambient, shadow scales everything but
+// the ambient term.
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 FragPos, vec3 albedo, vec3 specularColor, float shininess,
+                  float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(viewDir, halfwayDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = max(SkyAmbient(normal), vec3(0.0)) * albedo;
+#ifdef AMBIENT_OCCLUSION
+    ambient *= texelFetch(ambientOcclusion, ivec2(gl_FragCoord.xy), 0).r;
+#endif
+    vec3 diffuse = light.diffuse * diff * albedo;
+    vec3 specular = light.specular * spec * specularColor;
+
+    vec3 result = ambient + (diffuse + specular) * shadow;
+
+#ifdef FOG
+    if(FragPos.y < 1.0){
+        float dist = length(FragPos);
+
+        result.x -= (result.x*pow(dist,1.75))/940.0;
+        result.y -= (result.y*pow(dist,1.75))/940.0;
+        result.z -= (result.z*pow(dist,1.75))/940.0;
+
+        if(dist>50.0) result = vec3(0.0, 0.0, 0.0);
+    }
+#endif
+
+    return (result);
+}
+
+// calculates the color of a point or spot light, point lights have cone cosines below -1; their ambient
+// is left to the sky's
+vec3 CalcLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+    int base = clusterBase.x + light * 6;
+    vec4 positionRange = texelFetch(lightData, base);
+    vec4 diffuseConstant = texelFetch(lightData, base + 1);
+    vec4 specularLinear = texelFetch(lightData, base + 2);
+    vec4 ambientQuadratic = texelFetch(lightData, base + 3);
+    vec4 directionCutOff = texelFetch(lightData, base + 4);
+    vec4 outerCutOffShadow = texelFetch(lightData, base + 5);
+    float outerCutOff = outerCutOffShadow.x;
+
+    vec3 lightDir = normalize(positionRange.xyz - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // attenuation, faded to zero at the light's range so the cluster bounds don't show
+    float distance = length(positionRange.xyz - fragPos);
+    float attenuation = 1.0 / (diffuseConstant.w + specularLinear.w * distance + ambientQuadratic.w * (distance * distance));
+    float falloff = distance / positionRange.w;
+    falloff *= falloff;
+    float window = clamp(1.0 - falloff * falloff, 0.0, 1.0);
+    attenuation *= window * window;
+    // spotlight intensity
+    float theta = dot(lightDir, -directionCutOff.xyz);
+    float epsilon = directionCutOff.w - outerCutOff;
+    float intensity = clamp((theta - outerCutOff) / epsilon, 0.0, 1.0);
+    float shadow = 1.0;
+#ifdef SHADOWS
+    int shadowFace = int(outerCutOffShadow.y);
+    if (shadowFace >= 0)
+        shadow = LightShadow(shadowFace, directionCutOff.w < -1.0, fragPos - positionRange.xyz, fragPos, normal,
+                             outerCutOffShadow.z);
+#endif
+    // combine results
+    vec3 diffuse = diffuseConstant.rgb * diff * albedo;
+    vec3 specular = specularLinear.rgb * spec * specularColor;
+    return (diffuse + specular) * shadow * attenuation * intensity;
+}
+
+// the directional light plus every light of the cluster this fragment falls into
+vec3 Shade(vec3 fragPos, float viewDepth, vec3 normal, vec3 albedo, vec3 specularColor, float shininess)
+{
+    vec3 viewDir = normalize(viewPos - fragPos);
+    // phase 1: directional lighting
+#ifdef SHADOWS
+    float shadow = DirShadow(fragPos, viewDepth, normal);
+#else
+    float shadow = 1.0;
+#endif
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, fragPos, albedo, specularColor, shininess, shadow);
+    // phase 2: point and spot lights of this fragment's cluster
+    int slice = clamp(int(log(viewDepth) * clusterSliceScaleBias.x + clusterSliceScaleBias.y), 0, clusterDims.z - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterDims.xy - 1);
+    int cluster = (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+    uvec2 lights = texelFetch(clusterGrid, clusterBase.y + cluster).xy;
+#ifdef LIGHTMAP
+    // baked lights are already in the lightmap, as their diffuse term; their specular is dropped
+    bool lightmapped = Lightmapped != 0;
+    if (lightmapped)
+        result += texture(lightmap, LightmapUV).rgb * albedo;
+#endif
+    for(uint i = 0u; i < lights.y; i++)
+    {
+        int light = int(texelFetch(lightIndices, clusterBase.z + int(lights.x + i)).x);
+#ifdef LIGHTMAP
+        if (lightmapped && texelFetch(lightData, clusterBase.x + light * 6 + 5).w > 0.5)
+            continue;
+#endif
+        result += CalcLight(light, normal, fragPos, viewDir, albedo, specularColor, shininess);
+    }
+    return result;
+}
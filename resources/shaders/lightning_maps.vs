@@ -8,13 +8,14 @@ out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of model, computed once on the CPU
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal ;
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
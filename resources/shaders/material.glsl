@@ -0,0 +1,44 @@
+// Material inputs shared by the model fragment shaders. The samplers sit on fixed units, see TextureKind.
+//  NORMAL_MAPPING: perturb the normal with material.normal through the TBN basis from model_lighting.vs
+//  ALPHA_TEST: discard texels whose diffuse alpha is below one half
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+#ifdef NORMAL_MAPPING
+    sampler2D normal;
+#endif
+};
+
+in vec3 Normal;
+in vec2 TexCoords;
+#ifdef NORMAL_MAPPING
+in mat3 TBN;
+#endif
+
+uniform Material material;
+
+vec3 SampleAlbedo()
+{
+    vec4 albedo = texture(material.diffuse, TexCoords);
+#ifdef ALPHA_TEST
+    if (albedo.a < 0.5)
+        discard;
+#endif
+    return albedo.rgb;
+}
+
+vec3 SampleSpecular()
+{
+    return texture(material.specular, TexCoords).rgb;
+}
+
+vec3 SurfaceNormal()
+{
+#ifdef NORMAL_MAPPING
+    vec3 tangentNormal = texture(material.normal, TexCoords).rgb * 2.0 - 1.0;
+    return normalize(TBN * tangentNormal);
+#else
+    return normalize(Normal);
+#endif
+}
@@ -2,20 +2,63 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef NORMAL_MAPPING
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+layout (location = 5) in int aDrawId;
+#ifdef LIGHTMAP
+layout (location = 6) in vec2 aLightmapUV;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out float ViewDepth;
+flat out float Shininess;
+#ifdef NORMAL_MAPPING
+out mat3 TBN;
+#endif
+#ifdef LIGHTMAP
+out vec2 LightmapUV;
+flat out int Lightmapped;
+#endif
 
-
-uniform mat4 model;
+// per-draw records streamed from the CPU, 8 texels each: model matrix, normal matrix, params
+uniform samplerBuffer drawData;
+#ifdef LIGHTMAP
+// atlas offset xy and scale zw per lightmap region, see rg::Lightmaps
+uniform samplerBuffer lightmapRegions;
+#endif
 uniform mat4 view;
 uniform mat4 projection;
 
+invariant gl_Position;
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    int record = aDrawId * 8;
+    mat4 model = mat4(texelFetch(drawData, record), texelFetch(drawData, record + 1),
+                      texelFetch(drawData, record + 2), texelFetch(drawData, record + 3));
+    mat3 normalMatrix = mat3(texelFetch(drawData, record + 4).xyz, texelFetch(drawData, record + 5).xyz,
+                             texelFetch(drawData, record + 6).xyz);
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    FragPos = vec3(worldPos);
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+#ifdef NORMAL_MAPPING
+    // tangents follow the surface, so they take the model matrix rather than the normal matrix
+    TBN = mat3(normalize(mat3(model) * aTangent), normalize(mat3(model) * aBitangent), normalize(Normal));
+#endif
+    vec4 params = texelFetch(drawData, record + 7);
+    Shininess = params.x;
+#ifdef LIGHTMAP
+    int region = int(params.z);
+    Lightmapped = region >= 0 ? 1 : 0;
+    vec4 regionRect = region >= 0 ? texelFetch(lightmapRegions, region) : vec4(0.0);
+    LightmapUV = regionRect.xy + aLightmapUV * regionRect.zw;
+#endif
+    vec4 viewPos = view * worldPos;
+    ViewDepth = -viewPos.z;
+    gl_Position = projection * viewPos;
 }
\ No newline at end of file
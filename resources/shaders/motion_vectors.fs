@@ -0,0 +1,11 @@
+#version 330 core
+out vec2 ObjectMotion;
+
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+
+// in UV units: where the surface was last frame, minus where the last frame's camera would see it now
+void main()
+{
+    ObjectMotion = (PreviousClip.xy / PreviousClip.w - CurrentClip.xy / CurrentClip.w) * 0.5;
+}
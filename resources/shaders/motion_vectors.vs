@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in int aDrawId;
+
+// both in the previous frame's unjittered clip space, see rg::TemporalUpsampler
+out vec4 CurrentClip;
+out vec4 PreviousClip;
+
+uniform samplerBuffer drawData;
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 previousModel;
+uniform mat4 previousViewProjection;
+
+// the same position as the scene passes computed, the depth test against their depth is EQUAL
+invariant gl_Position;
+
+void main()
+{
+    int record = aDrawId * 8;
+    mat4 model = mat4(texelFetch(drawData, record), texelFetch(drawData, record + 1),
+                      texelFetch(drawData, record + 2), texelFetch(drawData, record + 3));
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    CurrentClip = previousViewProjection * worldPos;
+    PreviousClip = previousViewProjection * (previousModel * vec4(aPos, 1.0));
+    gl_Position = projection * (view * worldPos);
+}
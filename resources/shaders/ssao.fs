@@ -0,0 +1,68 @@
+#version 330 core
+out vec2 OcclusionDepth;
+
+// see rg::Ssao
+uniform sampler2D linearDepth; // half resolution view depth
+uniform sampler2D noise;       // 4x4 rotations of the kernel about the normal, tiled over the screen
+uniform mat4 projection;
+uniform vec3 kernel[32];       // hemisphere around +z
+uniform int sampleCount;
+uniform float radius;
+uniform float power;
+
+// what ssao_depth.fs writes for the sky
+const float skyDepth = 65504.0;
+
+ivec2 lastTexel;
+vec2 texelSize;
+
+float DepthAt(ivec2 texel)
+{
+    return texelFetch(linearDepth, clamp(texel, ivec2(0), lastTexel), 0).r;
+}
+
+vec3 ViewPosition(ivec2 texel)
+{
+    float depth = DepthAt(texel);
+    vec2 ndc = (vec2(texel) + 0.5) * texelSize * 2.0 - 1.0;
+    vec2 xy = (ndc + vec2(projection[2][0], projection[2][1])) * depth / vec2(projection[0][0], projection[1][1]);
+    return vec3(xy, -depth);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    lastTexel = textureSize(linearDepth, 0) - 1;
+    texelSize = 1.0 / vec2(lastTexel + 1);
+    vec3 position = ViewPosition(pixel);
+    float depth = -position.z;
+    // the sky, which nothing lights
+    if (depth >= skyDepth) {
+        OcclusionDepth = vec2(1.0, depth);
+        return;
+    }
+
+    // the normal from the neighbours, on each axis the side closer in depth so edges don't bend it
+    vec3 left = position - ViewPosition(pixel - ivec2(1, 0)), right = ViewPosition(pixel + ivec2(1, 0)) - position;
+    vec3 down = position - ViewPosition(pixel - ivec2(0, 1)), up = ViewPosition(pixel + ivec2(0, 1)) - position;
+    vec3 dx = abs(left.z) < abs(right.z) ? left : right;
+    vec3 dy = abs(down.z) < abs(up.z) ? down : up;
+    vec3 normal = normalize(cross(dx, dy));
+
+    vec3 rotation = vec3(texelFetch(noise, pixel & 3, 0).xy, 0.0);
+    vec3 tangent = normalize(rotation - normal * dot(rotation, normal));
+    mat3 tbn = mat3(tangent, cross(normal, tangent), normal);
+
+    float bias = 0.02 * radius;
+    float occlusion = 0.0;
+    for (int i = 0; i < sampleCount; i++) {
+        vec3 samplePos = position + tbn * kernel[i] * radius;
+        vec4 clip = projection * vec4(samplePos, 1.0);
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        float sceneDepth = DepthAt(ivec2(uv / texelSize));
+        // occluded if the surface there is in front of the sample, fading out for surfaces far in front
+        float range = smoothstep(0.0, 1.0, radius / abs(depth - sceneDepth));
+        occlusion += (sceneDepth < -samplePos.z - bias ? 1.0 : 0.0) * range;
+    }
+    OcclusionDepth = vec2(pow(1.0 - occlusion / float(sampleCount), power), depth);
+}
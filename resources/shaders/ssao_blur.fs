@@ -0,0 +1,27 @@
+#version 330 core
+out vec2 OcclusionDepth;
+
+// see rg::Ssao
+uniform sampler2D occlusion; // half resolution occlusion and view depth
+
+// relative depth difference at which a texel stops counting
+const float depthTolerance = 0.05;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 lastTexel = textureSize(occlusion, 0) - 1;
+    float depth = texelFetch(occlusion, pixel, 0).g;
+    float sum = 0.0, weights = 0.0;
+    // the noise repeats every 4 texels, a 4x4 box takes its pattern back out
+    for (int y = -2; y < 2; y++) {
+        for (int x = -2; x < 2; x++) {
+            vec2 texel = texelFetch(occlusion, clamp(pixel + ivec2(x, y), ivec2(0), lastTexel), 0).rg;
+            float weight = max(0.0, 1.0 - abs(texel.y - depth) / (depth * depthTolerance));
+            sum += texel.x * weight;
+            weights += weight;
+        }
+    }
+    // the centre texel always counts
+    OcclusionDepth = vec2(sum / weights, depth);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+out float LinearDepth;
+
+// see rg::Ssao
+uniform sampler2D depth;   // at the render size
+uniform vec2 depthParams;  // view depth = x / (ndc depth + y)
+
+// written for the sky, farther than any surface and still exact in the half float copy ssao.fs makes
+const float skyDepth = 65504.0;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(depth, 0) - 1;
+    ivec2 source = pixel * 2;
+    float a = texelFetch(depth, min(source, last), 0).r;
+    float b = texelFetch(depth, min(source + ivec2(1, 0), last), 0).r;
+    float c = texelFetch(depth, min(source + ivec2(0, 1), last), 0).r;
+    float d = texelFetch(depth, min(source + ivec2(1, 1), last), 0).r;
+    // the nearest and the farthest of the block in a checkerboard, so both sides of an edge survive
+    float chosen = ((pixel.x + pixel.y) & 1) == 0 ? min(min(a, b), min(c, d)) : max(max(a, b), max(c, d));
+    LinearDepth = chosen == 1.0 ? skyDepth : depthParams.x / (chosen * 2.0 - 1.0 + depthParams.y);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+out float Occlusion;
+
+// see rg::Ssao
+uniform sampler2D occlusion; // half resolution, blurred occlusion and view depth
+uniform sampler2D depth;     // at the render size
+uniform vec2 depthParams;    // view depth = x / (ndc depth + y)
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float viewDepth = depthParams.x / (texelFetch(depth, pixel, 0).r * 2.0 - 1.0 + depthParams.y);
+    // the four half resolution texels around the pixel, bilinear weights times how close their depth is
+    vec2 position = (vec2(pixel) + 0.5) * 0.5 - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    ivec2 lastTexel = textureSize(occlusion, 0) - 1;
+    float sum = 0.0, weights = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec2 texel = texelFetch(occlusion, clamp(base + offset, ivec2(0), lastTexel), 0).rg;
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y / (1e-3 + abs(texel.y - viewDepth) / viewDepth);
+        sum += texel.x * weight;
+        weights += weight;
+    }
+    Occlusion = weights > 0.0 ? sum / weights : 1.0;
+}
@@ -0,0 +1,94 @@
+#version 330 core
+out vec4 FragColor;
+
+#include "catmull_rom.glsl"
+
+in vec2 TexCoords;
+
+// see rg::TemporalUpsampler; the scene inputs are at the render size, the history at the output size
+uniform sampler2D scene;
+uniform sampler2D sceneDepth;
+uniform sampler2D objectMotion;
+uniform sampler2D history;
+uniform vec2 sceneSize;
+// scene texels the geometry was shifted by this frame
+uniform vec2 jitter;
+// this frame's unjittered clip space to the last frame's
+uniform mat4 reprojection;
+uniform float historyValid;
+
+vec3 RGBToYCoCg(vec3 color)
+{
+    return vec3(dot(color, vec3(0.25, 0.5, 0.25)), dot(color, vec3(0.5, 0.0, -0.5)),
+                dot(color, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 YCoCgToRGB(vec3 color)
+{
+    return vec3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+// blending with this weight is blending tone mapped colours, so a single bright sample doesn't flicker
+float ToneWeight(vec3 color)
+{
+    return 1.0 / (1.0 + dot(color, vec3(0.299, 0.587, 0.114)));
+}
+
+void main()
+{
+    // this pixel's centre in scene texels, in the unjittered image
+    vec2 position = TexCoords * sceneSize;
+    vec2 outputTexel = sceneSize / vec2(textureSize(history, 0));
+    ivec2 center = ivec2(floor(position + jitter));
+    ivec2 lastTexel = ivec2(sceneSize) - 1;
+
+    // this frame's 3x3 samples around the pixel: a Blackman-Harris fit over their distance in scene texels,
+    // their colour range, and the nearest surface among them
+    vec3 current = vec3(0.0);
+    float currentWeight = 0.0;
+    float nearest = 0.0;
+    vec3 minColor = vec3(1e9), maxColor = vec3(-1e9);
+    float closestDepth = 1.0;
+    ivec2 closestTexel = center;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 texel = clamp(center + ivec2(x, y), ivec2(0), lastTexel);
+            vec3 color = max(texelFetch(scene, texel, 0).rgb, vec3(0.0));
+            vec2 offset = vec2(texel) + 0.5 - jitter - position;
+            float weight = exp(-2.29 * dot(offset, offset)) * ToneWeight(color);
+            current += color * weight;
+            currentWeight += weight;
+            // how close a sample landed to this output pixel, in output pixels
+            vec2 outputOffset = offset / outputTexel;
+            nearest = max(nearest, exp(-2.29 * dot(outputOffset, outputOffset)));
+            vec3 ycocg = RGBToYCoCg(color);
+            minColor = min(minColor, ycocg);
+            maxColor = max(maxColor, ycocg);
+            float depth = texelFetch(sceneDepth, texel, 0).r;
+            if (depth < closestDepth) {
+                closestDepth = depth;
+                closestTexel = texel;
+            }
+        }
+    }
+    current /= max(currentWeight, 1e-6);
+
+    // where the nearest surface was last frame, so the edges of moving objects take their motion along:
+    // the camera's reprojection plus the object's own motion
+    vec4 previousClip = reprojection * vec4(TexCoords * 2.0 - 1.0, closestDepth * 2.0 - 1.0, 1.0);
+    vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5 + texelFetch(objectMotion, closestTexel, 0).rg;
+    if (historyValid == 0.0 || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0)))) {
+        FragColor = vec4(current, 1.0);
+        return;
+    }
+
+    // the history, clamped to what this frame's neighbourhood spans so disocclusions don't ghost
+    vec3 past = SampleCatmullRom(history, previousUV, vec2(textureSize(history, 0)));
+    past = YCoCgToRGB(clamp(RGBToYCoCg(past), minColor, maxColor));
+
+    // this frame counts for more where one of its samples fell right on the pixel
+    float alpha = mix(0.04, 0.2, nearest);
+    float pastWeight = (1.0 - alpha) * ToneWeight(past);
+    float currentBlend = alpha * ToneWeight(current);
+    FragColor = vec4((past * pastWeight + current * currentBlend) / (pastWeight + currentBlend), 1.0);
+}
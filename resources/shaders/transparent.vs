@@ -1,15 +1,16 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in vec4 aInstance; // xyz: position, w: scale
 
 out vec2 TexCoords;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 worldPos = aInstance.xyz + aPos * aInstance.w;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
 }
\ No newline at end of file
@@ -13,7 +13,32 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include <rg/AutoExposure.h>
+#include <rg/BloomChain.h>
+#include <rg/CascadedShadows.h>
+#include <rg/ColorGrading.h>
+#include <rg/ClusteredLights.h>
+#include <rg/DrawData.h>
+#include <rg/DynamicResolution.h>
+#include <rg/GBuffer.h>
+#include <rg/GLExt.h>
+#include <rg/JobSystem.h>
+#include <rg/LightShadowAtlas.h>
+#include <rg/Lightmaps.h>
+#include <rg/Profiler.h>
+#include <rg/RenderGraph.h>
+#include <rg/RenderTargetPool.h>
+#include <rg/Scene.h>
+#include <rg/ShackScene.h>
+#include <rg/ShaderLibrary.h>
+#include <rg/Ssao.h>
+#include <rg/SkyIrradiance.h>
+#include <rg/TemporalUpsampler.h>
+#include <rg/Transparency.h>
+
+#include <cstdio>
 #include <iostream>
+#include <memory>
 
 using namespace std;
 
@@ -24,19 +49,41 @@ void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 unsigned int loadCubemap(vector<string> faces);
 unsigned int loadTexture(char const *path);
-void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int specularMap, unsigned int boxVAO);
-void renderModel(Shader &ourShader, Model &ourModel, const glm::vec3 &translateVec, const glm::vec3 &scalarVec,
-                 const glm::vec3 &rotateVec, float angle, bool rotate = false);
+void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int specularMap, unsigned int boxVAO,
+                  const glm::mat4 &projection);
+glm::mat4 lanternSwing(float time);
+void updateStressObjects(rg::Scene &scene, size_t baseObjectCount, int count, const vector<Model*> &models,
+                         vector<Model> &lods);
+void updateStressFoliage(rg::TransparentCards &cards, size_t baseCardCount, int count, uint32_t batch);
+void addExtraLanterns(rg::ClusteredLights &lights, int count);
+size_t writeDrawData(rg::JobSystem &jobs, rg::DrawDataBuffer &drawData, const vector<rg::DrawItem> &drawList,
+                     vector<rg::ShadowCaster> &casters);
+void submitDrawList(const vector<rg::DrawItem> &drawList, size_t begin, size_t end, const rg::DrawDataBuffer &drawData,
+                    rg::ShaderLibrary &shaders, rg::ShaderProgramId litProgram, uint32_t globalFeatures,
+                    Shader &lightSourceShader, bool depthPrePass);
+void requestLitVariants(const vector<rg::DrawItem> &drawList, size_t drawCount, rg::ShaderLibrary &shaders,
+                        rg::ShaderProgramId litProgram, uint32_t globalFeatures);
+void setDirectionalLight(Shader &shader);
+void submitDepthPrePass(const vector<rg::DrawItem> &drawList, size_t drawCount, const rg::DrawDataBuffer &drawData,
+                        Shader &depthShader);
+unsigned submitMotionVectors(const vector<rg::DrawItem> &drawList, size_t drawCount, const rg::DrawDataBuffer &drawData,
+                             Shader &motionShader, const glm::mat4 &previousViewProjection);
+void parseArguments(int argc, char **argv);
 void renderQuad();
 
 // settings
-const unsigned int SCR_WIDTH = 1200;
-const unsigned int SCR_HEIGHT = 900;
+unsigned int SCR_WIDTH = 1200;
+unsigned int SCR_HEIGHT = 900;
+int benchFrames = 0; // --bench N: measure every renderer configuration for N frames and exit
+float targetFrameMs = 0.0f; // --target-frame-ms MS: dynamic resolution on, aiming at MS of GPU time per frame
+string colorCubeFile; // --grade FILE: color grading LUT on, with the .cube grade in FILE
 bool hdr = false;
 bool hdrKeyPressed = false;
 float exposure = 1.0f;
 bool bloom = false;
 bool bloomKeyPressed = false;
+// the moonlight's direction, shared by the lighting shaders and the shadow cascades
+const glm::vec3 moonDirection(30.0f, -10.0f, 30.0f);
 
 // quad
 unsigned int quadVAO = 0;
@@ -70,6 +117,80 @@ struct ProgramState {
     glm::vec3 backpackPosition = glm::vec3(0.0f, 3.0f, 0.0f);
     float backpackScale = 1.0f;
     PointLight pointLight;
+    // frame preparation
+    int jobThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    int stressObjects = 0;
+    rg::FramePrepStats framePrep;
+    unsigned droppedDraws = 0;
+    // sorted transparent cards
+    int stressFoliage = 0;
+    rg::TransparencyStats transparency;
+    // clustered lighting
+    int extraLanterns = 0;
+    rg::ClusterStats clusters;
+    // depth-only pass before the lit pass, which then shades every pixel once
+    bool depthPrePass = false;
+    // G-buffer and a full screen lighting pass instead of lighting while rasterizing
+    bool deferred = false;
+    // compiled into the lighting shaders as the FOG feature
+    bool fog = true;
+    // half resolution ambient occlusion darkening the sky's ambient; it needs the depth before the lit pass,
+    // so the forward path gets the depth pre-pass with it
+    bool ssao = false;
+    int ssaoQuality = (int)rg::SsaoQuality::Medium;
+    float ssaoRadius = 0.5f;
+    float ssaoPower = 1.5f;
+    // cascaded moonlight shadows, static casters cached between frames unless shadowCache is off
+    bool shadows = true;
+    bool shadowCache = true;
+    rg::ShadowStats shadowStats;
+    // lantern and spot light shadow faces redrawn per frame at most
+    int lightShadowBudget = 6;
+    rg::LightShadowStats lightShadowStats;
+    // baked lantern light on the static objects, when resources/lightmaps.bin was found (forward only)
+    bool lightmaps = true;
+    bool lightmapsLoaded = false;
+    // average brightness of the skybox's spherical harmonics ambient
+    float skyAmbient = 0.5f;
+    // bloom (B): the half resolution mip chain, or the full resolution Gaussian ping-pong blur
+    bool bloomMipChain = true;
+    // the Gaussian blur in compute shaders with shared memory tiles, where GL 4.3 is available
+    bool bloomCompute = true;
+    float bloomThreshold = 1.0f;
+    float bloomKnee = 0.5f;
+    float bloomEmissive = 1.0f;
+    float bloomRadius = 1.0f;
+    float bloomIntensity = 1.0f;
+    rg::RenderTargetStats renderTargets;
+    rg::RenderGraphStats renderGraph;
+    // the scene and its post-processing render at a scale of the window's size, picked every frame to keep
+    // the GPU frame time under targetFrameMs; the composite upscales to the window, the UI stays native
+    bool dynamicResolution = false;
+    float targetFrameMs = 16.7f;
+    float minResolutionScale = 0.5f;
+    // with dynamic resolution off
+    float renderScale = 1.0f;
+    float resolutionScale = 1.0f;
+    // jittered frames accumulated into a window sized history instead of the composite's upscale
+    bool temporalUpsampling = false;
+    // exposure from the scene's adapted average luminance instead of the fixed one, tone mapped also
+    // without bloom; the adapted luminance is kept between the limits so the night stays dark
+    bool autoExposure = false;
+    float exposureKey = 0.18f;
+    float adaptationSpeedUp = 3.0f;
+    float adaptationSpeedDown = 1.0f;
+    float minAdaptedLuminance = 0.05f;
+    float maxAdaptedLuminance = 4.0f;
+    // tone curve, grade and gamma from one 3D LUT, baked whenever colorGrade changes; always tone maps
+    bool colorLut = false;
+    rg::ColorGradeParams colorGrade;
+    // a .cube grade on top, read again when reloadColorCube is set
+    char colorCubePath[256] = {};
+    bool reloadColorCube = false;
+    bool colorCubeLoaded = false;
+    double gpuFrameMs = 0.0;
+    unsigned shaderVariants = 0;
+    unsigned shaderVariantsPending = 0;
     ProgramState()
             : camera(glm::vec3(-7.0f, 0.0f, 26.0f)) {}
 
@@ -110,9 +231,10 @@ void ProgramState::LoadFromFile(string filename) {
 
 ProgramState *programState;
 
-void DrawImGui(ProgramState *programState);
+void DrawImGui(ProgramState *programState, const rg::Profiler &profiler);
 
-int main() {
+int main(int argc, char **argv) {
+    parseArguments(argc, argv);
 
     // glfw: initialize and configure
     // ------------------------------
@@ -134,6 +256,13 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // window sizes are in screen coordinates, on HiDPI displays the framebuffer has more pixels
+    int framebufferWidth = 0, framebufferHeight = 0;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    if (framebufferWidth > 0 && framebufferHeight > 0) {
+        SCR_WIDTH = (unsigned int)framebufferWidth;
+        SCR_HEIGHT = (unsigned int)framebufferHeight;
+    }
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -147,12 +276,22 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    rg::loadGLExtensions((GLADloadproc) glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     //stbi_set_flip_vertically_on_load(true);
 
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
+    if (targetFrameMs > 0.0f) {
+        programState->dynamicResolution = true;
+        programState->targetFrameMs = targetFrameMs;
+    }
+    if (!colorCubeFile.empty()) {
+        programState->colorLut = true;
+        std::snprintf(programState->colorCubePath, sizeof(programState->colorCubePath), "%s", colorCubeFile.c_str());
+        programState->reloadColorCube = true;
+    }
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -173,60 +312,207 @@ int main() {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
 
-    // build and compile shaders
-    Shader objShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
-    Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
-    Shader lightingShader("resources/shaders/lightning_maps.vs", "resources/shaders/lightning_maps.fs");
-    Shader transparentShader("resources/shaders/transparent.vs", "resources/shaders/transparent.fs");
-    Shader bloomShader("resources/shaders/bloom.vs", "resources/shaders/bloom.fs");
-    Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs");
-    Shader lightSourceShader("resources/shaders/light_source.vs", "resources/shaders/light_source.fs");
+    // build and compile shaders, linked programs are kept in the cache file between runs
+    rg::ShaderLibrary shaders;
+    shaders.OpenCache("resources/shader_cache.bin");
+    double shaderStartTime = glfwGetTime();
+    rg::ShaderProgramId skyboxProgram = shaders.Register("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
+    rg::ShaderProgramId lightingProgram = shaders.Register("resources/shaders/lightning_maps.vs",
+                                                           "resources/shaders/lightning_maps.fs");
+    rg::ShaderProgramId transparentProgram = shaders.Register("resources/shaders/transparent.vs",
+                                                              "resources/shaders/transparent.fs");
+    // the Gaussian blur has a variant per direction, see blurDirection
+    auto blurInit = [](Shader &shader) {
+        shader.use();
+        shader.setInt("image", 0);
+    };
+    rg::ShaderProgramId blurProgram = shaders.Register("resources/shaders/blur.vs", "resources/shaders/blur.fs",
+                                                       blurInit);
+    const bool computeBlur = rg::glext().computeShaders;
+    rg::ShaderProgramId blurComputeProgram = computeBlur ? shaders.RegisterCompute("resources/shaders/blur.cs", blurInit)
+                                                         : 0;
+    rg::ShaderProgramId lightSourceProgram = shaders.Register("resources/shaders/light_source.vs",
+                                                              "resources/shaders/light_source.fs");
+    rg::ShaderProgramId depthProgram = shaders.Register("resources/shaders/depth_prepass.vs",
+                                                        "resources/shaders/depth_prepass.fs");
+    // same depth-only shader, its own program so the shadow cascades keep their matrices out of the pre-pass
+    rg::ShaderProgramId shadowDepthProgram = shaders.Register("resources/shaders/depth_prepass.vs",
+                                                              "resources/shaders/depth_prepass.fs", [](Shader &shader) {
+        shader.use();
+        shader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+    });
+
+    // programs with feature permutations, compiled per set of #defines when a frame first needs it
+    rg::ShaderProgramId litProgram = shaders.Register("resources/shaders/model_lighting.vs",
+                                                      "resources/shaders/model_lighting.fs", [](Shader &shader) {
+        // material samplers live on fixed units, see TextureKind
+        SetMaterialSamplers(shader, "material.");
+        shader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+        rg::ClusteredLights::SetSamplers(shader);
+        rg::CascadedShadowMap::SetSamplers(shader);
+        rg::LightShadowAtlas::SetSamplers(shader);
+        rg::Lightmaps::SetSamplers(shader);
+        rg::Ssao::SetSamplers(shader);
+    });
+    rg::ShaderProgramId gBufferProgram = shaders.Register("resources/shaders/model_lighting.vs",
+                                                          "resources/shaders/gbuffer.fs", [](Shader &shader) {
+        SetMaterialSamplers(shader, "material.");
+        shader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+    });
+    rg::ShaderProgramId deferredLightingProgram = shaders.Register("resources/shaders/bloom.vs",
+                                                                   "resources/shaders/deferred_lighting.fs", [](Shader &shader) {
+        rg::GBuffer::SetSamplers(shader);
+        rg::ClusteredLights::SetSamplers(shader);
+        rg::CascadedShadowMap::SetSamplers(shader);
+        rg::LightShadowAtlas::SetSamplers(shader);
+        rg::Ssao::SetSamplers(shader);
+    });
+    rg::ShaderProgramId compositeProgram = shaders.Register("resources/shaders/bloom.vs", "resources/shaders/bloom.fs",
+                                                            [](Shader &shader) {
+        shader.use();
+        shader.setInt("scene", 0);
+        shader.setInt("bloomBlur", 1);
+        shader.setInt("adaptedLuminance", rg::AutoExposure::AdaptedUnit);
+        rg::ColorGrading::SetUniforms(shader);
+    });
+    rg::ShaderProgramId bloomBrightPassProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                                  "resources/shaders/bloom_bright_pass.fs");
+    rg::ShaderProgramId bloomDownsampleProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                                  "resources/shaders/bloom_downsample.fs");
+    rg::ShaderProgramId bloomUpsampleProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                                "resources/shaders/bloom_upsample.fs");
+    rg::ShaderProgramId motionVectorsProgram = shaders.Register("resources/shaders/motion_vectors.vs",
+                                                                "resources/shaders/motion_vectors.fs",
+                                                                [](Shader &shader) {
+        shader.use();
+        shader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+    });
+    rg::ShaderProgramId temporalResolveProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                                  "resources/shaders/temporal_resolve.fs",
+                                                                  rg::TemporalUpsampler::SetSamplers);
+    rg::ShaderProgramId luminanceProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                            "resources/shaders/auto_exposure_luminance.fs");
+    rg::ShaderProgramId adaptLuminanceProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                                 "resources/shaders/auto_exposure_adapt.fs");
+    rg::ShaderProgramId ssaoDepthProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                            "resources/shaders/ssao_depth.fs");
+    rg::ShaderProgramId ssaoProgram = shaders.Register("resources/shaders/bloom_chain.vs", "resources/shaders/ssao.fs");
+    rg::ShaderProgramId ssaoBlurProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                           "resources/shaders/ssao_blur.fs");
+    rg::ShaderProgramId ssaoUpsampleProgram = shaders.Register("resources/shaders/bloom_chain.vs",
+                                                               "resources/shaders/ssao_upsample.fs");
+
+    // every compile and link is issued before the first status check, so the driver can work on them
+    // side by side; the variants requested here are also the fallbacks drawn with while newly needed
+    // permutations compile
+    const rg::ShaderDefines blurDirection[2] = {rg::ShaderDefines(), rg::ShaderDefines().Set("HORIZONTAL")};
+    for (const rg::ShaderDefines &direction : blurDirection) {
+        shaders.Request(blurProgram, direction);
+        if (computeBlur)
+            shaders.Request(blurComputeProgram, direction);
+    }
+    for (rg::ShaderProgramId program : {skyboxProgram, lightingProgram, transparentProgram,
+                                        lightSourceProgram, depthProgram, shadowDepthProgram, gBufferProgram,
+                                        compositeProgram, bloomBrightPassProgram, bloomDownsampleProgram,
+                                        bloomUpsampleProgram, motionVectorsProgram, temporalResolveProgram,
+                                        luminanceProgram, adaptLuminanceProgram, ssaoDepthProgram, ssaoProgram,
+                                        ssaoBlurProgram, ssaoUpsampleProgram})
+        shaders.Request(program);
+    const uint32_t defaultLighting = rg::ShaderFeature::Fog | rg::ShaderFeature::Shadows;
+    shaders.Request(litProgram, defaultLighting);
+    shaders.Request(deferredLightingProgram, defaultLighting);
+    shaders.Request(compositeProgram, rg::ShaderFeature::Bloom);
+    shaders.Finish();
+    shaders.SetFallback(litProgram, defaultLighting);
+    shaders.SetFallback(gBufferProgram, 0u);
+    shaders.SetFallback(deferredLightingProgram, defaultLighting);
+    shaders.SetFallback(compositeProgram, 0u);
+    double shaderStartupMs = (glfwGetTime() - shaderStartTime) * 1000.0;
+    Shader &skyboxShader = shaders.Get(skyboxProgram);
+    Shader &lightingShader = shaders.Get(lightingProgram);
+    Shader &transparentShader = shaders.Get(transparentProgram);
+    Shader &lightSourceShader = shaders.Get(lightSourceProgram);
+    Shader &depthShader = shaders.Get(depthProgram);
+    Shader &shadowDepthShader = shaders.Get(shadowDepthProgram);
+    Shader &bloomBrightPassShader = shaders.Get(bloomBrightPassProgram);
+    Shader &bloomDownsampleShader = shaders.Get(bloomDownsampleProgram);
+    Shader &bloomUpsampleShader = shaders.Get(bloomUpsampleProgram);
+    Shader &motionVectorsShader = shaders.Get(motionVectorsProgram);
+    Shader &temporalResolveShader = shaders.Get(temporalResolveProgram);
+    Shader &luminanceShader = shaders.Get(luminanceProgram);
+    Shader &adaptLuminanceShader = shaders.Get(adaptLuminanceProgram);
+    Shader &ssaoDepthShader = shaders.Get(ssaoDepthProgram);
+    Shader &ssaoShader = shaders.Get(ssaoProgram);
+    Shader &ssaoBlurShader = shaders.Get(ssaoBlurProgram);
+    Shader &ssaoUpsampleShader = shaders.Get(ssaoUpsampleProgram);
 
     // load models
-    Model deadTree("resources/objects/dead_tree/dead_tree.obj");
-    deadTree.SetShaderTextureNamePrefix("material.");
-
-    Model scene("resources/objects/shack_scene/untitled.obj");
-    scene.SetShaderTextureNamePrefix("material.");
-
+    using rg::ShackModel;
+    Model deadTree(rg::ShackModelPath(ShackModel::DeadTree));
+    Model scene(rg::ShackModelPath(ShackModel::Shack));
     Model redLantern("resources/objects/red_lantern/red_lantern.obj");
-    redLantern.SetShaderTextureNamePrefix("material.");
-
-    Model plant("resources/objects/plant/plant.obj");
-    plant.SetShaderTextureNamePrefix("material.");
-
+    Model plant(rg::ShackModelPath(ShackModel::Plant));
     Model bronzeLantern("resources/objects/bronze_lantern/bronze_lantern.obj");
-    bronzeLantern.SetShaderTextureNamePrefix("material.");
-
-    Model oldTap("resources/objects/old_tap/old_tap.obj");
-    oldTap.SetShaderTextureNamePrefix("material.");
-
-    Model trees("resources/objects/trees_pack/trees_pack.obj");
-    trees.SetShaderTextureNamePrefix("material.");
-
-    Model rockA("resources/objects/rock_set/rockA.obj");
-    rockA.SetShaderTextureNamePrefix("material.");
-
-    Model rockB("resources/objects/rock_set/rockB.obj");
-    rockB.SetShaderTextureNamePrefix("material.");
-
-    Model rockC("resources/objects/rock_set/rockC.obj");
-    rockC.SetShaderTextureNamePrefix("material.");
-
-    Model rockD("resources/objects/rock_set/rockD.obj");
-    rockD.SetShaderTextureNamePrefix("material.");
-
-    Model rockE("resources/objects/rock_set/rockE.obj");
-    rockE.SetShaderTextureNamePrefix("material.");
-
-    Model rockF("resources/objects/rock_set/rockF.obj");
-    rockF.SetShaderTextureNamePrefix("material.");
-
-    Model rockG("resources/objects/rock_set/rockG.obj");
-    rockG.SetShaderTextureNamePrefix("material.");
+    Model oldTap(rg::ShackModelPath(ShackModel::OldTap));
+    Model trees(rg::ShackModelPath(ShackModel::Trees));
+    Model rockA(rg::ShackModelPath(ShackModel::RockA));
+    Model rockB(rg::ShackModelPath(ShackModel::RockB));
+    Model rockC(rg::ShackModelPath(ShackModel::RockC));
+    Model rockD(rg::ShackModelPath(ShackModel::RockD));
+    Model rockE(rg::ShackModelPath(ShackModel::RockE));
+    Model rockF(rg::ShackModelPath(ShackModel::RockF));
+    Model rockG(rg::ShackModelPath(ShackModel::RockG));
+    Model cactusPot(rg::ShackModelPath(ShackModel::CactusPot));
+    // the shack's ground references its diffuse texture as the bump map, which is no tangent space normal map
+    scene.normalMapped = false;
+    Model *shackModels[(int)ShackModel::Count] = {&scene, &deadTree, &oldTap, &cactusPot, &plant, &trees, &rockA,
+                                                  &rockB,  &rockC,    &rockD,  &rockE,     &rockF, &rockG};
+
+    // lantern light baked by lightmap_baker, gives the static models their lightmap UVs before they are drawn
+    rg::Lightmaps lightmaps;
+    programState->lightmapsLoaded = lightmaps.Load("resources/lightmaps.bin", shackModels);
+    if (programState->lightmapsLoaded)
+        std::cout << "Lightmaps: " << lightmaps.Size().x << "x" << lightmaps.Size().y << " atlas" << std::endl;
+    else
+        std::cout << "Lightmaps: none baked, run ./lightmap_baker to bake the lanterns" << std::endl;
+
+    // scene layout, transforms are resolved on the job system every frame
+    using rg::SceneObject;
+    using rg::ShadingPass;
+    rg::Scene sceneObjects;
+    // the static lit objects, shared with the lightmap baker
+    const vector<rg::ShackPlacement> &placements = rg::ShackLitObjects();
+    for (size_t i = 0; i < placements.size(); ++i) {
+        const rg::ShackPlacement &placement = placements[i];
+        SceneObject object = SceneObject::Static(*shackModels[(int)placement.model], ShadingPass::Lit,
+                                                 placement.position, placement.scale, placement.rotationAxis,
+                                                 placement.angle, placement.rotate);
+        object.cullFaces = placement.cullFaces;
+        object.lightmapRegion = lightmaps.Region(i);
+        sceneObjects.AddObject(object);
+    }
 
-    Model cactusPot("resources/objects/cactus_pot/CACTUS_CONCRETE_POT_10K.obj");
-    cactusPot.SetShaderTextureNamePrefix("material.");
+    // red lantern - on the table
+    sceneObjects.AddObject(SceneObject::Static(redLantern, ShadingPass::LightSource, glm::vec3(-24.0f, -7.3f, -0.5f),
+                                               glm::vec3(0.2f), glm::vec3(0,1,0), 55.0f, true));
+    // red2 lantern - behind the cabin
+    sceneObjects.AddObject(SceneObject::Static(redLantern, ShadingPass::LightSource, glm::vec3(10.0f, -10.0f, -25.0f),
+                                               glm::vec3(0.4f), glm::vec3(0,1,0), 55.0f, false));
+    // bronze lantern - the one that is moving
+    sceneObjects.AddObject(SceneObject::Animated(bronzeLantern, ShadingPass::LightSource, lanternSwing));
+    // bronze lantern
+    sceneObjects.AddObject(SceneObject::Static(bronzeLantern, ShadingPass::LightSource, glm::vec3(17.0f, -9.5f, -7.0f),
+                                               glm::vec3(0.4f), glm::vec3(0,1,0), 55.0f, false));
+
+    // everything past this index is stress test filler (see the "Frame preparation" ImGui window)
+    const size_t sceneObjectCount = sceneObjects.ObjectCount();
+    const vector<Model*> stressModels { &rockA, &rockB, &rockC, &rockD, &rockE, &rockF, &rockG };
+    // their distant LOD, clustered on a 6x6x6 grid over each rock
+    vector<Model> stressLods;
+    for (Model *model : stressModels)
+        stressLods.push_back(model->Simplified(6));
+    int stressObjectCount = 0;
+    std::unique_ptr<rg::JobSystem> jobs(new rg::JobSystem((unsigned)programState->jobThreads));
 
     float transparentVertices[] = {
             // positions         // texture Coords (swapped y coordinates because texture is flipped upside down)
@@ -356,70 +642,35 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
 
-    // transparent VAO
-    unsigned int transparentVAO, transparentVBO;
-    glGenVertexArrays(1, &transparentVAO);
-    glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)nullptr);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindVertexArray(0);
-
-    // configure floating point framebuffer
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    unsigned int colorBuffers[2]; // create floating point color buffer
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0); // attach texture to framebuffer
-    }
-    unsigned int rboDepth; // create depth buffer (renderbuffer)
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO); // attach buffers
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffers[0], 0); //<=
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);//<=
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "Framebuffer not complete!" << endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // ping-pong-framebuffer for blurring
-    unsigned int pingPongFBO[2];
-    unsigned int pingPongColorBuffers[2];
-    glGenFramebuffers(2, pingPongFBO);
-    glGenTextures(2, pingPongColorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingPongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingPongColorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingPongColorBuffers[i], 0);
-        // also check if framebuffers are complete (no need for depth buffer)
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            cout << "Framebuffer not complete!" << endl;
-    }
+    // transparent cards, instanced from a per-instance position/scale buffer
+    rg::TransparentCards transparentCards;
+    transparentCards.Create(transparentVertices, sizeof(transparentVertices) / (5 * sizeof(float)));
+
+    // The frame is a render graph rebuilt every frame, its screen sized targets come from the pool, by
+    // descriptor at the current framebuffer size; targets of a previous size are dropped by the pool a few
+    // frames after a resize. The scene is drawn into scene colour, alpha is 0 on emissive surfaces (see
+    // rg::BloomChain).
+    rg::RenderGraph renderGraph;
+    rg::DynamicResolution dynamicResolution;
+    dynamicResolution.Create();
+    rg::TemporalUpsampler temporalUpsampler;
+    rg::AutoExposure autoExposure;
+    autoExposure.Create();
+    rg::ColorGrading colorGrading;
+    colorGrading.Create();
+    rg::Ssao ssao;
+    ssao.Create();
+    rg::RenderTargetPool renderTargets;
+    const GLenum hdrColorFormat = GL_RGBA16F;
+    const GLenum hdrDepthFormat = GL_DEPTH_COMPONENT24; // same format as the G-buffer depth
+
+    // bright pass and half resolution mip chain, the default bloom blur
+    rg::BloomChain bloomChain;
+    bloomChain.Create((int)SCR_WIDTH, (int)SCR_HEIGHT);
+    // the Gaussian ping-pong blur runs at the bright pass's resolution; its passes alternate directions,
+    // starting horizontal, an odd number of them ends in the second target
+    const unsigned int bloomBlurPasses = 5;
+    static_assert(bloomBlurPasses % 2 == 1, "the blurred bloom ends up in the bloom blur target");
 
     // load skybox
     vector<std::string> faces
@@ -436,6 +687,15 @@ int main() {
     stbi_set_flip_vertically_on_load(true); // darker parts of the clouds are 'above' sunny parts because of the mood
     // of the scene
     unsigned int cubemapTexture = loadCubemap(faces);
+    // the sky's diffuse ambient as spherical harmonics, projected from the same flipped faces once and cached
+    rg::SkyIrradiance skyIrradiance;
+    uint64_t skyKey = rg::SkyIrradiance::Key(faces);
+    if (skyIrradiance.LoadCached("resources/sky_irradiance.bin", skyKey))
+        std::cout << "Sky ambient: spherical harmonics from the cache" << std::endl;
+    else if (skyIrradiance.Project(*jobs, faces))
+        skyIrradiance.SaveCache("resources/sky_irradiance.bin", skyKey);
+    else
+        std::cout << "Sky ambient: could not project the skybox, using a flat ambient" << std::endl;
     stbi_set_flip_vertically_on_load(false);
 
     // load textures for the box
@@ -444,8 +704,12 @@ int main() {
 
     //load grass texture
     unsigned int transparentTexture = loadTexture(FileSystem::getPath("resources/textures/grass.png").c_str());
+    glBindTexture(GL_TEXTURE_2D, transparentTexture);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    uint32_t grassBatch = transparentCards.AddBatch(transparentTexture);
 
-    // water position
+    // grass positions
     vector<glm::vec3> vegetation
             {
                     glm::vec3(-15.5f, -9.0f, -23.48f),
@@ -455,12 +719,28 @@ int main() {
                     glm::vec3 (10.5f, -9.0f, -10.6f),
                     glm::vec3(-17.0f, -9.0f, -13.5f)
             };
+    for (const glm::vec3 &position : vegetation)
+        transparentCards.Add(grassBatch, position);
+    const size_t vegetationCardCount = transparentCards.Count();
+    int stressFoliageCount = 0;
 
     // lighting shader configuration
     lightingShader.use();
     lightingShader.setInt("material.diffuse", 0);
     lightingShader.setInt("material.specular", 1);
 
+    // deferred path
+    rg::GBuffer gBuffer;
+
+    // moonlight shadows
+    rg::CascadedShadowMap shadowMap;
+    shadowMap.Create(2048);
+    rg::LightShadowAtlas lightShadows;
+    lightShadows.Create(512);
+    vector<rg::ShadowCaster> shadowCasters;
+    // the static objects the cached shadows were drawn with, ~0u while shadows are off
+    uint32_t shadowSceneRevision = ~0u;
+
     // water (transparent) shader configuration
     transparentShader.use();
     transparentShader.setInt("texture1", 0);
@@ -469,17 +749,134 @@ int main() {
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
-    // bloom shader configuration
-    bloomShader.use();
-    bloomShader.setInt("scene", 0);
-    bloomShader.setInt("bloomBlur", 1);
-
-    // blur shader configuration
-    blurShader.use();
-    blurShader.setInt("image", 0);
+    // per-draw transforms and material parameters are streamed to the model shaders through a buffer texture
+    rg::DrawDataBuffer drawData;
+    drawData.Create(1024);
+    lightSourceShader.use();
+    lightSourceShader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+    depthShader.use();
+    depthShader.setInt("drawData", rg::DrawDataBuffer::TextureUnit);
+    // lights reach the model shader through the clustered light lists
+    rg::ClusteredLights lights;
+    lights.Create();
+    const vector<rg::Light> lanterns = rg::ShackLanterns();
+    std::cout << "Draw data streaming: " << (drawData.Persistent() ? "persistent mapping" : "unsynchronized mapping with orphaning") << std::endl;
+    const rg::ShaderBuildStats &shaderBuilds = shaders.BuildStats();
+    std::printf("Startup shaders: %u compiled, %u from the cache, all ready after %.1f ms\n", shaderBuilds.compiled,
+                shaderBuilds.cacheHits, shaderStartupMs);
 
     PointLight& pointLight = programState->pointLight;
 
+    rg::Profiler profiler;
+    rg::Benchmark benchmark(benchFrames);
+    if (benchmark.Enabled()) {
+        glfwSwapInterval(0);
+        std::cout << "Benchmarking on " << glGetString(GL_RENDERER) << " at " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+        benchmark.SetLabel(std::to_string(SCR_WIDTH) + "x" + std::to_string(SCR_HEIGHT) + ", ");
+        benchmark.AddConfig("forward, depth pre-pass off", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+        });
+        benchmark.AddConfig("forward, depth pre-pass on", [] {
+            programState->deferred = false;
+            programState->depthPrePass = true;
+            programState->shadowCache = true;
+        });
+        benchmark.AddConfig("deferred", [] {
+            programState->deferred = true;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+        });
+        benchmark.AddConfig("forward, every shadow caster redrawn each frame", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = false;
+        });
+        benchmark.AddConfig("forward, bloom mip chain", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = true;
+            programState->bloomMipChain = true;
+        });
+        benchmark.AddConfig("forward, Gaussian ping-pong bloom", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = true;
+            programState->bloomMipChain = false;
+            programState->bloomCompute = false;
+        });
+        if (computeBlur)
+            benchmark.AddConfig("forward, Gaussian bloom in compute shaders", [] {
+                programState->deferred = false;
+                programState->depthPrePass = false;
+                programState->shadowCache = true;
+                bloom = true;
+                programState->bloomMipChain = false;
+                programState->bloomCompute = true;
+            });
+        benchmark.AddConfig("forward, 62% resolution, Catmull-Rom upscale", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = false;
+            programState->renderScale = 0.625f;
+            programState->temporalUpsampling = false;
+        });
+        benchmark.AddConfig("forward, 62% resolution, temporal upsampling", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = false;
+            programState->renderScale = 0.625f;
+            programState->temporalUpsampling = true;
+        });
+        benchmark.AddConfig("forward, auto exposure", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = false;
+            programState->renderScale = 1.0f;
+            programState->temporalUpsampling = false;
+            programState->autoExposure = true;
+        });
+        benchmark.AddConfig("forward, auto exposure, color grading LUT", [] {
+            programState->deferred = false;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            bloom = false;
+            programState->renderScale = 1.0f;
+            programState->temporalUpsampling = false;
+            programState->autoExposure = true;
+            programState->colorLut = true;
+        });
+        benchmark.AddConfig("forward, SSAO (medium, with the depth pre-pass)", [] {
+            programState->deferred = false;
+            programState->depthPrePass = true;
+            programState->shadowCache = true;
+            programState->autoExposure = false;
+            programState->colorLut = false;
+            programState->ssao = true;
+            programState->ssaoQuality = (int)rg::SsaoQuality::Medium;
+        });
+        benchmark.AddConfig("deferred, SSAO (medium)", [] {
+            programState->deferred = true;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            programState->ssao = true;
+            programState->ssaoQuality = (int)rg::SsaoQuality::Medium;
+        });
+        benchmark.AddConfig("deferred, SSAO (high)", [] {
+            programState->deferred = true;
+            programState->depthPrePass = false;
+            programState->shadowCache = true;
+            programState->ssao = true;
+            programState->ssaoQuality = (int)rg::SsaoQuality::High;
+        });
+    }
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window)) {
@@ -490,70 +887,51 @@ int main() {
         lastFrame = currentFrame;
 
         processInput(window);
+        profiler.BeginFrame();
+        shaders.Update();
+        if (benchmark.Enabled() && !benchmark.Step(profiler))
+            glfwSetWindowShouldClose(window, true);
+
+        if ((int)jobs->ThreadCount() != programState->jobThreads)
+            jobs.reset(new rg::JobSystem((unsigned)programState->jobThreads));
+        if (stressObjectCount != programState->stressObjects) {
+            stressObjectCount = programState->stressObjects;
+            updateStressObjects(sceneObjects, sceneObjectCount, stressObjectCount, stressModels, stressLods);
+        }
+        if (stressFoliageCount != programState->stressFoliage) {
+            stressFoliageCount = programState->stressFoliage;
+            updateStressFoliage(transparentCards, vegetationCardCount, stressFoliageCount, grassBatch);
+        }
 
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        setWoodenBox(lightingShader, diffuseMap, specularMap, boxVAO);
+        dynamicResolution.Update(programState->dynamicResolution, programState->targetFrameMs,
+                                 programState->minResolutionScale);
+        const float renderScale = programState->dynamicResolution ? dynamicResolution.Scale()
+                                                                  : programState->renderScale;
+        programState->resolutionScale = renderScale;
+        programState->gpuFrameMs = dynamicResolution.GpuMs();
+        const int renderWidth = std::max(1, (int)((float)SCR_WIDTH * renderScale + 0.5f));
+        const int renderHeight = std::max(1, (int)((float)SCR_HEIGHT * renderScale + 0.5f));
+        // the temporal resolve already writes at the window's size
+        const bool temporal = programState->temporalUpsampling;
+        const bool upscale = !temporal && (renderWidth != (int)SCR_WIDTH || renderHeight != (int)SCR_HEIGHT);
+        if (bloomChain.OutputDesc().width != std::max(1, renderWidth / 2) ||
+            bloomChain.OutputDesc().height != std::max(1, renderHeight / 2))
+            bloomChain.Create(renderWidth, renderHeight);
 
         // view/projection transformations + activate shader
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-
-        objShader.use();
-        objShader.setVec3("viewPosition", programState->camera.Position);
-        objShader.setFloat("material.shininess", 32.0f);
-        objShader.setMat4("projection", projection);
-        objShader.setMat4("view", view);
-
-        lightSourceShader.use();
-        lightSourceShader.setMat4("projection", projection);
-        lightSourceShader.setMat4("view", view);
-
-        // directional light
-        objShader.use();
-        objShader.setVec3("dirLight.direction", 30.0f, -10.0f, 30.0f);
-        objShader.setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
-        objShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.6f);
-        objShader.setVec3("dirLight.specular", 1.0f, 1.0f, 0.7f);
-
-        // point light 1 - green lantern
-        objShader.setVec3("pointLights[0].position", glm::vec3(10.0f, -11.0f, -25.0f));
-        objShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        objShader.setVec3("pointLights[0].diffuse", 0.94f, 0.98f, 0.78f);
-        objShader.setVec3("pointLights[0].specular", 0.9f, 0.98f, 0.78f);
-        objShader.setFloat("pointLights[0].constant", 1.0f);
-        objShader.setFloat("pointLights[0].linear", 0.2);
-        objShader.setFloat("pointLights[0].quadratic", 0.1);
-
-        //point light 2 - red lantern
-        objShader.setVec3("pointLights[1].position", glm::vec3(-24.0f, -7.0f, -0.5f));
-        objShader.setVec3("pointLights[1].ambient",  0.05f, 0.05f, 0.05f);
-        objShader.setVec3("pointLights[1].diffuse", 0.94f, 0.98f, 0.78f);
-        objShader.setVec3("pointLights[1].specular", 0.94f, 0.98f, 0.78f);
-        objShader.setFloat("pointLights[1].constant", 1.0f);
-        objShader.setFloat("pointLights[1].linear", 0.2f);
-        objShader.setFloat("pointLights[1].quadratic", 0.5f);
-
-        //point light 3 - bronze lantern
-        objShader.setVec3("pointLights[2].position", glm::vec3(17.0f, -12.5f, -7.0f));
-        objShader.setVec3("pointLights[2].ambient",  0.05f, 0.05f, 0.05f);
-        objShader.setVec3("pointLights[2].diffuse", 0.94f, 0.98f, 0.78f);
-        objShader.setVec3("pointLights[2].specular", 0.94f, 0.98f, 0.78f);
-        objShader.setFloat("pointLights[2].constant", 1.0f);
-        objShader.setFloat("pointLights[2].linear", 0.2f);
-        objShader.setFloat("pointLights[2].quadratic", 0.1f);
+        // every frame another sub-pixel offset, for the temporal resolve to accumulate
+        if (temporal) {
+            temporalUpsampler.Resize(renderTargets, (int)SCR_WIDTH, (int)SCR_HEIGHT);
+            projection = temporalUpsampler.BeginFrame(projection, view, renderWidth, renderHeight);
+        } else {
+            temporalUpsampler.Destroy(renderTargets);
+        }
 
         // lantern with movement
-        glm::mat4 movementMat = glm::mat4(1.0f);
-        movementMat = glm::translate(movementMat, glm::vec3(-10.7f, -4.6f, -16.7f));
-        movementMat = glm::scale(movementMat, glm::vec3(0.4f, 0.4f, 0.4f));
-        movementMat = glm::rotate(movementMat, sin(currentFrame * 1.5f) * glm::radians(60.0f), glm::vec3(0, 0, 1));
-        movementMat = glm::translate(movementMat, glm::vec3(0.0f, -3.0f, 0.0f));
+        glm::mat4 movementMat = lanternSwing(currentFrame);
 
         glm::mat4 modelMovement = glm::mat4(1.0f);
         modelMovement = glm::translate(movementMat, glm::vec3(-10.9f, -10.0f, 3.7f));
@@ -561,162 +939,528 @@ int main() {
         glm::vec3 base = modelMovement * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
         glm::vec3 spotlightMovement = normalize(positionMovement - base);
 
-        objShader.use();
-        objShader.setVec3("spotLights[0].position", base);
-        objShader.setVec3("spotLights[0].direction", spotlightMovement);
-        objShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-        objShader.setVec3("spotLights[0].diffuse", 0.5f, 0.5f, 0.5f);
-        objShader.setVec3("spotLights[0].specular", 1.0f, 1.0f, 1.0f);
-        objShader.setFloat("spotLights[0].constant", 1.0f);
-        objShader.setFloat("spotLights[0].linear", 0.09);
-        objShader.setFloat("spotLights[0].quadratic", 0.032);
-        objShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(16.5f)));
-        objShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(25.0f)));
-
-        // rendering the loaded models
-
-        //scene
-        glDisable(GL_CULL_FACE);
-        renderModel(objShader, scene, glm::vec3(0.0f, -10.0f, -10.0f),
-                    glm::vec3(3.0f), glm::vec3(0.0f), 0.0f, false);
-        glEnable(GL_CULL_FACE);
-
-        //tree1 - front, right
-        renderModel(objShader, deadTree, glm::vec3(20.0f, -10.0f, -10.0f),
-                    glm::vec3(3.0f), glm::vec3(0.0f), 0.0f, false);
-
-        //tree2 - back, right
-        renderModel(objShader, deadTree, glm::vec3(15.0f, -10.0f, -30.0f),
-                    glm::vec3(3.0f), glm::vec3(0,1,0), 145.0f,true);
-
-        //tree3 - back, left
-        renderModel(objShader, deadTree, glm::vec3(-30.0f, -10.0f, -30.0f),
-                    glm::vec3(3.0f), glm::vec3(0,1,0), 55.0f,true);
-
-        // red lantern - on the table
-        renderModel(lightSourceShader, redLantern, glm::vec3(-24.0f, -7.3f, -0.5f),
-                    glm::vec3(0.2f), glm::vec3(0,1,0), 55.0f,true);
-
-        // red2 lantern - behind the cabin
-        renderModel(lightSourceShader, redLantern, glm::vec3(10.0f, -10.0f, -25.0f),
-                    glm::vec3(0.4f), glm::vec3(0,1,0), 55.0f,false);
-
-        // bronze lantern - the one that is moving
+        // point and spot lights, the shadowed ones get their faces in the light shadow atlas
+        auto shadowed = [&](size_t slot, const rg::Light &light) {
+            return programState->shadows ? lightShadows.Track(slot, light) : light;
+        };
+        // the green, red and bronze lanterns; lightmapped objects take them from the lightmap, everything
+        // else still lights and shadows itself with them
+        bool useLightmaps = programState->lightmapsLoaded && programState->lightmaps && !programState->deferred;
+        lights.Clear();
+        for (size_t i = 0; i < lanterns.size(); ++i) {
+            rg::Light lantern = lanterns[i];
+            lantern.baked = useLightmaps;
+            lights.Add(shadowed(i, lantern));
+        }
+        // spot light of the swinging lantern
+        lights.Add(shadowed(3, rg::Light::Spot(base, spotlightMovement, glm::vec3(0.0f), glm::vec3(0.5f),
+                                               glm::vec3(1.0f), 1.0f, 0.09f, 0.032f, glm::cos(glm::radians(16.5f)),
+                                               glm::cos(glm::radians(25.0f)))));
+        addExtraLanterns(lights, programState->extraLanterns);
+
+        // instance transforms, culling, LOD selection and sort keys on the job system
+        profiler.Begin("frame prep");
+        sceneObjects.PrepareFrame(*jobs, view, projection, programState->camera.Position, 100.0f, currentFrame);
+        programState->framePrep = sceneObjects.Stats();
+        // shadow casters come from the whole scene, the static ones only when a cached cascade or light
+        // shadow face gets redrawn; which faces do depends on where the animated casters are
+        size_t dynamicCasterBegin = 0;
+        shadowCasters.clear();
+        if (programState->shadows) {
+            if (shadowSceneRevision != sceneObjects.StaticRevision()) {
+                shadowSceneRevision = sceneObjects.StaticRevision();
+                shadowMap.Invalidate();
+                lightShadows.Invalidate();
+            }
+            glm::vec3 sceneMin, sceneMax;
+            sceneObjects.StaticBounds(sceneMin, sceneMax);
+            shadowMap.SetCacheEnabled(programState->shadowCache);
+            shadowMap.Update(view, glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f,
+                             100.0f, moonDirection, sceneMin, sceneMax);
+            sceneObjects.CollectShadowCasters(false, shadowCasters, dynamicCasterBegin);
+            lightShadows.SetBudget(programState->lightShadowBudget);
+            lightShadows.Schedule(shadowCasters, dynamicCasterBegin);
+            if (shadowMap.NeedsStaticCasters() || lightShadows.NeedsStaticCasters())
+                sceneObjects.CollectShadowCasters(true, shadowCasters, dynamicCasterBegin);
+        } else {
+            shadowSceneRevision = ~0u;
+        }
+        size_t drawCount = writeDrawData(*jobs, drawData, sceneObjects.DrawList(), shadowCasters);
+        programState->droppedDraws = (unsigned)drawData.DroppedDraws();
+        profiler.End();
+
+        // the leanest variant for every feature set in the draw list, before their per-frame uniforms are set
+        const vector<rg::DrawItem> &drawList = sceneObjects.DrawList();
+        uint32_t lightingFeatures = 0;
+        if (programState->fog)
+            lightingFeatures |= rg::ShaderFeature::Fog;
+        if (programState->shadows)
+            lightingFeatures |= rg::ShaderFeature::Shadows;
+        if (useLightmaps)
+            lightingFeatures |= rg::ShaderFeature::Lightmap;
+        const bool ambientOcclusion = programState->ssao;
+        if (ambientOcclusion)
+            lightingFeatures |= rg::ShaderFeature::AmbientOcclusion;
+        const bool depthPrePass = programState->depthPrePass || (ambientOcclusion && !programState->deferred);
+        rg::ShaderProgramId modelProgram = programState->deferred ? gBufferProgram : litProgram;
+        uint32_t modelFeatures = programState->deferred ? 0 : lightingFeatures;
+        requestLitVariants(drawList, drawCount, shaders, modelProgram, modelFeatures);
+        // the G-buffer has no lightmap UVs, deferred lighting never uses the lightmap
+        Shader &deferredLightingShader = shaders.Get(deferredLightingProgram,
+                                                     lightingFeatures & ~rg::ShaderFeature::Lightmap);
+        rg::ShaderDefines compositeDefines = rg::ShaderDefines::FromFeatures(bloom ? rg::ShaderFeature::Bloom : 0u);
+        if (upscale)
+            compositeDefines.Set("UPSCALE");
+        if (programState->autoExposure)
+            compositeDefines.Set("AUTO_EXPOSURE");
+        if (programState->colorLut) {
+            compositeDefines.Set("COLOR_LUT");
+            if (programState->reloadColorCube) {
+                programState->colorCubeLoaded = colorGrading.LoadCube(programState->colorCubePath);
+                if (!programState->colorCubeLoaded)
+                    std::cout << "Failed to read the color grading LUT " << programState->colorCubePath << std::endl;
+                programState->reloadColorCube = false;
+            }
+            colorGrading.Update(programState->colorGrade);
+        }
+        Shader &bloomShader = shaders.Get(compositeProgram, compositeDefines);
+        programState->shaderVariants = (unsigned)shaders.VariantCount();
+        programState->shaderVariantsPending = (unsigned)shaders.PendingCount();
+
+        shaders.ForEachVariant(litProgram, [&](Shader &shader) {
+            shader.use();
+            shader.setVec3("viewPos", programState->camera.Position);
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+            setDirectionalLight(shader);
+            skyIrradiance.Apply(shader, programState->skyAmbient);
+            shadowMap.Apply(shader);
+            lightShadows.Apply(shader);
+        });
+
+        shaders.ForEachVariant(gBufferProgram, [&](Shader &shader) {
+            shader.use();
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+        });
+
+        deferredLightingShader.use();
+        deferredLightingShader.setVec3("viewPos", programState->camera.Position);
+        deferredLightingShader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+        deferredLightingShader.setMat4("view", view);
+        setDirectionalLight(deferredLightingShader);
+        skyIrradiance.Apply(deferredLightingShader, programState->skyAmbient);
+        shadowMap.Apply(deferredLightingShader);
+        lightShadows.Apply(deferredLightingShader);
+
         lightSourceShader.use();
-        lightSourceShader.setMat4("model", movementMat);
-        bronzeLantern.Draw(lightSourceShader);
-
-        // bronze lantern
-        renderModel(lightSourceShader, bronzeLantern, glm::vec3(17.0f, -9.5f, -7.0f),
-                    glm::vec3(0.4f), glm::vec3(0,1,0), 55.0f,false);
-
-        // tap & oldTap
-        renderModel(objShader, oldTap, glm::vec3(-17.0f, -9.0f, -15.5f),
-                    glm::vec3(0.4f), glm::vec3(0,1,0), 90.0f, false);
-
-        // cactus pot
-        renderModel(objShader, cactusPot, glm::vec3(-10.7f, -4.25f, -16.5f),
-                    glm::vec3(4.0f), glm::vec3(0,1,0), 55.0f,false);
-
-        // plant with big leaves
-        renderModel(objShader, plant, glm::vec3(13.0f, -10.0f, -7.0f),
-                    glm::vec3(0.2f), glm::vec3(0,1,0), 30.0f,true);
-
-        // trees
-        renderModel(objShader, trees, glm::vec3(-1.0f, -10.0f, -27.0f),
-                    glm::vec3(1.0f), glm::vec3(0,1,0), 55.0f,false);
-
-        // rocks
-        renderModel(objShader, rockA, glm::vec3(-10.0f, -10.0f, -3.0f),
-                    glm::vec3(0.7f), glm::vec3(0,1,0), 55.0f,false);
-        renderModel(objShader, rockB, glm::vec3(-8.5f, -10.0f, -2.5f),
-                    glm::vec3(0.5f), glm::vec3(0,1,0), 55.0f,true);
-        renderModel(objShader, rockC, glm::vec3(-9.0f, -10.0f, -0.7f),
-                    glm::vec3(0.7f), glm::vec3(0,1,0), 30.0f,true);
-        renderModel(objShader, rockG, glm::vec3(-10.5f, -10.0f, -0.9f),
-                    glm::vec3(1.0f), glm::vec3(0,1,0), 30.0f,true);
-
-        renderModel(objShader, rockE, glm::vec3(7.0f, -10.0f, -25.0f),
-                    glm::vec3(1.0f), glm::vec3(0,1,0), 30.0f,true);
-        renderModel(objShader, rockF, glm::vec3(8.0f, -10.0f, -26.7f),
-                    glm::vec3(1.0f), glm::vec3(0,1,0), 30.0f,true);
-
-        renderModel(objShader, rockC, glm::vec3(7.0f, -10.0f, 4.0f),
-                    glm::vec3(0.5f), glm::vec3(0,1,0), 55.0f,false);
-        renderModel(objShader, rockE, glm::vec3(8.0f, -10.0f, 3.0f),
-                    glm::vec3(0.5f), glm::vec3(0,1,0), 55.0f,false);
-
-        // transparent shader
-        transparentShader.use();
-        transparentShader.setMat4("projection", projection);
-        transparentShader.setMat4("view", view);
-        glm::mat4 model = glm::mat4(1.0f);
-        glBindVertexArray(transparentVAO);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
-        transparentShader.use();
-        for (unsigned int i = 0; i < vegetation.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, vegetation[i]);
-            transparentShader.setMat4("model", model);
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+        lightSourceShader.setMat4("projection", projection);
+        lightSourceShader.setMat4("view", view);
+
+        depthShader.use();
+        depthShader.setMat4("projection", projection);
+        depthShader.setMat4("view", view);
+
+        motionVectorsShader.use();
+        motionVectorsShader.setMat4("projection", projection);
+        motionVectorsShader.setMat4("view", view);
+
+        // point and spot lights, assigned to the view frustum clusters on the job system
+        profiler.Begin("light clustering");
+        lights.Build(*jobs, view, projection, 0.1f, 100.0f, renderWidth, renderHeight);
+        if (programState->deferred)
+            lights.Apply(deferredLightingShader);
+        else
+            shaders.ForEachVariant(litProgram, [&](Shader &shader) { lights.Apply(shader); });
+        programState->clusters = lights.Stats();
+        profiler.End();
+
+        // The frame as a render graph. Passes are declared whether they are needed or not: the shadow passes
+        // are culled with shadows off and the bloom passes with bloom off, nothing reads what they write then.
+        renderGraph.Reset();
+        const rg::RenderResource backbuffer = renderGraph.ImportBackbuffer((int)SCR_WIDTH, (int)SCR_HEIGHT);
+        const rg::RenderResource sceneColor =
+                renderGraph.Create("scene color", rg::RenderTargetDesc(renderWidth, renderHeight, hdrColorFormat),
+                                   glm::vec4(programState->clearColor, 1.0f));
+        const rg::RenderResource sceneDepth =
+                renderGraph.Create("scene depth", rg::RenderTargetDesc(renderWidth, renderHeight, hdrDepthFormat));
+        const rg::RenderResource moonShadows = renderGraph.Import("shadow cascades");
+        const rg::RenderResource lanternShadows = renderGraph.Import("light shadow atlas");
+        renderGraph.Output(backbuffer);
+        std::vector<rg::RenderResource> shadowMaps;
+        if (programState->shadows)
+            shadowMaps = {moonShadows, lanternShadows};
+
+        // moonlight shadow cascades, only the dynamic casters unless the cached static depth went stale
+        renderGraph.AddPass("shadows").Store(moonShadows).Execute([&]() {
+            shadowMap.Render(shadowCasters, std::min(dynamicCasterBegin, shadowCasters.size()), drawData,
+                             drawList.size(), shadowDepthShader);
+            // drawn without the casters that had no draw data, don't keep that as the static depth
+            if (programState->droppedDraws)
+                shadowMap.Invalidate();
+            programState->shadowStats = shadowMap.Stats();
+            profiler.CountItems(programState->shadowStats.casterDraws);
+        });
+
+        // lantern and spot light faces, the dirty ones round-robin under the budget
+        renderGraph.AddPass("light shadows").Store(lanternShadows).Execute([&]() {
+            lightShadows.Render(shadowCasters, std::min(dynamicCasterBegin, shadowCasters.size()), drawData,
+                                drawList.size(), shadowDepthShader);
+            if (programState->droppedDraws)
+                lightShadows.Invalidate();
+            programState->lightShadowStats = lightShadows.Stats();
+            profiler.CountItems(programState->lightShadowStats.facesDrawn);
+        });
+
+        // rendering the loaded models; in the deferred path the G-buffer takes the depth, and the forward
+        // passes get it blitted over by the lighting pass
+        rg::RenderResource gAlbedoSpecular = -1, gNormalShininess = -1, geometryDepth = sceneDepth;
+        if (programState->deferred) {
+            gAlbedoSpecular = renderGraph.Create("g-buffer albedo",
+                                                 rg::GBuffer::AlbedoSpecularDesc(renderWidth, renderHeight));
+            gNormalShininess = renderGraph.Create("g-buffer normal",
+                                                  rg::GBuffer::NormalShininessDesc(renderWidth, renderHeight));
+            geometryDepth = renderGraph.Create("g-buffer depth", rg::GBuffer::DepthDesc(renderWidth, renderHeight));
+        }
+        if (depthPrePass) {
+            renderGraph.AddPass("depth pre-pass").Write(geometryDepth).Execute([&]() {
+                submitDepthPrePass(drawList, drawCount, drawData, depthShader);
+            });
         }
+        // every visible surface already has its depth after the pre-pass, shade only the fragments that won
+        auto shadePrePassDepth = [&]() {
+            if (!depthPrePass)
+                return;
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        };
+        // half resolution ambient occlusion from the depth the lit passes are shaded at, once it is there
+        std::vector<rg::RenderResource> occlusionInputs;
+        auto addAmbientOcclusion = [&]() {
+            if (!ambientOcclusion)
+                return;
+            const rg::RenderResource halfDepth =
+                    renderGraph.Create("ssao depth", rg::Ssao::HalfDepthDesc(renderWidth, renderHeight));
+            const rg::RenderResource halfOcclusion =
+                    renderGraph.Create("ssao", rg::Ssao::HalfOcclusionDesc(renderWidth, renderHeight));
+            const rg::RenderResource blurredOcclusion =
+                    renderGraph.Create("ssao blur", rg::Ssao::HalfOcclusionDesc(renderWidth, renderHeight));
+            const rg::RenderResource occlusion =
+                    renderGraph.Create("ambient occlusion", rg::Ssao::OcclusionDesc(renderWidth, renderHeight));
+            occlusionInputs = {occlusion};
+            renderGraph.AddPass("ssao depth").Read(geometryDepth).Overwrite(halfDepth).Execute([&]() {
+                ssao.DownsampleDepth(ssaoDepthShader, renderGraph.Texture(geometryDepth), projection);
+            });
+            renderGraph.AddPass("ssao")
+                    .Read(halfDepth)
+                    .Overwrite(halfOcclusion)
+                    .Execute([&, halfDepth]() {
+                        ssao.Occlusion(ssaoShader, renderGraph.Texture(halfDepth), projection,
+                                       (rg::SsaoQuality)programState->ssaoQuality, programState->ssaoRadius,
+                                       programState->ssaoPower);
+                    });
+            renderGraph.AddPass("ssao blur")
+                    .Read(halfOcclusion)
+                    .Overwrite(blurredOcclusion)
+                    .Execute([&, halfOcclusion]() {
+                        ssao.Blur(ssaoBlurShader, renderGraph.Texture(halfOcclusion));
+                    });
+            renderGraph.AddPass("ssao upsample")
+                    .Read(blurredOcclusion)
+                    .Read(geometryDepth)
+                    .Overwrite(occlusion)
+                    .Execute([&, blurredOcclusion]() {
+                        ssao.Upsample(ssaoUpsampleShader, renderGraph.Texture(blurredOcclusion),
+                                      renderGraph.Texture(geometryDepth), projection);
+                    });
+        };
+        auto bindAmbientOcclusion = [&]() {
+            if (ambientOcclusion)
+                rg::Ssao::Bind(renderGraph.Texture(occlusionInputs[0]));
+        };
+        if (programState->deferred) {
+            // lit objects go to the G-buffer, the emissive light sources are drawn forward afterwards
+            size_t litCount = 0;
+            while (litCount < drawCount && drawList[litCount].pass == rg::ShadingPass::Lit)
+                litCount++;
+            renderGraph.AddPass("g-buffer")
+                    .Write(gAlbedoSpecular)
+                    .Write(gNormalShininess)
+                    .Write(geometryDepth)
+                    .Execute([&, litCount]() {
+                        gBuffer.SetTargets(renderGraph.Framebuffer(), renderGraph.Texture(gAlbedoSpecular),
+                                           renderGraph.Texture(gNormalShininess), renderGraph.Texture(geometryDepth),
+                                           renderWidth, renderHeight);
+                        shadePrePassDepth();
+                        submitDrawList(drawList, 0, litCount, drawData, shaders, gBufferProgram, 0, lightSourceShader,
+                                       depthPrePass);
+                        profiler.CountItems((unsigned)litCount);
+                        glDepthFunc(GL_LESS);
+                        glDepthMask(GL_TRUE);
+                    });
+            addAmbientOcclusion();
+
+            // the lighting pass skips the background, the sky is drawn over the cleared colour later
+            renderGraph.AddPass("deferred lighting")
+                    .Read(gAlbedoSpecular)
+                    .Read(gNormalShininess)
+                    .Read(geometryDepth)
+                    .Read(shadowMaps)
+                    .Read(occlusionInputs)
+                    .Write(sceneColor)
+                    .Overwrite(sceneDepth)
+                    .Execute([&]() {
+                        glDisable(GL_DEPTH_TEST);
+                        deferredLightingShader.use();
+                        gBuffer.BindTextures();
+                        bindAmbientOcclusion();
+                        renderQuad();
+                        glEnable(GL_DEPTH_TEST);
+                        gBuffer.BlitDepth(renderGraph.Framebuffer());
+                    });
+
+            renderGraph.AddPass("opaque")
+                    .Read(shadowMaps)
+                    .Read(occlusionInputs)
+                    .Write(sceneColor)
+                    .Write(sceneDepth)
+                    .Execute([&, litCount]() {
+                        bindAmbientOcclusion();
+                        // LEQUAL: with the pre-pass on, the light sources already have their exact depth in there
+                        glDepthFunc(GL_LEQUAL);
+                        submitDrawList(drawList, litCount, drawCount, drawData, shaders, litProgram, lightingFeatures,
+                                       lightSourceShader, false);
+                        profiler.CountItems((unsigned)(drawCount - litCount));
+                        glDepthFunc(GL_LESS);
+                    });
+        } else {
+            addAmbientOcclusion();
+            renderGraph.AddPass("opaque")
+                    .Read(shadowMaps)
+                    .Read(occlusionInputs)
+                    .Write(sceneColor)
+                    .Write(sceneDepth)
+                    .Execute([&]() {
+                        if (useLightmaps)
+                            lightmaps.Bind();
+                        bindAmbientOcclusion();
+                        shadePrePassDepth();
+                        submitDrawList(drawList, 0, drawCount, drawData, shaders, litProgram, lightingFeatures,
+                                       lightSourceShader, depthPrePass);
+                        profiler.CountItems((unsigned)drawCount);
+                        glDepthFunc(GL_LESS);
+                        glDepthMask(GL_TRUE);
+                    });
+        }
+
+        renderGraph.AddPass("wooden box").Write(sceneColor).Write(sceneDepth).Execute([&]() {
+            setWoodenBox(lightingShader, diffuseMap, specularMap, boxVAO, projection);
+        });
+
+        // what moved since the last frame, the animated bronze lantern say, for the temporal resolve; the
+        // rest of the scene only moves with the camera, which the resolve reprojects from depth
+        rg::RenderResource objectMotion = -1;
+        if (temporal) {
+            objectMotion = renderGraph.Create("object motion", rg::RenderTargetDesc(renderWidth, renderHeight,
+                                                                                    rg::TemporalUpsampler::MotionFormat));
+            renderGraph.AddPass("motion vectors").Write(objectMotion).Write(sceneDepth).Execute([&]() {
+                profiler.CountItems(submitMotionVectors(drawList, drawCount, drawData, motionVectorsShader,
+                                                        temporalUpsampler.PreviousViewProjection()));
+            });
+        }
+
+        // transparent cards, sorted back to front after the opaque geometry
+        renderGraph.AddPass("transparent").Write(sceneColor).Write(sceneDepth).Execute([&]() {
+            transparentShader.use();
+            transparentShader.setMat4("projection", projection);
+            transparentShader.setMat4("view", view);
+            glEnable(GL_BLEND);
+            // the cards' coverage also covers up the emissive mask in the destination alpha
+            glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glDisable(GL_CULL_FACE);
+            transparentCards.Draw(*jobs, view, projection);
+            programState->transparency = transparentCards.Stats();
+            glEnable(GL_CULL_FACE);
+            glDisable(GL_BLEND);
+        });
 
         //skybox
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        //glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
-        glDepthMask(GL_TRUE);
-
-        // blur bright fragments with two-pass Gaussian Blur
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 5;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingPongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingPongColorBuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+        renderGraph.AddPass("skybox").Write(sceneColor).Write(sceneDepth).Execute([&]() {
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+            skyboxShader.use();
+            glm::mat4 skyView = glm::mat4(glm::mat3(view)); // remove translation from the view matrix
+            skyboxShader.setMat4("view", skyView);
+            skyboxShader.setMat4("projection", projection);
+
+            // skybox cube
+            glBindVertexArray(skyboxVAO);
+            //glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glBindVertexArray(0);
+            glDepthFunc(GL_LESS); // set depth function back to default
+            glDepthMask(GL_TRUE);
+        });
+
+        // the jittered frames accumulated at the window's size
+        rg::RenderResource sceneOutput = sceneColor;
+        if (temporal) {
+            sceneOutput = renderGraph.Import("temporal history", temporalUpsampler.Output(),
+                                             temporalUpsampler.OutputDesc());
+            renderGraph.AddPass("temporal resolve")
+                    .Read(sceneColor)
+                    .Read(sceneDepth)
+                    .Read(objectMotion)
+                    .Overwrite(sceneOutput)
+                    .Execute([&]() {
+                        temporalUpsampler.Resolve(temporalResolveShader, renderGraph.Texture(sceneColor),
+                                                  renderGraph.Texture(sceneDepth), renderGraph.Texture(objectMotion),
+                                                  renderWidth, renderHeight);
+                    });
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingPongColorBuffers[!horizontal]);
-        bloomShader.setInt("bloom", bloom);
-        bloomShader.setFloat("exposure", exposure);
-        renderQuad();
+        // blur bright fragments, through the mip chain or with the full resolution two-pass Gaussian blur
+        const rg::RenderTargetDesc bloomDesc = bloomChain.OutputDesc();
+        const rg::RenderResource bloomBright = renderGraph.Create("bloom", bloomDesc);
+        rg::RenderResource bloomResult = bloomBright;
+        float bloomScale = programState->bloomIntensity;
+        renderGraph.AddPass("bloom bright pass").Read(sceneColor).Overwrite(bloomBright).Execute([&]() {
+            bloomChain.BrightPass(renderTargets, renderGraph.Texture(sceneColor), renderGraph.Texture(bloomBright),
+                                  bloomBrightPassShader, programState->bloomThreshold, programState->bloomKnee,
+                                  programState->bloomEmissive);
+        });
+        if (programState->bloomMipChain) {
+            renderGraph.AddPass("bloom mip chain").Store(bloomBright).Execute([&]() {
+                bloomChain.Blur(renderTargets, renderGraph.Texture(bloomBright), bloomDownsampleShader,
+                                bloomUpsampleShader, programState->bloomRadius);
+            });
+            bloomScale *= bloomChain.OutputScale();
+        } else if (computeBlur && programState->bloomCompute) {
+            // the same passes as below, each a row or column of work groups writing through an image
+            bloomResult = renderGraph.Create("bloom blur", bloomDesc);
+            renderGraph.AddPass("bloom blur (compute)").Store(bloomBright).Store(bloomResult).Execute([&]() {
+                const GLuint runs = (GLuint)((bloomDesc.width + 127) / 128);
+                const GLuint columnRuns = (GLuint)((bloomDesc.height + 127) / 128);
+                Shader *blurPass[2] = {&shaders.Get(blurComputeProgram, blurDirection[0]),
+                                       &shaders.Get(blurComputeProgram, blurDirection[1])};
+                GLuint targets[2] = {renderGraph.Texture(bloomBright), renderGraph.Texture(bloomResult)};
+                bool horizontal = true;
+                for (unsigned int i = 0; i < bloomBlurPasses; i++)
+                {
+                    blurPass[horizontal]->use();
+                    glBindTexture(GL_TEXTURE_2D, targets[i % 2]);
+                    rg::glext().BindImageTexture(0, targets[(i + 1) % 2], 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                                                 GL_R11F_G11F_B10F);
+                    if (horizontal)
+                        rg::glext().DispatchCompute(runs, (GLuint)bloomDesc.height, 1);
+                    else
+                        rg::glext().DispatchCompute(columnRuns, (GLuint)bloomDesc.width, 1);
+                    // the next pass and the composite sample what was just stored
+                    rg::glext().MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+                    horizontal = !horizontal;
+                }
+            });
+        } else {
+            bloomResult = renderGraph.Create("bloom blur", bloomDesc);
+            renderGraph.AddPass("bloom blur").Store(bloomBright).Overwrite(bloomResult).Execute([&]() {
+                Shader *blurPass[2] = {&shaders.Get(blurProgram, blurDirection[0]),
+                                       &shaders.Get(blurProgram, blurDirection[1])};
+                GLuint targets[2] = {renderGraph.Texture(bloomBright), renderGraph.Texture(bloomResult)};
+                bool horizontal = true;
+                for (unsigned int i = 0; i < bloomBlurPasses; i++)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, renderTargets.Framebuffer({targets[(i + 1) % 2]}));
+                    blurPass[horizontal]->use();
+                    glBindTexture(GL_TEXTURE_2D, targets[i % 2]);
+                    renderQuad();
+                    horizontal = !horizontal;
+                }
+            });
+        }
 
-        //if (programState->ImGuiEnabled)
-        //    DrawImGui(programState);
+        // the scene's average luminance, adapted over time, without leaving the GPU; culled with auto
+        // exposure off, the next time it runs starts from the scene as it is then
+        const rg::RenderResource adaptedLuminance = renderGraph.Import("adapted luminance");
+        renderGraph.AddPass("auto exposure").Read(sceneColor).Store(adaptedLuminance).Execute([&]() {
+            autoExposure.Update(luminanceShader, adaptLuminanceShader, renderGraph.Texture(sceneColor), deltaTime,
+                                programState->adaptationSpeedUp, programState->adaptationSpeedDown,
+                                programState->minAdaptedLuminance, programState->maxAdaptedLuminance);
+        });
+        if (!programState->autoExposure)
+            autoExposure.Reset();
+
+        // the quad covers every pixel, the default framebuffer needs no clear
+        rg::RenderGraph::PassBuilder composite = renderGraph.AddPass("composite");
+        composite.Read(sceneOutput).Overwrite(backbuffer);
+        if (bloom)
+            composite.Read(bloomResult);
+        if (programState->autoExposure)
+            composite.Read(adaptedLuminance);
+        composite.Execute([&]() {
+            glDisable(GL_DEPTH_TEST);
+            bloomShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture(sceneOutput));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, bloom ? renderGraph.Texture(bloomResult) : 0);
+            glActiveTexture(GL_TEXTURE0);
+            if (programState->autoExposure) {
+                glActiveTexture(GL_TEXTURE0 + rg::AutoExposure::AdaptedUnit);
+                glBindTexture(GL_TEXTURE_2D, autoExposure.AdaptedLuminance());
+                glActiveTexture(GL_TEXTURE0);
+                bloomShader.setFloat("exposureKey", programState->exposureKey);
+            }
+            if (programState->colorLut) {
+                glActiveTexture(GL_TEXTURE0 + rg::ColorGrading::LutUnit);
+                glBindTexture(GL_TEXTURE_3D, colorGrading.Texture());
+                glActiveTexture(GL_TEXTURE0);
+            }
+            bloomShader.setFloat("exposure", exposure);
+            bloomShader.setFloat("bloomIntensity", bloomScale);
+            if (upscale)
+                bloomShader.setVec2("sceneSize", (float)renderWidth, (float)renderHeight);
+            renderQuad();
+            glEnable(GL_DEPTH_TEST);
+        });
+
+        dynamicResolution.Begin();
+        renderGraph.Execute(renderTargets, profiler);
+        dynamicResolution.End();
+        if (temporal)
+            temporalUpsampler.EndFrame();
+        renderTargets.EndFrame();
+        programState->renderTargets = renderTargets.Stats();
+        programState->renderGraph = renderGraph.Stats();
+
+        if (programState->ImGuiEnabled)
+            DrawImGui(programState, profiler);
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        drawData.EndFrame();
+        lights.EndFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    drawData.Destroy();
+    lights.Destroy();
+    bloomChain.Destroy();
+    temporalUpsampler.Destroy(renderTargets);
+    autoExposure.Destroy();
+    colorGrading.Destroy();
+    ssao.Destroy();
+    renderTargets.Destroy();
+    dynamicResolution.Destroy();
+    shadowMap.Destroy();
+    lightShadows.Destroy();
+    lightmaps.Destroy();
+    shaders.Destroy();
+    transparentCards.Destroy();
+    profiler.Destroy();
+
     programState->SaveToFile("resources/program_state.txt");
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
@@ -728,10 +1472,8 @@ int main() {
 
     glDeleteVertexArrays(1, &boxVAO);
     glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteVertexArrays(1, &transparentVAO);
     glDeleteBuffers(1, &boxVBO);
     glDeleteBuffers(1, &skyboxVBO);
-    glDeleteBuffers(1, &transparentVBO);
 
     glfwTerminate();
     return 0;
@@ -759,6 +1501,11 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    // the frame renders at the framebuffer's size in pixels, minimized windows keep the last one
+    if (width > 0 && height > 0) {
+        SCR_WIDTH = (unsigned int)width;
+        SCR_HEIGHT = (unsigned int)height;
+    }
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -786,7 +1533,7 @@ void scroll_callback(GLFWwindow *window, double xOffset, double yOffset) {
     programState->camera.ProcessMouseScroll((float)yOffset);
 }
 
-void DrawImGui(ProgramState *programState) {
+void DrawImGui(ProgramState *programState, const rg::Profiler &profiler) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -817,6 +1564,140 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Frame preparation");
+        const rg::FramePrepStats& stats = programState->framePrep;
+        ImGui::Text("Prep time: %.3f ms on %u threads", stats.prepMs, stats.threadCount);
+        ImGui::Text("Objects: %u, visible: %u", stats.objectCount, stats.visibleCount);
+        if (programState->droppedDraws)
+            ImGui::Text("Draw data buffer not mapped, dropped draws: %u", programState->droppedDraws);
+        ImGui::SliderInt("Worker threads", &programState->jobThreads, 1, 32);
+        ImGui::DragInt("Stress objects", &programState->stressObjects, 100.0f, 0, 100000);
+        ImGui::Separator();
+        const rg::TransparencyStats& cards = programState->transparency;
+        ImGui::Text("Transparent cards: %u, visible: %u, draw calls: %u", cards.instanceCount, cards.visibleCount, cards.drawCalls);
+        ImGui::Text("Cull, sort and upload: %.3f ms", cards.sortMs);
+        ImGui::DragInt("Stress foliage", &programState->stressFoliage, 100.0f, 0, 200000);
+        ImGui::Separator();
+        const rg::ClusterStats& clusters = programState->clusters;
+        ImGui::Text("Lights: %u, cluster light indices: %u, most in one cluster: %u", clusters.lightCount,
+                    clusters.indexCount, clusters.maxLightsPerCluster);
+        ImGui::Text("Light clustering: %.3f ms", clusters.buildMs);
+        ImGui::DragInt("Extra lanterns", &programState->extraLanterns, 4.0f, 0, 4096);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Renderer");
+        ImGui::Checkbox("Depth pre-pass (P)", &programState->depthPrePass);
+        ImGui::Checkbox("Deferred shading (G)", &programState->deferred);
+        ImGui::Checkbox("Fog", &programState->fog);
+        ImGui::SliderFloat("Sky ambient", &programState->skyAmbient, 0.0f, 1.5f);
+        ImGui::Checkbox("SSAO (O)", &programState->ssao);
+        if (programState->ssao) {
+            ImGui::Combo("SSAO quality", &programState->ssaoQuality,
+                         "Low, 8 samples\0Medium, 16 samples\0High, 32 samples\0");
+            ImGui::SliderFloat("SSAO radius", &programState->ssaoRadius, 0.1f, 2.0f);
+            ImGui::SliderFloat("SSAO power", &programState->ssaoPower, 0.5f, 4.0f);
+            if (!programState->deferred && !programState->depthPrePass)
+                ImGui::Text("Forward shading runs the depth pre-pass for SSAO");
+        }
+        ImGui::Checkbox("Shadows", &programState->shadows);
+        ImGui::Checkbox("Cache static shadow casters", &programState->shadowCache);
+        if (programState->shadows)
+            ImGui::Text("Shadow caster draws: %u, static cascades redrawn: %u", programState->shadowStats.casterDraws,
+                        programState->shadowStats.staticCascadesDrawn);
+        if (programState->lightmapsLoaded)
+            ImGui::Checkbox("Baked lantern lightmaps (forward)", &programState->lightmaps);
+        else
+            ImGui::Text("Lightmaps: none baked, see lightmap_baker");
+        ImGui::Checkbox("Bloom (B)", &bloom);
+        if (bloom) {
+            ImGui::Checkbox("Bloom mip chain", &programState->bloomMipChain);
+            ImGui::SliderFloat("Bloom threshold", &programState->bloomThreshold, 0.0f, 4.0f);
+            ImGui::SliderFloat("Bloom soft knee", &programState->bloomKnee, 0.0f, 1.0f);
+            ImGui::SliderFloat("Emissive bloom", &programState->bloomEmissive, 0.0f, 4.0f);
+            if (programState->bloomMipChain)
+                ImGui::SliderFloat("Bloom radius", &programState->bloomRadius, 0.5f, 3.0f);
+            else if (rg::glext().computeShaders)
+                ImGui::Checkbox("Gaussian blur in compute shaders", &programState->bloomCompute);
+            ImGui::SliderFloat("Bloom intensity", &programState->bloomIntensity, 0.0f, 4.0f);
+        }
+        ImGui::SliderInt("Light shadow faces per frame", &programState->lightShadowBudget, 1, rg::LightShadowAtlas::MaxFaces);
+        if (programState->shadows) {
+            const rg::LightShadowStats& faces = programState->lightShadowStats;
+            ImGui::Text("Light shadows: %u lights, %u faces, %u dirty, %u drawn, %u caster draws", faces.lightCount,
+                        faces.faceCount, faces.dirtyFaces, faces.facesDrawn, faces.casterDraws);
+        }
+        ImGui::Checkbox("Dynamic resolution", &programState->dynamicResolution);
+        if (programState->dynamicResolution) {
+            ImGui::SliderFloat("Target frame time (ms)", &programState->targetFrameMs, 4.0f, 50.0f);
+            ImGui::SliderFloat("Minimum resolution scale", &programState->minResolutionScale, 0.25f, 1.0f);
+        } else {
+            ImGui::SliderFloat("Resolution scale", &programState->renderScale, 0.25f, 1.0f);
+        }
+        ImGui::Checkbox("Temporal upsampling", &programState->temporalUpsampling);
+        ImGui::Checkbox("Auto exposure", &programState->autoExposure);
+        if (programState->autoExposure) {
+            ImGui::SliderFloat("Exposure key", &programState->exposureKey, 0.02f, 1.0f);
+            ImGui::SliderFloat("Adaptation to brighter (1/s)", &programState->adaptationSpeedUp, 0.1f, 10.0f);
+            ImGui::SliderFloat("Adaptation to darker (1/s)", &programState->adaptationSpeedDown, 0.1f, 10.0f);
+            ImGui::DragFloatRange2("Adapted luminance", &programState->minAdaptedLuminance,
+                                   &programState->maxAdaptedLuminance, 0.01f, 0.001f, 16.0f);
+        }
+        ImGui::Checkbox("Color grading LUT", &programState->colorLut);
+        if (programState->colorLut) {
+            rg::ColorGradeParams &grade = programState->colorGrade;
+            ImGui::SliderFloat("Gamma", &grade.gamma, 1.0f, 2.6f);
+            ImGui::SliderFloat("Contrast", &grade.contrast, 0.5f, 2.0f);
+            ImGui::SliderFloat("Saturation", &grade.saturation, 0.0f, 2.0f);
+            ImGui::ColorEdit3("Color filter", &grade.colorFilter[0]);
+            ImGui::InputText(".cube file", programState->colorCubePath, sizeof(programState->colorCubePath));
+            ImGui::SameLine();
+            programState->reloadColorCube |= ImGui::Button("Load");
+            ImGui::Text(programState->colorCubeLoaded ? "Grading with the .cube file" : "No .cube grade");
+        }
+        ImGui::Text("Resolution scale: %.0f%%, GPU frame: %.2f ms", programState->resolutionScale * 100.0f,
+                    programState->gpuFrameMs);
+        ImGui::Text("Shader variants: %u, compiling: %u", programState->shaderVariants,
+                    programState->shaderVariantsPending);
+        if (programState->deferred)
+            ImGui::Text("G-buffer: %d bytes/pixel, %.1f MB", rg::GBuffer::BytesPerPixel,
+                        (double)(SCR_WIDTH * SCR_HEIGHT * rg::GBuffer::BytesPerPixel) *
+                                (double)(programState->resolutionScale * programState->resolutionScale) /
+                                (1024.0 * 1024.0));
+        const rg::RenderTargetStats& targets = programState->renderTargets;
+        ImGui::Text("Render targets at %ux%u: %u textures, %.1f MB, %.1f MB in use at once", SCR_WIDTH, SCR_HEIGHT,
+                    targets.textureCount, (double)targets.totalBytes / (1024.0 * 1024.0),
+                    (double)targets.framePeakBytes / (1024.0 * 1024.0));
+        const rg::RenderGraphStats& graph = programState->renderGraph;
+        ImGui::Text("Render graph: %u passes, %u culled, %u clears, %u transient targets", graph.passCount,
+                    graph.culledCount, graph.clearCount, graph.transientCount);
+        ImGui::Separator();
+        ImGui::Columns(4);
+        ImGui::Text("pass");
+        ImGui::NextColumn();
+        ImGui::Text("cpu ms");
+        ImGui::NextColumn();
+        ImGui::Text("gpu ms");
+        ImGui::NextColumn();
+        ImGui::Text("cpu us/item");
+        ImGui::NextColumn();
+        for (const rg::PassTiming *timing : profiler.Timings()) {
+            ImGui::Text("%s", timing->name.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", timing->cpuMs);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", timing->gpuMs);
+            ImGui::NextColumn();
+            if (timing->items)
+                ImGui::Text("%.3f", timing->cpuMs * 1000.0 / timing->items);
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -849,6 +1730,36 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
     {
         hdrKeyPressed = false;
     }
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        programState->depthPrePass = !programState->depthPrePass;
+    if (key == GLFW_KEY_G && action == GLFW_PRESS)
+        programState->deferred = !programState->deferred;
+    if (key == GLFW_KEY_O && action == GLFW_PRESS)
+        programState->ssao = !programState->ssao;
+}
+
+// --size WxH sets the window size, --bench N runs the benchmark for N frames per configuration,
+// --target-frame-ms MS turns on dynamic resolution with that target, --grade FILE grades with a .cube LUT
+void parseArguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            unsigned int width = 0, height = 0;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0) {
+                SCR_WIDTH = width;
+                SCR_HEIGHT = height;
+            }
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--target-frame-ms" && i + 1 < argc) {
+            targetFrameMs = std::max(1.0f, (float)atof(argv[++i]));
+        } else if (arg == "--grade" && i + 1 < argc) {
+            colorCubeFile = argv[++i];
+        } else {
+            std::cout << "Unknown argument: " << arg << std::endl;
+        }
+    }
 }
 
 unsigned int loadCubemap(vector<std::string> faces)
@@ -922,7 +1833,8 @@ unsigned int loadTexture(char const *path)
     return textureId;
 }
 
-void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int specularMap, unsigned int boxVAO)
+void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int specularMap, unsigned int boxVAO,
+                  const glm::mat4 &projection)
 {
     //set shader
     lightingShader.use();
@@ -937,8 +1849,7 @@ void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int
     // material properties
     lightingShader.setFloat("material.shininess", 64.0f);
 
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    // view/projection transformations, the frame's projection with its jitter
     glm::mat4 view = programState->camera.GetViewMatrix();
     lightingShader.setMat4("projection", projection);
     lightingShader.setMat4("view", view);
@@ -947,6 +1858,7 @@ void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(17.0f, -10.0f, -7.0f));
     lightingShader.setMat4("model", model);
+    lightingShader.setMat3("normalMatrix", rg::ComputeNormalMatrix(model));
 
     // bind diffuse map
     glActiveTexture(GL_TEXTURE0);
@@ -961,18 +1873,222 @@ void setWoodenBox(Shader &lightingShader, unsigned int diffuseMap, unsigned int
 
 }
 
-void renderModel(Shader &ourShader, Model &ourModel, const glm::vec3 &translateVec, const glm::vec3 &scalarVec,
-                 const glm::vec3 &rotateVec, float angle, bool rotate)
+// the swinging bronze lantern hanging from the dead tree
+glm::mat4 lanternSwing(float time)
+{
+    glm::mat4 movementMat = glm::mat4(1.0f);
+    movementMat = glm::translate(movementMat, glm::vec3(-10.7f, -4.6f, -16.7f));
+    movementMat = glm::scale(movementMat, glm::vec3(0.4f, 0.4f, 0.4f));
+    movementMat = glm::rotate(movementMat, sin(time * 1.5f) * glm::radians(60.0f), glm::vec3(0, 0, 1));
+    movementMat = glm::translate(movementMat, glm::vec3(0.0f, -3.0f, 0.0f));
+    return movementMat;
+}
+
+// keeps count filler rocks scattered around the shack after the first baseObjectCount scene objects,
+// lods[i] is the simplified copy of models[i] drawn at a distance
+void updateStressObjects(rg::Scene &scene, size_t baseObjectCount, int count, const vector<Model*> &models,
+                         vector<Model> &lods)
+{
+    scene.Truncate(baseObjectCount);
+    unsigned int seed = 12345u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / 16777216.0f;
+    };
+    for (int i = 0; i < count; i++) {
+        float angle = random01() * 6.2831853f;
+        float radius = 35.0f + random01() * 200.0f;
+        glm::vec3 position(cos(angle) * radius, -10.0f, -10.0f + sin(angle) * radius);
+        rg::SceneObject rock = rg::SceneObject::Static(*models[i % models.size()], rg::ShadingPass::Lit, position,
+                                                       glm::vec3(0.5f + random01()), glm::vec3(0,1,0),
+                                                       random01() * 6.2831853f, true);
+        // simplified past 45, and small far away rocks are not worth a draw call at all
+        rock.lods[0].maxDistance = 45.0f;
+        rock.AddLod(lods[i % lods.size()], 90.0f);
+        scene.AddObject(rock);
+    }
+}
+
+// keeps count grass cards scattered around the shack after the first baseCardCount cards
+void updateStressFoliage(rg::TransparentCards &cards, size_t baseCardCount, int count, uint32_t batch)
+{
+    cards.Truncate(baseCardCount);
+    unsigned int seed = 54321u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / 16777216.0f;
+    };
+    for (int i = 0; i < count; i++) {
+        float angle = random01() * 6.2831853f;
+        float radius = 8.0f + random01() * 120.0f;
+        float scale = 0.6f + random01() * 0.8f;
+        // cards are centred vertically, keep their bottom edge on the ground
+        glm::vec3 position(cos(angle) * radius, -9.5f + 0.5f * scale, -10.0f + sin(angle) * radius);
+        cards.Add(batch, position, scale);
+    }
+}
+
+// small coloured lights scattered over the ground around the shack, for testing many lights
+void addExtraLanterns(rg::ClusteredLights &lights, int count)
+{
+    unsigned int seed = 777u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / 16777216.0f;
+    };
+    for (int i = 0; i < count; i++) {
+        float angle = random01() * 6.2831853f;
+        float radius = 4.0f + random01() * 40.0f;
+        glm::vec3 position(cos(angle) * radius, -9.0f + random01() * 3.0f, -10.0f + sin(angle) * radius);
+        glm::vec3 color = glm::mix(glm::vec3(1.0f, 0.6f, 0.2f), glm::vec3(0.3f, 0.6f, 1.0f), random01());
+        lights.Add(rg::Light::Point(position, glm::vec3(0.0f), color, color, 1.0f, 0.7f, 1.8f));
+    }
+}
+
+// fills this frame's region of the draw data ring buffer: records of the draw list first, then one per
+// shadow caster. Returns how many draws of the draw list have a record, all of them unless the buffer
+// could not be mapped; the casters are then dropped as well.
+size_t writeDrawData(rg::JobSystem &jobs, rg::DrawDataBuffer &drawData, const vector<rg::DrawItem> &drawList,
+                     vector<rg::ShadowCaster> &casters)
+{
+    size_t count = drawList.size() + casters.size();
+    if (!drawData.Begin(count))
+        casters.clear();
+    size_t drawCount = std::min(count, drawList.size());
+    jobs.ParallelFor(count, 512, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (i < drawCount) {
+                const rg::DrawItem &item = drawList[i];
+                drawData.Record(i).Set(item.transform, item.normalMatrix, item.shininess, item.materialIndex,
+                                       item.lightmapRegion);
+            } else {
+                drawData.Record(i).Set(casters[i - drawCount].transform, glm::mat3(1.0f), 0.0f, 0);
+            }
+        }
+    });
+    drawData.End();
+    return drawCount;
+}
+
+void submitDepthPrePass(const vector<rg::DrawItem> &drawList, size_t drawCount, const rg::DrawDataBuffer &drawData,
+                        Shader &depthShader)
+{
+    bool cullFaces = true;
+    glEnable(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    depthShader.use();
+    drawData.Bind();
+    for (size_t i = 0; i < drawCount; i++) {
+        const rg::DrawItem &item = drawList[i];
+        if (item.features & rg::ShaderFeature::AlphaTest)
+            continue; // needs its texture for the depth, see submitDrawList
+        if (item.cullFaces != cullFaces) {
+            cullFaces = item.cullFaces;
+            if (cullFaces)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+        }
+        drawData.Select(i);
+        item.model->DrawDepth();
+    }
+    rg::DrawDataBuffer::SetDrawId(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glEnable(GL_CULL_FACE);
+}
+
+// Draws the objects that moved since the last frame into the bound object motion target, depth tested
+// against the finished scene depth; returns how many
+unsigned submitMotionVectors(const vector<rg::DrawItem> &drawList, size_t drawCount, const rg::DrawDataBuffer &drawData,
+                             Shader &motionShader, const glm::mat4 &previousViewProjection)
 {
-    ourShader.use();
-    glm::mat4 modelMat = glm::mat4(1.0f);
-    modelMat = glm::translate(modelMat, translateVec);
-    modelMat = glm::scale(modelMat, scalarVec);
-    if(rotate)
-        modelMat = glm::rotate(modelMat, angle, rotateVec);
-    ourShader.setMat4("model", modelMat);
-    ourModel.Draw(ourShader);
+    unsigned count = 0;
+    motionShader.use();
+    motionShader.setMat4("previousViewProjection", previousViewProjection);
+    drawData.Bind();
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    for (size_t i = 0; i < drawCount; i++) {
+        const rg::DrawItem &item = drawList[i];
+        if (!item.moving)
+            continue;
+        motionShader.setMat4("previousModel", item.previousTransform);
+        drawData.Select(i);
+        item.model->DrawDepth();
+        count++;
+    }
+    rg::DrawDataBuffer::SetDrawId(0);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    return count;
+}
+
+// starts compiling the variants of litProgram the lit draws need, once per material feature set
+void requestLitVariants(const vector<rg::DrawItem> &drawList, size_t drawCount, rg::ShaderLibrary &shaders,
+                        rg::ShaderProgramId litProgram, uint32_t globalFeatures)
+{
+    uint32_t featureSets = 0;
+    for (size_t i = 0; i < drawCount && drawList[i].pass == rg::ShadingPass::Lit; i++)
+        featureSets |= 1u << drawList[i].features;
+    for (uint32_t features = 0; features < 16; features++) {
+        if (featureSets & (1u << features))
+            shaders.Request(litProgram, features | globalFeatures);
+    }
 }
+
+void submitDrawList(const vector<rg::DrawItem> &drawList, size_t begin, size_t end, const rg::DrawDataBuffer &drawData,
+                    rg::ShaderLibrary &shaders, rg::ShaderProgramId litProgram, uint32_t globalFeatures,
+                    Shader &lightSourceShader, bool depthPrePass)
+{
+    Shader *current = nullptr;
+    uint32_t currentFeatures = ~0u;
+    bool cullFaces = true;
+    bool alphaTest = false;
+    bool lightmapped = (globalFeatures & rg::ShaderFeature::Lightmap) != 0;
+    glEnable(GL_CULL_FACE);
+    drawData.Bind();
+    for (size_t i = begin; i < end; i++) {
+        const rg::DrawItem &item = drawList[i];
+        bool lit = item.pass == rg::ShadingPass::Lit;
+        uint32_t features = lit ? item.features : ~0u;
+        if (features != currentFeatures || !current) {
+            current = lit ? &shaders.Get(litProgram, features | globalFeatures) : &lightSourceShader;
+            current->use();
+            currentFeatures = features;
+        }
+        // alpha-tested draws are left out of the pre-pass, so they write their own depth
+        bool itemAlphaTest = lit && (item.features & rg::ShaderFeature::AlphaTest);
+        if (depthPrePass && itemAlphaTest != alphaTest) {
+            alphaTest = itemAlphaTest;
+            glDepthFunc(alphaTest ? GL_LESS : GL_EQUAL);
+            glDepthMask(alphaTest ? GL_TRUE : GL_FALSE);
+        }
+        if (item.cullFaces != cullFaces) {
+            cullFaces = item.cullFaces;
+            if (cullFaces)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+        }
+        drawData.Select(i);
+        // only lightmapped shaders read the lightmap UVs, everything else draws the indexed meshes
+        item.model->Draw(*current, lightmapped && lit && item.lightmapRegion >= 0);
+    }
+    rg::DrawDataBuffer::SetDrawId(0);
+    glEnable(GL_CULL_FACE);
+}
+
+// the moonlight shared by the forward and deferred lighting shaders
+void setDirectionalLight(Shader &shader)
+{
+    shader.use();
+    shader.setVec3("dirLight.direction", moonDirection);
+    shader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.6f);
+    shader.setVec3("dirLight.specular", 1.0f, 1.0f, 0.7f);
+}
+
 void renderQuad()
 {
     if (quadVAO == 0)
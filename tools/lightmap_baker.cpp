@@ -0,0 +1,498 @@
+// Offline lightmap baker for the static lanterns of the shack scene.
+//
+// Loads the static lit objects of rg/ShackScene.h the way learnopengl's Model does, without GL, builds one
+// BVH over the whole scene and traces direct light plus one diffuse bounce from ShackLanterns() into a
+// lightmap atlas, see rg/LightmapFile.h. Every core works on its own triangles, and rays go through the
+// BVH four at a time: four neighbouring texels towards one lantern, or four bounce rays of one texel.
+//
+// Run it from the repository root, where the renderer runs too:
+//   ./lightmap_baker [--density texels-per-unit] [--samples bounce-rays] [--threads n] [--out file]
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <rg/Bvh.h>
+#include <rg/JobSystem.h>
+#include <rg/LightmapFile.h>
+#include <rg/ShackScene.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BakeMesh {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<unsigned> indices;
+    glm::vec3 albedo = glm::vec3(0.5f);
+};
+
+struct BakeModel {
+    std::vector<BakeMesh> meshes;
+    size_t triangleCount = 0;
+};
+
+// the bounce only needs a rough colour per mesh, so the diffuse map is averaged
+glm::vec3 averageColor(const std::string& path, const glm::vec3& fallback) {
+    int width = 0, height = 0, components = 0;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 3);
+    if (!data)
+        return fallback;
+    double sum[3] = {};
+    size_t texels = (size_t)width * height;
+    for (size_t i = 0; i < 3 * texels; ++i)
+        sum[i % 3] += data[i];
+    stbi_image_free(data);
+    // sRGB images, brought to linear after averaging
+    double scale = 1.0 / (255.0 * (double)std::max<size_t>(1, texels));
+    glm::vec3 color((float)(sum[0] * scale), (float)(sum[1] * scale), (float)(sum[2] * scale));
+    return glm::pow(color, glm::vec3(2.2f));
+}
+
+void processNode(const aiNode* node, const aiScene* scene, const std::string& directory, BakeModel& model) {
+    for (unsigned i = 0; i < node->mNumMeshes; ++i) {
+        const aiMesh* source = scene->mMeshes[node->mMeshes[i]];
+        BakeMesh mesh;
+        for (unsigned v = 0; v < source->mNumVertices; ++v) {
+            mesh.positions.emplace_back(source->mVertices[v].x, source->mVertices[v].y, source->mVertices[v].z);
+            mesh.normals.push_back(source->HasNormals()
+                                           ? glm::vec3(source->mNormals[v].x, source->mNormals[v].y, source->mNormals[v].z)
+                                           : glm::vec3(0.0f));
+        }
+        for (unsigned f = 0; f < source->mNumFaces; ++f)
+            for (unsigned j = 0; j < source->mFaces[f].mNumIndices; ++j)
+                mesh.indices.push_back(source->mFaces[f].mIndices[j]);
+        const aiMaterial* material = scene->mMaterials[source->mMaterialIndex];
+        aiColor3D diffuse(0.5f, 0.5f, 0.5f);
+        material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+        mesh.albedo = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+        aiString texture;
+        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+            material->GetTexture(aiTextureType_DIFFUSE, 0, &texture) == AI_SUCCESS)
+            mesh.albedo = averageColor(directory + '/' + texture.C_Str(), mesh.albedo);
+        model.triangleCount += mesh.indices.size() / 3;
+        model.meshes.push_back(std::move(mesh));
+    }
+    for (unsigned i = 0; i < node->mNumChildren; ++i)
+        processNode(node->mChildren[i], scene, directory, model);
+}
+
+// same flags and node order as learnopengl's Model, so mesh and triangle order match at runtime
+bool loadModel(const std::string& path, BakeModel& model) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                                                           aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        fprintf(stderr, "lightmap_baker: %s: %s\n", path.c_str(), importer.GetErrorString());
+        return false;
+    }
+    processNode(scene->mRootNode, scene, path.substr(0, path.find_last_of('/')), model);
+    return true;
+}
+
+// one right-triangle chart per triangle: corners at (x, y) + (1, 1), + (size, 0) and + (0, size) inside a
+// (size + 2)^2 cell, the border texels are baked too so bilinear filtering never reads unbaked texels
+struct Cell {
+    int x, y, size;
+};
+
+struct ChartLayout {
+    int width = 0, height = 0;
+    std::vector<Cell> cells; // per triangle over all meshes
+};
+
+const int MaxChartSize = 128;
+const int MaxLayoutSize = 2048;
+
+ChartLayout packCharts(const BakeModel& model, float texelsPerUnit) {
+    ChartLayout layout;
+    std::vector<int> sizes;
+    for (const BakeMesh& mesh : model.meshes)
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            const glm::vec3& a = mesh.positions[mesh.indices[t]];
+            float area = 0.5f * glm::length(glm::cross(mesh.positions[mesh.indices[t + 1]] - a,
+                                                       mesh.positions[mesh.indices[t + 2]] - a));
+            // a right triangle with legs of sqrt(2 * area) has the same area
+            sizes.push_back(glm::clamp((int)std::ceil(std::sqrt(2.0f * area) * texelsPerUnit), 1, MaxChartSize));
+        }
+    std::vector<uint32_t> order(sizes.size());
+    double totalArea = 0.0;
+    int largest = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        order[i] = (uint32_t)i;
+        totalArea += (double)(sizes[i] + 2) * (sizes[i] + 2);
+        largest = std::max(largest, sizes[i] + 2);
+    }
+    // shelves of the tallest cells first
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+    layout.width = std::max(largest, (int)std::ceil(std::sqrt(totalArea) * 1.05));
+    layout.cells.resize(sizes.size());
+    int x = 0, y = 0, shelfHeight = 0;
+    for (uint32_t triangle : order) {
+        int cell = sizes[triangle] + 2;
+        if (x + cell > layout.width) {
+            y += shelfHeight;
+            x = 0;
+            shelfHeight = 0;
+        }
+        layout.cells[triangle] = Cell{x, y, sizes[triangle]};
+        x += cell;
+        shelfHeight = std::max(shelfHeight, cell);
+    }
+    layout.height = y + shelfHeight;
+    return layout;
+}
+
+// the scene as the BVH sees it, with what the bounce needs per triangle
+struct BakeScene {
+    rg::Bvh bvh;
+    std::vector<glm::vec3> faceNormals;
+    std::vector<glm::vec3> albedos;
+    std::vector<rg::Light> lights;
+    float rayOffset = 2e-3f;
+};
+
+struct Random {
+    uint32_t state;
+
+    explicit Random(uint32_t seed) : state(seed * 747796405u + 2891336453u) {}
+
+    // PCG-RXS-M-XS
+    float Next() {
+        state = state * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (float)(((word >> 22u) ^ word) >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+uint32_t hash(uint32_t a, uint32_t b) {
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Diffuse light from every lantern at up to four points (bit i of mask for point i), with CalcLight's
+// attenuation; ambient comes from the sky at runtime and specular depends on the view, neither is baked.
+void lightPoints(const BakeScene& scene, const glm::vec3* points, const glm::vec3* normals, int mask, glm::vec3* result,
+                 std::atomic<uint64_t>& rays) {
+    for (int i = 0; i < 4; ++i)
+        result[i] = glm::vec3(0.0f);
+    for (const rg::Light& light : scene.lights) {
+        rg::RayPacket packet;
+        float attenuation[4] = {}, cosine[4] = {};
+        int active = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!((mask >> i) & 1))
+                continue;
+            glm::vec3 origin = points[i] + normals[i] * scene.rayOffset;
+            glm::vec3 toLight = light.position - origin;
+            float distance = glm::length(toLight);
+            glm::vec3 direction = toLight / std::max(distance, 1e-6f);
+            for (int a = 0; a < 3; ++a) {
+                packet.origin[a][i] = origin[a];
+                packet.direction[a][i] = direction[a];
+            }
+            packet.tMax[i] = distance;
+            float falloff = distance / light.range;
+            falloff *= falloff;
+            float window = glm::clamp(1.0f - falloff * falloff, 0.0f, 1.0f);
+            float intensity = glm::clamp((glm::dot(direction, -light.direction) - light.outerCutOff) /
+                                                 (light.cutOff - light.outerCutOff),
+                                         0.0f, 1.0f);
+            attenuation[i] = window * window * intensity /
+                             (light.constant + light.linear * distance + light.quadratic * distance * distance);
+            cosine[i] = std::max(glm::dot(normals[i], direction), 0.0f);
+            if (cosine[i] > 0.0f && attenuation[i] > 0.0f)
+                active |= 1 << i;
+        }
+        if (!active)
+            continue;
+        int occluded = scene.bvh.Occluded(packet, active);
+        rays.fetch_add((uint64_t)__builtin_popcount(active), std::memory_order_relaxed);
+        for (int i = 0; i < 4; ++i)
+            if ((active >> i) & 1 && !((occluded >> i) & 1))
+                result[i] += light.diffuse * cosine[i] * attenuation[i];
+    }
+}
+
+// one bounce: cosine-weighted rays from the point, the light arriving where they hit, scaled by that albedo
+glm::vec3 bounceLight(const BakeScene& scene, const glm::vec3& point, const glm::vec3& normal, int samples,
+                      Random& random, std::atomic<uint64_t>& rays) {
+    glm::vec3 tangent = glm::normalize(glm::cross(std::fabs(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                                             : glm::vec3(1.0f, 0.0f, 0.0f),
+                                                  normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    glm::vec3 origin = point + normal * scene.rayOffset;
+    glm::vec3 sum(0.0f);
+    for (int first = 0; first < samples; first += 4) {
+        rg::RayPacket packet;
+        int mask = 0;
+        for (int i = 0; i < 4 && first + i < samples; ++i) {
+            float phi = 6.2831853f * random.Next();
+            float r2 = random.Next();
+            float r = std::sqrt(r2);
+            glm::vec3 direction = tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+                                  normal * std::sqrt(std::max(0.0f, 1.0f - r2));
+            for (int a = 0; a < 3; ++a) {
+                packet.origin[a][i] = origin[a];
+                packet.direction[a][i] = direction[a];
+            }
+            packet.tMax[i] = 1e30f;
+            mask |= 1 << i;
+        }
+        rg::PacketHit hit;
+        scene.bvh.Intersect(packet, hit, mask);
+        rays.fetch_add((uint64_t)__builtin_popcount(mask), std::memory_order_relaxed);
+        glm::vec3 points[4], normals[4], light[4];
+        int hitMask = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!((mask >> i) & 1) || hit.triangle[i] == rg::Bvh::NoHit)
+                continue;
+            glm::vec3 direction(packet.direction[0][i], packet.direction[1][i], packet.direction[2][i]);
+            points[i] = origin + direction * hit.t[i];
+            normals[i] = scene.faceNormals[hit.triangle[i]];
+            if (glm::dot(normals[i], direction) > 0.0f)
+                normals[i] = -normals[i];
+            hitMask |= 1 << i;
+        }
+        if (!hitMask)
+            continue;
+        lightPoints(scene, points, normals, hitMask, light, rays);
+        for (int i = 0; i < 4; ++i)
+            if ((hitMask >> i) & 1)
+                sum += scene.albedos[hit.triangle[i]] * light[i];
+    }
+    return sum / (float)std::max(1, samples);
+}
+
+void usage() {
+    fprintf(stderr, "usage: lightmap_baker [--density texels-per-unit] [--samples bounce-rays] [--threads n] "
+                    "[--out file]\n");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    float density = 4.0f;
+    int samples = 32;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string outPath = "resources/lightmaps.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "--density"))
+            density = std::max(0.1f, (float)atof(argv[++i]));
+        else if (i + 1 < argc && !strcmp(argv[i], "--samples"))
+            samples = std::max(0, atoi(argv[++i]));
+        else if (i + 1 < argc && !strcmp(argv[i], "--threads"))
+            threads = (unsigned)std::max(1, atoi(argv[++i]));
+        else if (i + 1 < argc && !strcmp(argv[i], "--out"))
+            outPath = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<rg::ShackPlacement>& placements = rg::ShackLitObjects();
+
+    // load each model once, along with the largest scale it is placed at
+    BakeModel models[(int)rg::ShackModel::Count];
+    bool used[(int)rg::ShackModel::Count] = {};
+    float maxScale[(int)rg::ShackModel::Count] = {};
+    for (const rg::ShackPlacement& placement : placements) {
+        int model = (int)placement.model;
+        maxScale[model] = std::max(maxScale[model], std::max(placement.scale.x, std::max(placement.scale.y, placement.scale.z)));
+        if (used[model])
+            continue;
+        used[model] = true;
+        if (!loadModel(rg::ShackModelPath(placement.model), models[model]))
+            return 1;
+    }
+
+    // charts per model, shrunk until they fit a layout of MaxLayoutSize
+    rg::LightmapFile file;
+    ChartLayout layouts[(int)rg::ShackModel::Count];
+    for (int model = 0; model < (int)rg::ShackModel::Count; ++model) {
+        if (!used[model])
+            continue;
+        float texelsPerUnit = density * maxScale[model];
+        do {
+            layouts[model] = packCharts(models[model], texelsPerUnit);
+            texelsPerUnit *= 0.7f;
+        } while (layouts[model].height > MaxLayoutSize && texelsPerUnit * MaxChartSize > 1.0f);
+        const ChartLayout& layout = layouts[model];
+        rg::LightmapFile::ModelCharts charts;
+        charts.model = (uint32_t)model;
+        glm::vec2 size((float)layout.width, (float)layout.height);
+        for (const BakeMesh& mesh : models[model].meshes)
+            charts.meshTriangles.push_back((uint32_t)(mesh.indices.size() / 3));
+        for (const Cell& cell : layout.cells) {
+            glm::vec2 corner((float)cell.x + 1.0f, (float)cell.y + 1.0f);
+            charts.uvs.push_back(corner / size);
+            charts.uvs.push_back((corner + glm::vec2((float)cell.size, 0.0f)) / size);
+            charts.uvs.push_back((corner + glm::vec2(0.0f, (float)cell.size)) / size);
+        }
+        file.models.push_back(std::move(charts));
+    }
+
+    // one copy of its model's layout per object, shelf packed like the charts
+    std::vector<glm::ivec2> regionOrigins(placements.size());
+    {
+        std::vector<uint32_t> order(placements.size());
+        double totalArea = 0.0;
+        int widest = 0;
+        for (size_t i = 0; i < placements.size(); ++i) {
+            const ChartLayout& layout = layouts[(int)placements[i].model];
+            order[i] = (uint32_t)i;
+            totalArea += (double)layout.width * layout.height;
+            widest = std::max(widest, layout.width);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return layouts[(int)placements[a].model].height > layouts[(int)placements[b].model].height;
+        });
+        int width = (std::max(widest, (int)std::ceil(std::sqrt(totalArea) * 1.05)) + 3) & ~3;
+        int x = 0, y = 0, shelfHeight = 0;
+        for (uint32_t object : order) {
+            const ChartLayout& layout = layouts[(int)placements[object].model];
+            if (x + layout.width > width) {
+                y += shelfHeight;
+                x = 0;
+                shelfHeight = 0;
+            }
+            regionOrigins[object] = glm::ivec2(x, y);
+            x += layout.width;
+            shelfHeight = std::max(shelfHeight, layout.height);
+        }
+        file.width = (uint32_t)width;
+        file.height = (uint32_t)(y + shelfHeight);
+        for (size_t i = 0; i < placements.size(); ++i) {
+            const ChartLayout& layout = layouts[(int)placements[i].model];
+            float atlasWidth = (float)file.width, atlasHeight = (float)file.height;
+            file.regions.emplace_back((float)regionOrigins[i].x / atlasWidth, (float)regionOrigins[i].y / atlasHeight,
+                                      (float)layout.width / atlasWidth, (float)layout.height / atlasHeight);
+        }
+    }
+
+    // world space triangles of every object, the lanterns themselves are not in ShackLitObjects
+    BakeScene scene;
+    scene.lights = rg::ShackLanterns();
+    std::vector<glm::mat4> transforms;
+    std::vector<size_t> firstTriangle;
+    {
+        std::vector<glm::vec3> positions;
+        for (const rg::ShackPlacement& placement : placements) {
+            glm::mat4 transform = rg::PlacementTransform(placement.position, placement.scale, placement.rotationAxis,
+                                                         placement.angle, placement.rotate);
+            transforms.push_back(transform);
+            firstTriangle.push_back(positions.size() / 3);
+            for (const BakeMesh& mesh : models[(int)placement.model].meshes)
+                for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+                    glm::vec3 v[3];
+                    for (int k = 0; k < 3; ++k) {
+                        v[k] = glm::vec3(transform * glm::vec4(mesh.positions[mesh.indices[t + k]], 1.0f));
+                        positions.push_back(v[k]);
+                    }
+                    glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+                    float length = glm::length(normal);
+                    scene.faceNormals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f));
+                    scene.albedos.push_back(mesh.albedo);
+                }
+        }
+        scene.bvh.Build(positions);
+    }
+    auto built = std::chrono::steady_clock::now();
+    printf("lightmap_baker: %zu triangles, %zu BVH nodes, %ux%u atlas\n", scene.bvh.TriangleCount(),
+           scene.bvh.NodeCount(), file.width, file.height);
+
+    // every texel of a cell belongs to one triangle, so the triangles bake in parallel without locks
+    std::vector<glm::vec3> irradiance((size_t)file.width * file.height, glm::vec3(0.0f));
+    std::atomic<uint64_t> rays(0);
+    rg::JobSystem jobs(threads);
+    jobs.ParallelFor(scene.faceNormals.size(), 64, [&](size_t begin, size_t end) {
+        size_t object = 0;
+        for (size_t triangle = begin; triangle < end; ++triangle) {
+            while (object + 1 < firstTriangle.size() && firstTriangle[object + 1] <= triangle)
+                ++object;
+            const rg::ShackPlacement& placement = placements[object];
+            const BakeModel& model = models[(int)placement.model];
+            size_t local = triangle - firstTriangle[object];
+            const Cell& cell = layouts[(int)placement.model].cells[local];
+            const BakeMesh* mesh = &model.meshes[0];
+            size_t meshTriangle = local;
+            while (meshTriangle >= mesh->indices.size() / 3) {
+                meshTriangle -= mesh->indices.size() / 3;
+                ++mesh;
+            }
+            glm::vec3 vertices[3], normals[3];
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transforms[object])));
+            for (int k = 0; k < 3; ++k) {
+                unsigned index = mesh->indices[3 * meshTriangle + k];
+                vertices[k] = glm::vec3(transforms[object] * glm::vec4(mesh->positions[index], 1.0f));
+                normals[k] = normalMatrix * mesh->normals[index];
+            }
+            glm::vec3 faceNormal = scene.faceNormals[triangle];
+            Random random(hash((uint32_t)triangle, 0x4C4D4150u));
+
+            // texels in groups of four along the cell's rows, the closest point of the triangle for border texels
+            int cellSize = cell.size + 2, texelCount = cellSize * cellSize;
+            int originX = regionOrigins[object].x + cell.x, originY = regionOrigins[object].y + cell.y;
+            for (int first = 0; first < texelCount; first += 4) {
+                glm::vec3 points[4], shading[4], geometric[4], direct[4];
+                int mask = 0;
+                for (int i = 0; i < 4 && first + i < texelCount; ++i) {
+                    int tx = (first + i) % cellSize, ty = (first + i) / cellSize;
+                    float u = std::max(0.0f, ((float)tx - 0.5f) / (float)cell.size);
+                    float v = std::max(0.0f, ((float)ty - 0.5f) / (float)cell.size);
+                    if (u + v > 1.0f) {
+                        float sum = u + v;
+                        u /= sum;
+                        v /= sum;
+                    }
+                    float w = 1.0f - u - v;
+                    points[i] = vertices[0] * w + vertices[1] * u + vertices[2] * v;
+                    glm::vec3 normal = normals[0] * w + normals[1] * u + normals[2] * v;
+                    float length = glm::length(normal);
+                    shading[i] = length > 0.0f ? normal / length : faceNormal;
+                    // rays leave on the side the shading normal faces, two-sided leaves and walls included
+                    geometric[i] = glm::dot(faceNormal, shading[i]) < 0.0f ? -faceNormal : faceNormal;
+                    mask |= 1 << i;
+                }
+                lightPoints(scene, points, geometric, mask, direct, rays);
+                for (int i = 0; i < 4; ++i) {
+                    if (!((mask >> i) & 1))
+                        continue;
+                    glm::vec3 total = direct[i];
+                    if (samples > 0)
+                        total += bounceLight(scene, points[i], geometric[i], samples, random, rays);
+                    int tx = (first + i) % cellSize, ty = (first + i) / cellSize;
+                    irradiance[(size_t)(originY + ty) * file.width + originX + tx] = total;
+                }
+            }
+        }
+    });
+
+    file.texels.resize(irradiance.size());
+    for (size_t i = 0; i < irradiance.size(); ++i)
+        file.texels[i] = rg::PackRGB9E5(irradiance[i]);
+    if (!file.Write(outPath)) {
+        fprintf(stderr, "lightmap_baker: could not write %s\n", outPath.c_str());
+        return 1;
+    }
+    auto done = std::chrono::steady_clock::now();
+    double bakeSeconds = std::chrono::duration<double>(done - built).count();
+    printf("lightmap_baker: %u threads, %.1f s loading and BVH, %.1f s baking, %.2f Mrays/s -> %s\n",
+           jobs.ThreadCount(), std::chrono::duration<double>(built - start).count(), bakeSeconds,
+           (double)rays.load() / 1e6 / std::max(bakeSeconds, 1e-6), outPath.c_str());
+    return 0;
+}